@@ -1,3 +1,31 @@
+/*
+ * microbenchmark1.c - TLB Shootdown Scaling Benchmark
+ *
+ * Every worker mprotects its own region in a loop while workers on all
+ * other nodes do the same, so each flush has to reach every node the mm
+ * runs on. Workers can fill several or all CPUs of each node to show how
+ * shootdown cost grows with cores, not just nodes.
+ *
+ * With --rate the workers run open loop instead: mprotect calls arrive on
+ * a schedule (fixed or Poisson) and latency counts from the scheduled
+ * time, so a sweep of rates yields throughput-vs-p99 curves and the knee
+ * where shootdown cost saturates a node.
+ *
+ * With --processes each worker is a forked process with its own mm, so a
+ * flush only reaches the CPUs of that one process; --memfd makes the
+ * processes share one MAP_SHARED memfd carved into their slices. Against
+ * the threaded run this tells the cpumask narrowing apart from what
+ * replication adds on top.
+ *
+ * --nodes sweeps the active node subset: step k runs workers on the first
+ * k nodes with CPUs, and a table of throughput, speedup over the first
+ * step and parallel efficiency follows. Run it once plain and once under
+ * numactl -r all for the two scaling curves.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark1 [-t <threads_per_node> | --all-cpus]
+ */
+
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,156 +34,680 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <sched.h>
-#include <numa.h>
-#include <numaif.h>
-#include <time.h>
+#include <getopt.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
 
 #define NUM_OPS 20000
-#define REGION_SIZE (8 * 1024 * 1024)  /* 8MB per thread */
+#define REGION_SIZE (8 * 1024 * 1024)  /* 8MB per thread, page rounded */
+#define MAX_RATES 64
+#define RATE_POINT_SEC 2        /* default open-loop run per rate, see run_default_duration */
+#define KNEE_ACHIEVED 0.95      /* knee: achieved below 95% of offered */
+#define KNEE_P99_FACTOR 10      /* ... or p99 10x that of the lowest rate */
+#define MAX_STEPS 64
 
 static int num_nodes;
-static volatile int ready_count = 0;
-static volatile int go = 0;
+static size_t region_size;
+static int threads_per_node = 1;
+static int all_cpus;
+static int num_workers;
+static start_barrier_t *barrier;  /* shared_calloc(), --processes children arrive on it */
+
+/* Shared-mapping mode: all workers mprotect slices of one VMA */
+static int shared_mode;
+static size_t slice_stride;
+static int slice_align_pmd;
+static slice_region_t slices;
+
+/* Open-loop sweep (--rate), mprotect calls per second per thread */
+static double rates[MAX_RATES];
+static int num_rates;
+static double cur_rate;
+static int poisson;
 
+/* Node-count sweep (--nodes), active nodes with CPUs per step */
+static const char *node_steps_arg;
+static int node_steps[MAX_STEPS];
+static int num_steps;
+static double cur_speedup;  /* over the first step, 0 outside a sweep */
+static double cur_efficiency;
+
+/* One point of a rate or node sweep */
 typedef struct {
-    int node;
-    void *region;
-    double elapsed_sec;
-    uint64_t ops;
-} worker_data_t;
-
-static void pin_to_node(int node) {
-    struct bitmask *cpus = numa_allocate_cpumask();
-    cpu_set_t cpuset;
-    
-    if (numa_node_to_cpus(node, cpus) < 0) {
-        numa_free_cpumask(cpus);
-        return;
-    }
-    
-    CPU_ZERO(&cpuset);
-    for (int i = 0; i < numa_num_configured_cpus(); i++) {
-        if (numa_bitmask_isbitset(cpus, i)) {
-            CPU_SET(i, &cpuset);
-            break; /* Just first CPU on node */
-        }
-    }
-    numa_free_cpumask(cpus);
-    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+    double rate;
+    int nodes;
+    int workers;
+    uint64_t total_ops;
+    double max_time;
+    double p50, p99, p999;
+} rate_row_t;
+
+static const char *const lat_names[LAT_SLOTS] = {
+    [LAT_RW_TO_RO] = "RW->RO",
+    [LAT_RO_TO_RW] = "RO->RW",
+};
+
+static const char *const open_lat_names[LAT_SLOTS] = {
+    [LAT_RESPONSE] = "response",
+    [LAT_SERVICE]  = "service",
+};
+
+static const char *const *cur_lat_names(void) {
+    return cur_rate > 0 ? open_lat_names : lat_names;
+}
+
+static void run_load(worker_data_t *data, run_budget_t budget) {
+    if (cur_rate > 0)
+        run_mprotect_open_loop(data, region_size, budget, cur_rate, poisson);
+    else
+        run_mprotect_toggle(data, region_size, budget);
+}
+
+/* "1000,5000,20k": rates per thread; returns count or -1 */
+static int parse_rates(const char *arg) {
+    char *copy = strdup(arg), *tok, *save, *end;
+    int n = 0;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        double r = strtod(tok, &end);
+
+        if (*end == 'k' || *end == 'K')
+            r *= 1e3, end++;
+        else if (*end == 'm' || *end == 'M')
+            r *= 1e6, end++;
+        if (*end != '\0' || r <= 0 || n == MAX_RATES) {
+            n = -1;
+            break;
+        }
+        rates[n++] = r;
+    }
+    free(copy);
+    return n;
 }
 
 static void *worker(void *arg) {
     worker_data_t *data = (worker_data_t *)arg;
-    struct timespec start, end;
-    
-    /* Pin to our node */
-    pin_to_node(data->node);
-    
-    /* Allocate and touch memory */
-    data->region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (data->region == MAP_FAILED) {
-        perror("mmap");
+
+    /* Pin to our CPU on our node */
+    pin_to_cpu(data->cpu);
+
+    /* Allocate and touch memory (our slice only in shared mode) */
+    if (shared_mode) {
+        data->region = slice_region_get(&slices, data->id);
+        memset(data->region, 0xAB, region_size);
+    } else {
+        data->region = region_alloc(region_size);
+    }
+    if (!data->region) {
+        barrier_arrive_and_wait(data->barrier);
         return NULL;
     }
-    
-    /* Touch pages to fault them in on THIS node */
-    memset(data->region, 0xAB, REGION_SIZE);
-    
+
+    /* Pilot for --target-rse; before the barrier so it is never timed */
+    if (run_calibrating()) {
+        run_load(data, run_budget_fixed(RUN_PILOT_ITERS));
+        run_calibrate_report(data, LAT_RW_TO_RO, 1);
+    }
+
     /* Signal ready and wait for go */
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
-    }
-    
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    
-    /* Main loop: mprotect triggers TLB shootdowns */
-    for (int i = 0; i < NUM_OPS; i++) {
-        mprotect(data->region, REGION_SIZE, PROT_READ);
-        mprotect(data->region, REGION_SIZE, PROT_READ | PROT_WRITE);
-        data->ops += 2;
-    }
-    
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
-    
-    munmap(data->region, REGION_SIZE);
+    barrier_arrive_and_wait(data->barrier);
+
+    perf_thread_start(&data->perf);
+    run_load(data, run_budget(NUM_OPS));
+    perf_thread_stop(&data->perf);
+
+    if (!shared_mode)
+        region_free(data->region, region_size);
     return NULL;
 }
 
+/*
+ * Throughput-vs-latency curve of a rate sweep. The knee is the first rate
+ * that is not sustained (achieved < KNEE_ACHIEVED of offered) or whose
+ * response p99 exceeds KNEE_P99_FACTOR times that of the lowest rate.
+ */
+static void print_rate_table(const rate_row_t *rows, int n) {
+    int knee = -1;
+
+    printf("\n");
+    print_rule();
+    printf("RATE SWEEP (%d threads, %s arrivals, response time from schedule):\n",
+           num_workers, poisson ? "Poisson" : "fixed");
+    print_rule();
+    printf("  %12s %14s %14s %9s %10s %10s %10s\n", "rate/thread", "offered/sec",
+           "achieved/sec", "achieved", "p50 us", "p99 us", "p99.9 us");
+    for (int i = 0; i < n; i++) {
+        const rate_row_t *r = &rows[i];
+        double offered = r->rate * num_workers;
+        double achieved = r->total_ops / r->max_time;
+
+        if (knee < 0 && (achieved < KNEE_ACHIEVED * offered ||
+                         r->p99 > KNEE_P99_FACTOR * rows[0].p99))
+            knee = i;
+        printf("  %12.0f %14.0f %14.0f %8.1f%% %10.2f %10.2f %10.2f%s\n", r->rate, offered,
+               achieved, 100.0 * achieved / offered, r->p50, r->p99, r->p999,
+               knee == i ? "  <- knee" : "");
+    }
+    if (knee > 0)
+        printf("Knee: between %.0f and %.0f calls/sec per thread\n",
+               rows[knee - 1].rate, rows[knee].rate);
+    else if (knee == 0)
+        printf("Knee: at or below the lowest rate (%.0f calls/sec per thread)\n", rows[0].rate);
+    else
+        printf("Knee: not reached (highest rate sustained)\n");
+    print_rule();
+}
+
+/*
+ * "1..N", "1..4", "1,2,4" or a mix: active node counts, where N is the
+ * number of nodes with CPUs. Returns the step count or -1.
+ */
+static int parse_node_steps(const char *arg) {
+    char *copy = strdup(arg), *tok, *save, *end;
+    int max = topo_cpu_nodes();
+    int n = 0;
+
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *dots = strstr(tok, "..");
+        long lo, hi;
+
+        if (dots)
+            *dots = '\0';
+        lo = strcmp(tok, "N") == 0 ? max : strtol(tok, &end, 10);
+        if (strcmp(tok, "N") != 0 && (end == tok || *end)) {
+            n = -1;
+            break;
+        }
+        hi = lo;
+        if (dots) {
+            hi = strcmp(dots + 2, "N") == 0 ? max : strtol(dots + 2, &end, 10);
+            if (strcmp(dots + 2, "N") != 0 && (end == dots + 2 || *end)) {
+                n = -1;
+                break;
+            }
+        }
+        if (lo < 1 || hi < lo || hi > max || n + (hi - lo + 1) > MAX_STEPS) {
+            n = -1;
+            break;
+        }
+        for (long k = lo; k <= hi; k++) {
+            node_steps[n++] = (int)k;
+        }
+    }
+    free(copy);
+    return n;
+}
+
+/* Workers on the first active nodes with CPUs (-1 = all), capped at their CPUs */
+static int count_workers(int active, int warn) {
+    int n = 0;
+
+    for (int node = 0; node < num_nodes && active != 0; node++) {
+        int cpus = node_cpu_count(node);
+        int want = all_cpus ? cpus : threads_per_node;
+
+        if (cpus == 0)
+            continue;
+        if (want > cpus) {
+            if (warn)
+                fprintf(stderr, "Warning: node %d has only %d CPUs\n", node, cpus);
+            want = cpus;
+        }
+        n += want;
+        active--;
+    }
+    return n;
+}
+
+/*
+ * Speedup of each step over the first one and parallel efficiency, the
+ * speedup divided by the growth in workers. Ideal scaling keeps the
+ * efficiency at 1; it falls as each flush has more nodes to reach.
+ */
+static void print_scaling_table(const rate_row_t *rows, int n) {
+    double base = rows[0].total_ops / rows[0].max_time;
+
+    printf("\n");
+    print_rule();
+    printf("NODE SCALING (%s, speedup over %d node%s):\n",
+           all_cpus ? "every CPU per node" : threads_per_node == 1 ? "one thread per node" :
+           "several threads per node", rows[0].nodes, rows[0].nodes > 1 ? "s" : "");
+    print_rule();
+    printf("  %6s %8s %14s %10s %9s %11s\n", "nodes", "threads", "ops/sec", "us/op",
+           "speedup", "efficiency");
+    for (int i = 0; i < n; i++) {
+        const rate_row_t *r = &rows[i];
+        double thr = r->total_ops / r->max_time;
+        double speedup = base > 0 ? thr / base : 0;
+
+        printf("  %6d %8d %14.0f %10.2f %8.2fx %10.1f%%\n", r->nodes, r->workers, thr,
+               r->max_time * 1e6 / (r->total_ops / r->workers), speedup,
+               100.0 * speedup * rows[0].workers / r->workers);
+    }
+    print_rule();
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-t <threads_per_node> | --all-cpus]\n", prog);
+    fprintf(stderr, "  -t, --threads-per-node  Workers per node, one per CPU (default: 1)\n");
+    fprintf(stderr, "      --all-cpus          One worker on every CPU of every node\n");
+    fprintf(stderr, "      --shared            Carve one mapping into per-thread slices\n");
+    fprintf(stderr, "      --stride SIZE       Distance between slice starts (default: slice size)\n");
+    fprintf(stderr, "      --slice-align A     page (default) or pmd: round the stride to 2MB\n");
+    fprintf(stderr, "      --rate LIST         Open loop: mprotect calls/sec per thread, e.g.\n");
+    fprintf(stderr, "                          1k,5k,20k,50k (sweeps; %d s per rate by default)\n",
+            RATE_POINT_SEC);
+    fprintf(stderr, "      --arrival A         fixed (default) or poisson schedule for --rate\n");
+    fprintf(stderr, "      --nodes STEPS       Sweep the active node count, e.g. 1..N, 1..4 or\n");
+    fprintf(stderr, "                          1,2,4 (N = nodes with CPUs); one run per step\n");
+    fprintf(stderr, "  -h, --help              Show this help\n");
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s\n", prog);
+    harness_print_usage();
+    process_print_usage();
+}
+
+/* Nodes the workers run on, which is what a shootdown without Hydra reaches */
+static unsigned long worker_node_mask(const worker_data_t *data) {
+    unsigned long mask = 0;
+
+    for (int i = 0; i < num_workers; i++) {
+        mask |= 1UL << data[i].node;
+    }
+    return mask;
+}
+
+/* Call-function IPIs per mprotect over the trial, -1 without --perf tracepoints */
+static double ipis_per_op(uint64_t total_ops) {
+    uint64_t ipis = 0;
+
+    if (perf_trial_ncpus() == 0 || total_ops == 0)
+        return -1;
+    for (int cpu = 0; cpu < perf_trial_ncpus(); cpu++) {
+        ipis += perf_trial_ipis(cpu);
+    }
+    return (double)ipis / total_ops;
+}
+
+/*
+ * Expected IPIs per mprotect from where the workers actually run. Without
+ * Hydra every other worker CPU is interrupted, W-1; with Hydra only the
+ * other workers on the caller's node, W_node-1 averaged over the workers.
+ * With --processes no worker shares a memory map, so neither arm IPIs
+ * another worker. The measured IPIs per call are set against the former.
+ */
+static void print_ipi_expectation(const worker_data_t *data, uint64_t total_ops) {
+    unsigned long mask = worker_node_mask(data);
+    int nodes = topo_mask_nodes(mask);
+    int sockets = topo_mask_sockets(mask);
+    int per_node[TOPO_MAX_NODES] = { 0 };
+    double measured = ipis_per_op(total_ops);
+    double without = num_workers - 1, with = 0;
+
+    for (int i = 0; i < num_workers; i++) {
+        per_node[data[i].node]++;
+    }
+    for (int node = 0; node < TOPO_MAX_NODES; node++) {
+        with += (double)per_node[node] * (per_node[node] - 1) / num_workers;
+    }
+
+    printf("Workers' cpumask: %d CPU%s on %d node%s, %d socket%s\n", num_workers,
+           num_workers > 1 ? "s" : "", nodes, nodes > 1 ? "s" : "",
+           sockets, sockets > 1 ? "s" : "");
+    if (worker_processes()) {
+        printf("Separate processes: no mprotect IPIs another worker, with or without Hydra\n");
+    } else {
+        printf("Without Hydra: each mprotect IPIs the other %d CPU%s, on all %d node%s\n",
+               num_workers - 1, num_workers == 2 ? "" : "s", nodes, nodes > 1 ? "s" : "");
+        printf("With Hydra: each mprotect IPIs the other workers on its node, %.2f on average\n",
+               with);
+        if (without == 0)
+            printf("Expected IPI reduction: none, a single worker IPIs no one\n");
+        else if (with == 0)
+            printf("Expected IPI reduction: all eliminated, one worker per node\n");
+        else
+            printf("Expected IPI reduction: ~%.1fx\n", without / with);
+    }
+    if (measured >= 0) {
+        printf("Measured: %.2f IPIs received per mprotect", measured);
+        if (measured > 0 && !worker_processes() && without > 0)
+            printf(", %.1fx below the cpumask", without / measured);
+        printf("\n");
+    }
+}
+
+static void emit_record(const worker_data_t *data, uint64_t total_ops, double max_time) {
+    rec_begin("microbenchmark1");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("threads", num_workers);
+    rec_int("threads_per_node", all_cpus ? -1 : threads_per_node);
+    rec_int("ops_per_thread", (long long)run_ops(NUM_OPS) * (cur_rate > 0 ? 1 : 2));
+    rec_run_budget(NUM_OPS);
+    rec_str("loop", cur_rate > 0 ? "open" : "closed");
+    rec_double("rate_per_thread", cur_rate);
+    rec_str("arrival", cur_rate > 0 ? (poisson ? "poisson" : "fixed") : "");
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("shared", shared_mode);
+    rec_int("slice_stride_bytes", shared_mode ? (long long)slice_stride : 0);
+    rec_str("worker_mode", worker_mode_name());
+    rec_int("memfd", region_memfd());
+    rec_int("nodes_reached", topo_mask_nodes(worker_node_mask(data)));
+    rec_int("sockets_reached", topo_mask_sockets(worker_node_mask(data)));
+    rec_close();
+    rec_topology();
+    rec_object("results");
+    rec_int("total_ops", (long long)total_ops);
+    rec_double("wall_time_sec", max_time);
+    rec_double("throughput_ops_per_sec", total_ops / max_time);
+    rec_int("expected_ipi_reduction", topo_mask_nodes(worker_node_mask(data)));
+    if (cur_speedup > 0) {
+        rec_double("speedup", cur_speedup);
+        rec_double("efficiency", cur_efficiency);
+    }
+    if (ipis_per_op(total_ops) >= 0)
+        rec_double("ipis_per_op", ipis_per_op(total_ops));
+    rec_close();
+    rec_workers(data, num_workers);
+    rec_nodes(data, num_workers, num_nodes);
+    rec_fairness(data, num_workers, num_nodes);
+    rec_start_skew(barrier);
+    rec_latency(data, num_workers, cur_lat_names());
+    rec_perf(data, num_workers, num_nodes);
+    rec_hydra();
+    rec_end();
+}
+
 int main(int argc, char **argv) {
-    pthread_t *threads;
+    worker_handle_t *workers;
     worker_data_t *data;
+    rate_row_t *rows;
+    hist_t *merged;
     uint64_t total_ops = 0;
     double max_time = 0;
-    
-    if (numa_available() < 0) {
-        fprintf(stderr, "NUMA not available\n");
+    int max_workers, num_points;
+    char tag[32];
+
+    static struct option long_opts[] = {
+        {"threads-per-node", required_argument, 0, 't'},
+        {"all-cpus", no_argument, 0, 'A'},
+        {"shared", no_argument, 0, 'S'},
+        {"stride", required_argument, 0, 'D'},
+        {"slice-align", required_argument, 0, 'L'},
+        {"rate", required_argument, 0, 'R'},
+        {"arrival", required_argument, 0, 'a'},
+        {"nodes", required_argument, 0, 'N'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        PROCESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            threads_per_node = atoi(optarg);
+            if (threads_per_node < 1) {
+                fprintf(stderr, "threads per node must be >= 1\n");
+                return 1;
+            }
+            break;
+        case 'A':
+            all_cpus = 1;
+            break;
+        case 'S':
+            shared_mode = 1;
+            break;
+        case 'D':
+            slice_stride = parse_size(optarg);
+            if (slice_stride == 0) {
+                fprintf(stderr, "Invalid stride: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            if (strcmp(optarg, "pmd") == 0)
+                slice_align_pmd = 1;
+            else if (strcmp(optarg, "page") == 0)
+                slice_align_pmd = 0;
+            else {
+                fprintf(stderr, "Unknown slice alignment: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'R':
+            num_rates = parse_rates(optarg);
+            if (num_rates < 1) {
+                fprintf(stderr, "Invalid rate list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            if (strcmp(optarg, "poisson") == 0)
+                poisson = 1;
+            else if (strcmp(optarg, "fixed") == 0)
+                poisson = 0;
+            else {
+                fprintf(stderr, "Unknown arrival schedule: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'N':
+            node_steps_arg = optarg;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
         return 1;
+    region_size = region_round(REGION_SIZE);
+    if (region_memfd())
+        shared_mode = 1;
+    if (node_steps_arg) {
+        num_steps = parse_node_steps(node_steps_arg);
+        if (num_steps < 1) {
+            fprintf(stderr, "Invalid node steps: %s (1 to %d nodes)\n",
+                    node_steps_arg, topo_cpu_nodes());
+            return 1;
+        }
+        if (num_rates > 0) {
+            fprintf(stderr, "--nodes and --rate cannot be combined\n");
+            return 1;
+        }
     }
-    
-    num_nodes = numa_num_configured_nodes();
-    
-    printf("========================================\n");
-    printf("Hydra TLB Shootdown Benchmark\n");
-    printf("========================================\n");
+
+    /* One worker per CPU slot, capped at the CPUs each node has */
+    num_workers = count_workers(-1, 1);
+    max_workers = num_workers;
+
+    print_banner("Hydra TLB Shootdown Benchmark");
     printf("NUMA nodes: %d\n", num_nodes);
-    printf("Threads: %d (one per node)\n", num_nodes);
-    printf("Ops per thread: %d\n", NUM_OPS * 2);
-    printf("Region per thread: %d MB\n", REGION_SIZE / (1024*1024));
-    printf("\n");
-    
-    threads = calloc(num_nodes, sizeof(pthread_t));
-    data = calloc(num_nodes, sizeof(worker_data_t));
-    
-    /* Create workers */
-    for (int i = 0; i < num_nodes; i++) {
-        data[i].node = i;
-        data[i].ops = 0;
-        if (pthread_create(&threads[i], NULL, worker, &data[i]) != 0) {
-            perror("pthread_create");
-            return 1;
+    print_topology();
+    if (all_cpus)
+        printf("Threads: %d (every CPU of every node)\n", num_workers);
+    else if (threads_per_node == 1)
+        printf("Threads: %d (one per node)\n", num_workers);
+    else
+        printf("Threads: %d (%d per node)\n", num_workers, threads_per_node);
+    if (worker_processes())
+        printf("Workers: one forked process each (own mm)\n");
+    if (num_steps > 0) {
+        printf("Node sweep:");
+        for (int i = 0; i < num_steps; i++) {
+            printf(" %d", node_steps[i]);
         }
+        printf(" (first nodes with CPUs)\n");
+    }
+    if (num_rates > 0) {
+        printf("Open loop: %d rate%s per thread, %s arrivals\n", num_rates,
+               num_rates > 1 ? "s" : "", poisson ? "Poisson" : "fixed");
+        run_default_duration(RATE_POINT_SEC);
+        print_run_budget("Mprotect calls per thread per rate", NUM_OPS);
+    } else {
+        print_run_budget("Mprotect pairs per thread", NUM_OPS);
+    }
+    printf("Region per thread: %zu MB\n", region_size / (1024*1024));
+    print_page_layout(region_size);
+    if (shared_mode) {
+        slice_stride = slice_stride_for(region_size, slice_stride, slice_align_pmd);
+        if (slice_region_map(&slices, num_workers, region_size, slice_stride) != 0)
+            return 1;
+        print_slice_layout(&slices, num_workers);
     }
-    
-    /* Wait for all threads ready */
-    while (ready_count < num_nodes) {
-        usleep(1000);
-    }
-    
-    printf("All threads ready. Starting benchmark...\n\n");
-    
-    /* GO! */
-    go = 1;
-    __sync_synchronize();
-    
-    /* Wait for completion */
-    for (int i = 0; i < num_nodes; i++) {
-        pthread_join(threads[i], NULL);
-        printf("Node %d: %.3f sec, %lu ops\n", 
-               i, data[i].elapsed_sec, (unsigned long)data[i].ops);
-        total_ops += data[i].ops;
-        if (data[i].elapsed_sec > max_time)
-            max_time = data[i].elapsed_sec;
-    }
-    
-    printf("\n========================================\n");
-    printf("RESULTS:\n");
-    printf("========================================\n");
-    printf("Total mprotect ops: %lu\n", (unsigned long)total_ops);
-    printf("Wall time: %.3f sec\n", max_time);
-    printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
     printf("\n");
-    printf("Without Hydra: each mprotect IPIs all %d nodes\n", num_nodes);
-    printf("With Hydra: each mprotect IPIs only 1 node\n");
-    printf("Expected IPI reduction: ~%dx\n", num_nodes);
-    printf("========================================\n");
-    
-    free(threads);
-    free(data);
+
+    workers = calloc(num_workers, sizeof(worker_handle_t));
+    data = shared_calloc(num_workers, sizeof(worker_data_t));
+    barrier = shared_calloc(1, sizeof(*barrier));
+    num_points = num_rates > 0 ? num_rates : num_steps > 0 ? num_steps : 1;
+    rows = calloc(num_points, sizeof(rate_row_t));
+    merged = malloc(sizeof(*merged));
+    if (!workers || !data || !barrier || !rows || !merged) {
+        perror("calloc");
+        return 1;
+    }
+
+    /* One closed-loop run, or one run per rate or node-count step */
+    for (int point = 0; point < num_points; point++) {
+        if (num_rates > 0) {
+            cur_rate = rates[point];
+            printf("--- Rate %.0f calls/sec per thread, %.0f offered ---\n",
+                   cur_rate, cur_rate * num_workers);
+        }
+        if (num_steps > 0) {
+            num_workers = count_workers(node_steps[point], 0);
+            printf("--- %d node%s, %d thread%s ---\n", node_steps[point],
+                   node_steps[point] > 1 ? "s" : "", num_workers, num_workers > 1 ? "s" : "");
+        }
+        memset(data, 0, max_workers * sizeof(worker_data_t));
+        run_calibrate_reset();
+
+        /* Create workers, node by node, on that node's first CPUs */
+        int idx = 0;
+        for (int node = 0; node < num_nodes; node++) {
+            for (int t = 0; idx < num_workers; t++) {
+                int cpu = (all_cpus || t < threads_per_node) ? get_cpu_for_node(node, t) : -1;
+                if (cpu < 0)
+                    break;
+
+                data[idx].id = idx;
+                data[idx].node = node;
+                data[idx].cpu = cpu;
+                data[idx].barrier = barrier;
+                if (worker_start(&workers[idx], worker, &data[idx]) != 0)
+                    return 1;
+                idx++;
+            }
+        }
+
+        /* Wait for all threads ready */
+        barrier_wait_ready(barrier, num_workers);
+        print_run_calibration(NUM_OPS);
+
+        printf("All threads ready. Starting benchmark...\n\n");
+
+        hydra_trial_begin();
+        perf_trial_begin();
+
+        /* GO! */
+        barrier_release(barrier);
+
+        /* Wait for completion */
+        for (int i = 0; i < num_workers; i++) {
+            worker_join(&workers[i]);
+        }
+        perf_trial_end();
+        hydra_trial_end();
+
+        /* Tag this point's A/B metrics, the fairness one included */
+        if (num_rates > 1) {
+            snprintf(tag, sizeof(tag), "%.0f/s", cur_rate);
+            ab_set_tag(tag);
+        }
+        if (num_steps > 1) {
+            snprintf(tag, sizeof(tag), "%d nodes", node_steps[point]);
+            ab_set_tag(tag);
+        }
+        report_workers(data, num_workers, &total_ops, &max_time);
+        if (num_workers > num_nodes) {
+            printf("\n");
+            report_nodes(data, num_workers, num_nodes);
+        }
+        printf("\n");
+        report_fairness(data, num_workers, num_nodes);
+
+        printf("\n");
+        print_rule();
+        if (cur_rate > 0)
+            printf("RESULTS (open loop, %.0f calls/sec per thread):\n", cur_rate);
+        else
+            printf("RESULTS:\n");
+        print_rule();
+        printf("Total mprotect ops: %lu\n", (unsigned long)total_ops);
+        printf("Wall time: %.3f sec\n", max_time);
+        if (cur_rate > 0)
+            printf("Offered: %.0f ops/sec\n", cur_rate * num_workers);
+        printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
+        rows[point].nodes = num_steps > 0 ? node_steps[point] : topo_cpu_nodes();
+        rows[point].workers = num_workers;
+        rows[point].total_ops = total_ops;
+        rows[point].max_time = max_time;
+        if (num_steps > 0) {
+            cur_speedup = (total_ops / max_time) / (rows[0].total_ops / rows[0].max_time);
+            cur_efficiency = cur_speedup * rows[0].workers / num_workers;
+            printf("Speedup over %d node%s: %.2fx, efficiency %.1f%%\n", rows[0].nodes,
+                   rows[0].nodes > 1 ? "s" : "", cur_speedup, 100.0 * cur_efficiency);
+        }
+        print_start_skew(barrier);
+        report_latency(data, num_workers, cur_lat_names());
+        report_perf(data, num_workers, num_nodes);
+        report_ab_metrics(data, num_workers, cur_lat_names(), total_ops / max_time,
+                          (max_time * 1e6) / (total_ops / num_workers));
+        if (num_steps > 0)
+            ab_report_metric("parallel efficiency", cur_efficiency, 1);
+        printf("\n");
+        print_ipi_expectation(data, total_ops);
+        hydra_print_delta();
+        print_rule();
+
+        if (report_structured())
+            emit_record(data, total_ops, max_time);
+
+        latency_merge(data, num_workers, LAT_RESPONSE, merged);
+        rows[point].rate = cur_rate;
+        rows[point].p50 = hist_percentile(merged, 50.0) / 1e3;
+        rows[point].p99 = hist_percentile(merged, 99.0) / 1e3;
+        rows[point].p999 = hist_percentile(merged, 99.9) / 1e3;
+        if (num_rates > 1 || num_steps > 1)
+            printf("\n");
+    }
+
+    if (num_rates > 1)
+        print_rate_table(rows, num_rates);
+    if (num_steps > 1)
+        print_scaling_table(rows, num_steps);
+
+    slice_region_unmap(&slices);
+    free(merged);
+    free(rows);
+    free(workers);
+    shared_free(barrier, 1, sizeof(*barrier));
+    shared_free(data, max_workers, sizeof(worker_data_t));
     return 0;
 }
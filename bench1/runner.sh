@@ -0,0 +1,102 @@
+#!/bin/bash
+
+# microbenchmark1_runner.sh - TLB Shootdown Node Scaling Runner
+#
+# Sweeps the active node count from 1 to all nodes WITHOUT Hydra and WITH
+# Hydra (numactl -r all), one thread per node and every CPU per node, so
+# the two speedup curves can be compared
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark1_runner.sh
+
+set -e
+
+BENCH="./microbenchmark1"
+HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per step (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Node steps and worker layouts to test
+STEPS="${STEPS:-1..N}"
+LAYOUTS=("-t 1" "--all-cpus")
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+echo "========================================================"
+echo "Microbenchmark 1: TLB Shootdown Node Scaling"
+echo "========================================================"
+echo "Node steps: $STEPS"
+echo "Layouts: ${LAYOUTS[*]}"
+echo "Each sweep runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for layout in "${LAYOUTS[@]}"; do
+    echo ""
+    echo "########################################################"
+    echo "# Testing layout: $layout"
+    echo "########################################################"
+
+    # --- WITHOUT HYDRA ---
+    echo ""
+    echo ">>> WITHOUT HYDRA (baseline Linux):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    $BENCH $layout --nodes "$STEPS" --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (without Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+
+    # --- WITH HYDRA ---
+    echo ""
+    echo ">>> WITH HYDRA (numactl -r all):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    numactl -r all $BENCH $layout --nodes "$STEPS" --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (with Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
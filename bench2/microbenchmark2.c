@@ -4,8 +4,11 @@
  * Tests Hydra's TLB shootdown optimization across different memory region sizes.
  * Measures how IPI reduction scales with region size.
  *
- * Compile: gcc -O2 -o microbenchmark2 microbenchmark2.c -lpthread -lnuma
- * Run:     numactl -r all ./microbenchmark2 -s <size_in_kb>
+ * A whole sweep (-s 4,64,512 or --range 4K:1G:x2) runs in one process: the
+ * threads stay pinned and are re-gated by the barrier for every size.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark2 -s <size_in_kb>[,<size_in_kb>...]
  */
 
 #define _GNU_SOURCE
@@ -16,102 +19,228 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <sched.h>
-#include <numa.h>
-#include <numaif.h>
-#include <time.h>
 #include <getopt.h>
 
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
 #define NUM_OPS 10000
+#define DEFAULT_WARMUP 100
+#define MAX_SIZES 64
 
 static int num_nodes;
+static int num_threads; /* one per node with CPUs */
 static size_t region_size;
-static volatile int ready_count = 0;
-static volatile int go = 0;
+static start_barrier_t barrier;
+
+/* Sweep points in bytes; region_size is the current one */
+static size_t sizes[MAX_SIZES];
+static int num_sizes;
+static int warmup_ops = DEFAULT_WARMUP;
 
 typedef struct {
-    int node;
-    void *region;
-    double elapsed_sec;
-    uint64_t ops;
-} worker_data_t;
-
-static void pin_to_node(int node) {
-    struct bitmask *cpus = numa_allocate_cpumask();
-    cpu_set_t cpuset;
+    size_t size;
+    uint64_t total_ops;
+    double max_time;
+    double p50[2];
+    double p99[2];
+} sweep_row_t;
+
+/* Shared-mapping mode: all workers mprotect slices of one VMA */
+static int shared_mode;
+static size_t slice_stride;
+static int slice_align_pmd;
+static slice_region_t slices;
+
+static const char *const lat_names[LAT_SLOTS] = {
+    [LAT_RW_TO_RO] = "RW->RO",
+    [LAT_RO_TO_RW] = "RO->RW",
+};
+
+/*
+ * One pass per sweep point: set up the region, warm up, then arrive twice,
+ * once to be released into the timed loop and once to wait until main has
+ * collected the results and prepared the next size.
+ */
+static void *worker(void *arg) {
+    worker_data_t *data = (worker_data_t *)arg;
     
-    if (numa_node_to_cpus(node, cpus) < 0) {
-        numa_free_cpumask(cpus);
-        return;
-    }
+    data->cpu = pin_to_node(data->node);
     
-    CPU_ZERO(&cpuset);
-    for (int i = 0; i < numa_num_configured_cpus(); i++) {
-        if (numa_bitmask_isbitset(cpus, i)) {
-            CPU_SET(i, &cpuset);
+    for (int k = 0; k < num_sizes; k++) {
+        /* Touch pages to fault them in on THIS node (our slice only in shared mode) */
+        if (shared_mode) {
+            data->region = slice_region_get(&slices, data->id);
+            memset(data->region, 0xAB, region_size);
+        } else {
+            data->region = region_alloc(region_size);
+        }
+        
+        if (data->region && warmup_ops > 0)
+            run_mprotect_toggle(data, region_size, run_budget_fixed(warmup_ops));
+        worker_reset_stats(data);
+        
+        /* Pilot for --target-rse; before the barrier so it is never timed */
+        if (data->region && run_calibrating()) {
+            run_mprotect_toggle(data, region_size, run_budget_fixed(RUN_PILOT_ITERS));
+            run_calibrate_report(data, LAT_RW_TO_RO, 1);
+        }
+        
+        barrier_arrive_and_wait(data->barrier);
+        
+        if (data->region) {
+            perf_thread_start(&data->perf);
+            run_mprotect_toggle(data, region_size, run_budget(NUM_OPS));
+            perf_thread_stop(&data->perf);
+            if (!shared_mode)
+                region_free(data->region, region_size);
+        }
+        
+        barrier_arrive_and_wait(data->barrier);
+    }
+    return NULL;
+}
+
+/* A bare number is KB for compatibility with -s <size_in_kb> */
+static size_t parse_kb_or_size(const char *s) {
+    size_t len = strlen(s);
+
+    if (len > 0 && s[len - 1] >= '0' && s[len - 1] <= '9')
+        return parse_size(s) * 1024;
+    return parse_size(s);
+}
+
+static int add_size(size_t size) {
+    if (size == 0 || num_sizes == MAX_SIZES)
+        return -1;
+    sizes[num_sizes++] = size;
+    return 0;
+}
+
+/* "4,64,512"; works on a copy since argv is re-used by the A/B mode */
+static int parse_size_list(const char *arg) {
+    char *copy = strdup(arg), *save;
+    int rc = 0;
+
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (add_size(parse_kb_or_size(tok)) != 0) {
+            rc = -1;
             break;
         }
     }
-    numa_free_cpumask(cpus);
-    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+    free(copy);
+    return rc;
 }
 
-static void *worker(void *arg) {
-    worker_data_t *data = (worker_data_t *)arg;
-    struct timespec start, end;
-    
-    pin_to_node(data->node);
-    
-    data->region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (data->region == MAP_FAILED) {
-        perror("mmap");
-        return NULL;
+/* "4K:1G:x2" - from 4K to 1G inclusive, multiplying by 2 */
+static int parse_size_range(const char *arg) {
+    char *copy = strdup(arg);
+    char *end = strchr(copy, ':');
+    char *factor = end ? strchr(end + 1, ':') : NULL;
+    size_t from = 0, to = 0;
+    unsigned long mult = 0;
+    int rc = 0;
+
+    if (factor && factor[1] == 'x') {
+        *end++ = '\0';
+        *factor++ = '\0';
+        from = parse_size(copy);
+        to = parse_size(end);
+        mult = strtoul(factor + 1, NULL, 10);
     }
-    
-    /* Touch pages to fault them in on THIS node */
-    memset(data->region, 0xAB, region_size);
-    
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
+    free(copy);
+    if (from == 0 || to < from || mult < 2)
+        return -1;
+
+    for (size_t size = from; size <= to; size *= mult) {
+        if (add_size(size) != 0) {
+            rc = -1;
+            break;
+        }
     }
-    
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    
-    for (int i = 0; i < NUM_OPS; i++) {
-        mprotect(data->region, region_size, PROT_READ);
-        mprotect(data->region, region_size, PROT_READ | PROT_WRITE);
-        data->ops += 2;
+    return rc;
+}
+
+static void print_sweep_table(const sweep_row_t *rows, int n) {
+    printf("\n");
+    print_rule();
+    printf("SWEEP SUMMARY (%d sizes, %d threads):\n", n, num_threads);
+    print_rule();
+    printf("  %10s %14s %10s %10s %10s %10s %10s\n", "size(KB)", "ops/sec", "us/op",
+           "p50 RW->RO", "p99 RW->RO", "p50 RO->RW", "p99 RO->RW");
+    for (int i = 0; i < n; i++) {
+        const sweep_row_t *r = &rows[i];
+
+        printf("  %10zu %14.0f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               r->size / 1024, r->total_ops / r->max_time,
+               (r->max_time * 1e6) / (r->total_ops / num_threads),
+               r->p50[0], r->p99[0], r->p50[1], r->p99[1]);
     }
-    
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
-    
-    munmap(data->region, region_size);
-    return NULL;
+    print_rule();
 }
 
 static void print_usage(const char *prog) {
-    fprintf(stderr, "Usage: %s -s <size_in_kb>\n", prog);
-    fprintf(stderr, "  -s, --size    Region size in KB (default: 8192)\n");
-    fprintf(stderr, "  -h, --help    Show this help\n");
-    fprintf(stderr, "\nExample sizes: 4, 64, 512, 2048, 8192, 32768, 131072\n");
+    fprintf(stderr, "Usage: %s -s <size_in_kb>[,<size_in_kb>...]\n", prog);
+    fprintf(stderr, "  -s, --size      Region size(s) in KB, or with a k/m/g suffix (default: 8192)\n");
+    fprintf(stderr, "      --range A:B:xF  Geometric sweep from A to B, e.g. 4K:1G:x2\n");
+    fprintf(stderr, "      --warmup N      Untimed mprotect pairs before each size (default: %d)\n",
+            DEFAULT_WARMUP);
+    fprintf(stderr, "      --shared        Carve one mapping into per-thread slices\n");
+    fprintf(stderr, "      --stride SIZE   Distance between slice starts (default: slice size)\n");
+    fprintf(stderr, "      --slice-align A page (default) or pmd: round the stride to 2MB\n");
+    fprintf(stderr, "  -h, --help      Show this help\n");
+    fprintf(stderr, "\nExample sweep: -s 4,64,512,2048,8192,32768,131072\n");
     fprintf(stderr, "\nRun with Hydra: numactl -r all %s -s <size>\n", prog);
+    harness_print_usage();
+}
+
+static void emit_record(const worker_data_t *data, uint64_t total_ops, double max_time) {
+    rec_begin("microbenchmark2");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("threads", num_threads);
+    rec_int("ops_per_thread", (long long)run_ops(NUM_OPS) * 2);
+    rec_run_budget(NUM_OPS);
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("shared", shared_mode);
+    rec_int("slice_stride_bytes", shared_mode ? (long long)slices.stride : 0);
+    rec_int("warmup_ops", warmup_ops);
+    rec_int("sweep_points", num_sizes);
+    rec_close();
+    rec_object("results");
+    rec_int("total_ops", (long long)total_ops);
+    rec_double("wall_time_sec", max_time);
+    rec_double("throughput_ops_per_sec", total_ops / max_time);
+    rec_double("latency_per_op_us", (max_time * 1e6) / (total_ops / num_threads));
+    rec_close();
+    rec_workers(data, num_threads);
+    rec_fairness(data, num_threads, num_nodes);
+    rec_start_skew(&barrier);
+    rec_latency(data, num_threads, lat_names);
+    rec_perf(data, num_threads, num_nodes);
+    rec_hydra();
+    rec_end();
 }
 
 int main(int argc, char **argv) {
     pthread_t *threads;
     worker_data_t *data;
-    uint64_t total_ops = 0;
-    double max_time = 0;
-    size_t size_kb = 8192; /* Default 8MB */
+    sweep_row_t *rows;
+    hist_t *merged;
+    char tag[32];
     
     static struct option long_opts[] = {
         {"size", required_argument, 0, 's'},
+        {"range", required_argument, 0, 'R'},
+        {"warmup", required_argument, 0, 'W'},
+        {"shared", no_argument, 0, 'S'},
+        {"stride", required_argument, 0, 'D'},
+        {"slice-align", required_argument, 0, 'L'},
         {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
         {0, 0, 0, 0}
     };
     
@@ -119,74 +248,180 @@ int main(int argc, char **argv) {
     while ((opt = getopt_long(argc, argv, "s:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 's':
-            size_kb = (size_t)atol(optarg);
+            if (parse_size_list(optarg) != 0) {
+                fprintf(stderr, "Invalid size list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'R':
+            if (parse_size_range(optarg) != 0) {
+                fprintf(stderr, "Invalid range: %s (expected e.g. 4K:1G:x2)\n", optarg);
+                return 1;
+            }
+            break;
+        case 'W':
+            warmup_ops = atoi(optarg);
+            break;
+        case 'S':
+            shared_mode = 1;
+            break;
+        case 'D':
+            slice_stride = parse_size(optarg);
+            if (slice_stride == 0) {
+                fprintf(stderr, "Invalid stride: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'L':
+            if (strcmp(optarg, "pmd") == 0)
+                slice_align_pmd = 1;
+            else if (strcmp(optarg, "page") == 0)
+                slice_align_pmd = 0;
+            else {
+                fprintf(stderr, "Unknown slice alignment: %s\n", optarg);
+                return 1;
+            }
             break;
         case 'h':
+            print_usage(argv[0]);
+            return 0;
         default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
             print_usage(argv[0]);
-            return (opt == 'h') ? 0 : 1;
+            return 1;
         }
     }
     
-    region_size = size_kb * 1024;
+    if (ab_active())
+        return ab_run(argv);
     
-    if (numa_available() < 0) {
-        fprintf(stderr, "NUMA not available\n");
-        return 1;
+    if (num_sizes == 0)
+        add_size(8192 * 1024);  /* Default 8MB */
+    for (int k = 0; k < num_sizes; k++) {
+        sizes[k] = region_round(sizes[k]);
     }
     
-    num_nodes = numa_num_configured_nodes();
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    num_threads = topo_cpu_nodes();
     
-    printf("========================================\n");
-    printf("Microbenchmark 2: Region Size Scaling\n");
-    printf("========================================\n");
+    print_banner("Microbenchmark 2: Region Size Scaling");
     printf("NUMA nodes: %d\n", num_nodes);
-    printf("Threads: %d (one per node)\n", num_nodes);
-    printf("Region size: %zu KB (%zu MB)\n", size_kb, size_kb / 1024);
-    printf("Pages in region: %zu\n", region_size / 4096);
-    printf("Page-tables covered: %zu\n", (region_size + (512 * 4096 - 1)) / (512 * 4096));
-    printf("Ops per thread: %d\n", NUM_OPS * 2);
+    printf("Threads: %d (one per node with CPUs)\n", num_threads);
+    printf("Sweep points: %d\n", num_sizes);
+    print_run_budget("Mprotect pairs per thread", NUM_OPS);
+    printf("Warmup pairs per size: %d\n", warmup_ops);
     printf("\n");
     
-    threads = calloc(num_nodes, sizeof(pthread_t));
-    data = calloc(num_nodes, sizeof(worker_data_t));
-    
-    for (int i = 0; i < num_nodes; i++) {
-        data[i].node = i;
-        data[i].ops = 0;
-        if (pthread_create(&threads[i], NULL, worker, &data[i]) != 0) {
-            perror("pthread_create");
-            return 1;
-        }
+    threads = calloc(num_threads, sizeof(pthread_t));
+    data = aligned_calloc(num_threads, sizeof(worker_data_t));
+    rows = calloc(num_sizes, sizeof(sweep_row_t));
+    merged = malloc(sizeof(*merged));
+    if (!threads || !data || !rows || !merged) {
+        perror("calloc");
+        return 1;
     }
     
-    while (ready_count < num_nodes) {
-        usleep(1000);
+    for (int k = 0; k < num_sizes; k++) {
+        uint64_t total_ops = 0;
+        double max_time = 0;
+        
+        region_size = sizes[k];
+        printf("Region size: %zu KB (%zu MB)\n", region_size / 1024, region_size / (1024 * 1024));
+        print_page_layout(region_size);
+        if (shared_mode) {
+            size_t stride = slice_stride_for(region_size, slice_stride, slice_align_pmd);
+            if (slice_region_map(&slices, num_threads, region_size, stride) != 0)
+                return 1;
+            print_slice_layout(&slices, num_threads);
+        }
+        run_calibrate_reset();
+        
+        /* Start the threads once; later sizes release them from the previous pass */
+        if (k == 0) {
+            for (int node = 0, i = 0; node < num_nodes; node++) {
+                if (topo_cpus(node) == 0)
+                    continue;
+                data[i].id = i;
+                data[i].node = node;
+                data[i].barrier = &barrier;
+                if (pthread_create(&threads[i], NULL, worker, &data[i]) != 0) {
+                    perror("pthread_create");
+                    return 1;
+                }
+                i++;
+            }
+        } else {
+            barrier_release(&barrier);
+        }
+        
+        barrier_wait_ready(&barrier, num_threads);
+        print_run_calibration(NUM_OPS);
+        
+        printf("All threads ready. Starting benchmark...\n\n");
+        
+        hydra_trial_begin();
+        perf_trial_begin();
+        barrier_release(&barrier);
+        
+        barrier_wait_ready(&barrier, num_threads);
+        perf_trial_end();
+        hydra_trial_end();
+        
+        /* Tag this size's A/B metrics, the fairness one included */
+        if (num_sizes > 1) {
+            snprintf(tag, sizeof(tag), "%zuKB", region_size / 1024);
+            ab_set_tag(tag);
+        }
+        report_workers(data, num_threads, &total_ops, &max_time);
+        printf("\n");
+        report_fairness(data, num_threads, num_nodes);
+        
+        printf("\n");
+        print_rule();
+        printf("RESULTS (region_size=%zuKB):\n", region_size / 1024);
+        print_rule();
+        printf("Total mprotect ops: %lu\n", (unsigned long)total_ops);
+        printf("Wall time: %.3f sec\n", max_time);
+        printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
+        printf("Latency per op: %.2f us\n", (max_time * 1e6) / (total_ops / num_threads));
+        print_start_skew(&barrier);
+        report_latency(data, num_threads, lat_names);
+        report_perf(data, num_threads, num_nodes);
+        report_ab_metrics(data, num_threads, lat_names, total_ops / max_time,
+                          (max_time * 1e6) / (total_ops / num_threads));
+        hydra_print_delta();
+        print_rule();
+        printf("\n");
+        
+        rows[k].size = region_size;
+        rows[k].total_ops = total_ops;
+        rows[k].max_time = max_time;
+        for (int slot = 0; slot < 2; slot++) {
+            latency_merge(data, num_threads, slot, merged);
+            rows[k].p50[slot] = hist_percentile(merged, 50.0) / 1e3;
+            rows[k].p99[slot] = hist_percentile(merged, 99.0) / 1e3;
+        }
+        
+        if (report_structured())
+            emit_record(data, total_ops, max_time);
+        
+        slice_region_unmap(&slices);
     }
     
-    printf("All threads ready. Starting benchmark...\n\n");
-    
-    go = 1;
-    __sync_synchronize();
-    
-    for (int i = 0; i < num_nodes; i++) {
+    /* Let the threads leave their last pass */
+    barrier_release(&barrier);
+    for (int i = 0; i < num_threads; i++) {
         pthread_join(threads[i], NULL);
-        printf("Node %d: %.3f sec, %lu ops\n", 
-               i, data[i].elapsed_sec, (unsigned long)data[i].ops);
-        total_ops += data[i].ops;
-        if (data[i].elapsed_sec > max_time)
-            max_time = data[i].elapsed_sec;
     }
     
-    printf("\n========================================\n");
-    printf("RESULTS (region_size=%zuKB):\n", size_kb);
-    printf("========================================\n");
-    printf("Total mprotect ops: %lu\n", (unsigned long)total_ops);
-    printf("Wall time: %.3f sec\n", max_time);
-    printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
-    printf("Latency per op: %.2f us\n", (max_time * 1e6) / (total_ops / num_nodes));
-    printf("========================================\n");
+    if (num_sizes > 1)
+        print_sweep_table(rows, num_sizes);
     
+    free(merged);
+    free(rows);
     free(threads);
     free(data);
     return 0;
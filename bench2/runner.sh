@@ -3,7 +3,7 @@
 # microbenchmark2_runner.sh - Region Size Scaling Benchmark Runner
 #
 # Compile benchmark first:
-#   gcc -O2 -o microbenchmark2 microbenchmark2.c -lpthread -lnuma
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
 #
 # Run as root: sudo ./microbenchmark2_runner.sh
 
@@ -12,13 +12,24 @@ set -e
 BENCH="./microbenchmark2"
 HYDRA_HISTORY="/proc/hydra/history"
 
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
 # Region sizes in KB: 4KB to 128MB
 SIZES=(4 64 512 2048 8192 32768 131072)
 
+# Untimed mprotect pairs before each size
+WARMUP="${WARMUP:-100}"
+
 # Check prerequisites
 if [ ! -x "$BENCH" ]; then
     echo "Error: $BENCH not found or not executable"
-    echo "Compile with: gcc -O2 -o microbenchmark2 microbenchmark2.c -lpthread -lnuma"
+    echo "Compile with: make (from the repository root)"
     exit 1
 fi
 
@@ -34,34 +45,27 @@ echo "Region sizes (KB): ${SIZES[*]}"
 echo "========================================================"
 echo ""
 
-for size in "${SIZES[@]}"; do
-    echo ""
-    echo "########################################################"
-    echo "# Testing region size: ${size}KB"
-    echo "########################################################"
-    echo ""
-    
-    # Drop caches
-    sync
-    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
-    
-    # Reset Hydra stats
-    echo -1 > "$HYDRA_HISTORY"
-    
-    sleep 0.5
-    
-    # Run benchmark with Hydra enabled
-    numactl -r all $BENCH -s $size
-    
-    # Print Hydra IPI statistics
-    echo ""
-    echo "Hydra IPI Statistics:"
-    echo "----------------------------------------"
-    cat "$HYDRA_HISTORY"
-    echo "----------------------------------------"
-    
-    sleep 1
-done
+# The whole sweep runs in one process: threads stay pinned across sizes
+SIZE_LIST=$(IFS=,; echo "${SIZES[*]}")
+
+# Drop caches
+sync
+echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+
+# Reset Hydra stats
+echo -1 > "$HYDRA_HISTORY"
+
+sleep 0.5
+
+# Run benchmark with Hydra enabled; each size gets its own record and IPI delta
+numactl -r all $BENCH -s $SIZE_LIST --warmup $WARMUP --format=$FORMAT >&3
+
+# Print Hydra IPI statistics for the whole sweep
+echo ""
+echo "Hydra IPI Statistics:"
+echo "----------------------------------------"
+cat "$HYDRA_HISTORY"
+echo "----------------------------------------"
 
 echo ""
 echo "========================================================"
@@ -4,7 +4,19 @@
  * Measures how spinning threads on remote NUMA nodes impact mprotect performance.
  * Reproduces the key experiment from Hydra paper (Figure 1).
  *
- * Compile: gcc -O2 -o microbenchmark3 microbenchmark3.c -lpthread -lnuma
+ * With --processes the workers are forked processes while the spinners
+ * stay threads of the parent, so the spinners are never in a worker's mm
+ * cpumask: the ceiling of what cpumask narrowing alone can save. --memfd
+ * gives the workers slices of one MAP_SHARED memfd instead of private
+ * regions.
+ *
+ * With --hop-every M each worker re-pins itself to another node every M
+ * mprotect pairs (round robin or random), the way the scheduler or NUMA
+ * balancing would move it, and the first call after each hop is reported
+ * apart from the steady-state cost. --numa-balancing turns on
+ * kernel.numa_balancing for the run.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
  * Run:     numactl -r all ./microbenchmark3 -s <spinners_per_node>
  */
 
@@ -16,265 +28,507 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <sched.h>
-#include <numa.h>
-#include <numaif.h>
-#include <time.h>
 #include <getopt.h>
 
+#include "ab.h"
+#include "antagonist.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
 #define NUM_OPS 20000
-#define REGION_SIZE (64 * 1024)  /* 64KB - optimal from microbenchmark2 */
-#define WORKER_NODE 0
+#define REGION_SIZE (64 * 1024)  /* 64KB - optimal from microbenchmark2, page rounded */
+#define MAX_WORKERS 64
+#define MAX_NODES 64  /* node masks are one unsigned long */
+#define NUMA_BALANCING "/proc/sys/kernel/numa_balancing"
+
+/* Extra latency slots with --hop-every */
+enum {
+    LAT_HOP = 2,    /* RW->RO right after a re-pin */
+    LAT_REPIN = 3   /* the re-pin itself */
+};
 
 static int num_nodes;
+static size_t region_size;
 static int spinners_per_node;
-static volatile int ready_count = 0;
-static volatile int go = 0;
-static volatile int stop_spinners = 0;
+static antagonist_pool_t antagonists;
+static start_barrier_t *barrier;  /* shared_calloc(), --processes children arrive on it */
+static slice_region_t slices;     /* --memfd */
 
-typedef struct {
-    int id;
-    int node;
-    int cpu;
-    uint64_t spin_count;
-} spinner_data_t;
+/* One worker per entry (--worker-node / --workers), spinners elsewhere */
+static int worker_nodes[MAX_WORKERS] = { 0 };
+static int num_workers = 1;
 
-typedef struct {
-    void *region;
-    double elapsed_sec;
-    uint64_t ops;
-} worker_data_t;
+/* Migration stress: re-pin every hop_every pairs to the last CPU of a node */
+static int hop_every;
+static int hop_random;
+static int hop_cpus[MAX_NODES];
+static int numa_balancing_on;
+static int old_balancing = -1;
 
-static int get_cpu_for_node(int node, int index) {
-    struct bitmask *cpus = numa_allocate_cpumask();
-    int cpu = -1;
-    int count = 0;
-    
-    if (numa_node_to_cpus(node, cpus) < 0) {
-        numa_free_cpumask(cpus);
-        return -1;
-    }
-    
-    for (int i = 0; i < numa_num_configured_cpus(); i++) {
-        if (numa_bitmask_isbitset(cpus, i)) {
-            if (count == index) {
-                cpu = i;
-                break;
-            }
-            count++;
-        }
-    }
-    numa_free_cpumask(cpus);
-    return cpu;
-}
+static const char *const lat_names[LAT_SLOTS] = {
+    [LAT_RW_TO_RO] = "RW->RO",
+    [LAT_RO_TO_RW] = "RO->RW",
+};
 
-static void pin_to_cpu(int cpu) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(cpu, &cpuset);
-    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+static const char *const hop_lat_names[LAT_SLOTS] = {
+    [LAT_RW_TO_RO] = "RW->RO",
+    [LAT_RO_TO_RW] = "RO->RW",
+    [LAT_HOP]      = "hop RW->RO",
+    [LAT_REPIN]    = "re-pin",
+};
+
+static const char *const *cur_lat_names(void) {
+    return hop_every ? hop_lat_names : lat_names;
 }
 
-static void pin_to_node_first_cpu(int node) {
-    int cpu = get_cpu_for_node(node, 0);
-    if (cpu >= 0) {
-        pin_to_cpu(cpu);
+/* Node to hop to from cur, never cur itself when there is a choice */
+static int next_hop_node(int cur, unsigned int *seed) {
+    int next;
+    
+    /* Memory-only nodes have no CPU to hop to */
+    if (!hop_random || topo_cpu_nodes() < 2) {
+        next = cur;
+        do {
+            next = (next + 1) % num_nodes;
+        } while (topo_cpus(next) == 0);
+        return next;
     }
+    do {
+        next = rand_r(seed) % num_nodes;
+    } while (next == cur || topo_cpus(next) == 0);
+    return next;
 }
 
-static void *spinner(void *arg) {
-    spinner_data_t *data = (spinner_data_t *)arg;
+/*
+ * run_mprotect_toggle() with a re-pin every hop_every pairs. The re-pin
+ * (sched_setaffinity migrates the thread before it returns) goes to
+ * LAT_REPIN and the first RW->RO after it to LAT_HOP instead of
+ * LAT_RW_TO_RO, so that slot stays the steady-state cost.
+ */
+HOT_INLINE void mprotect_hop_loop(worker_data_t *data, run_budget_t budget, int deadline) {
+    unsigned int seed = data->id + 1;
+    int node = data->node;
+    int hopped = 0;
+    char *region = data->region;
+    size_t size = region_size;
+    uint64_t ops = 0;
+    uint64_t start = now_ns();
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        if (i > 0 && i % hop_every == 0) {
+            node = next_hop_node(node, &seed);
+            uint64_t t0 = now_ns();
+            pin_to_cpu(hop_cpus[node]);
+            hist_record(&data->lat[LAT_REPIN], now_ns() - t0);
+            hopped = 1;
+        }
     
-    pin_to_cpu(data->cpu);
+        uint64_t t0 = now_ns();
+        mprotect(region, size, PROT_READ);
+        uint64_t t1 = now_ns();
+        mprotect(region, size, PROT_READ | PROT_WRITE);
+        uint64_t t2 = now_ns();
     
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
+        hist_record(&data->lat[hopped ? LAT_HOP : LAT_RW_TO_RO], t1 - t0);
+        hist_record(&data->lat[LAT_RO_TO_RW], t2 - t1);
+        hopped = 0;
+        ops += 2;
     }
     
-    /* Spin until told to stop */
-    while (!stop_spinners) {
-        data->spin_count++;
-        __asm__ __volatile__("pause" ::: "memory");
-    }
+    /* Back home for the next phase */
+    pin_to_cpu(data->cpu);
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+}
+
+static void run_mprotect_hop(worker_data_t *data, run_budget_t budget) {
+    if (budget.deadline_ns)
+        mprotect_hop_loop(data, budget, 1);
+    else
+        mprotect_hop_loop(data, budget, 0);
+}
+
+static void run_load(worker_data_t *data, run_budget_t budget) {
+    if (hop_every)
+        run_mprotect_hop(data, budget);
+    else
+        run_mprotect_toggle(data, region_size, budget);
+}
+
+/* kernel.numa_balancing, or -1 if it cannot be read */
+static int read_numa_balancing(void) {
+    FILE *f = fopen(NUMA_BALANCING, "r");
+    int v = -1;
     
-    return NULL;
+    if (!f)
+        return -1;
+    if (fscanf(f, "%d", &v) != 1)
+        v = -1;
+    fclose(f);
+    return v;
+}
+
+static int write_numa_balancing(int v) {
+    FILE *f = fopen(NUMA_BALANCING, "w");
+    
+    if (!f)
+        return -1;
+    fprintf(f, "%d\n", v);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* atexit(): put kernel.numa_balancing back on every exit path */
+static void restore_numa_balancing(void) {
+    if (old_balancing >= 0)
+        write_numa_balancing(old_balancing);
+}
+
+/* Spike of the first call after a hop against the steady-state RW->RO */
+static void report_hops(const worker_data_t *data) {
+    hist_t *steady = malloc(sizeof(*steady));
+    hist_t *hop = malloc(sizeof(*hop));
+    hist_t *repin = malloc(sizeof(*repin));
+    
+    if (!steady || !hop || !repin)
+        goto out;
+    latency_merge(data, num_workers, LAT_RW_TO_RO, steady);
+    latency_merge(data, num_workers, LAT_HOP, hop);
+    latency_merge(data, num_workers, LAT_REPIN, repin);
+    if (hop->count == 0 || steady->count == 0)
+        goto out;
+    
+    printf("\nHops: %lu (every %d pairs, %s), re-pin mean %.2f us\n",
+           (unsigned long)hop->count, hop_every, hop_random ? "random" : "round robin",
+           hist_mean(repin) / 1e3);
+    printf("  %-12s %10s %10s %10s\n", "RW->RO", "mean (us)", "p50 (us)", "p99 (us)");
+    printf("  %-12s %10.2f %10.2f %10.2f\n", "steady", hist_mean(steady) / 1e3,
+           hist_percentile(steady, 50.0) / 1e3, hist_percentile(steady, 99.0) / 1e3);
+    printf("  %-12s %10.2f %10.2f %10.2f\n", "after hop", hist_mean(hop) / 1e3,
+           hist_percentile(hop, 50.0) / 1e3, hist_percentile(hop, 99.0) / 1e3);
+    printf("Hop penalty: %.2fx the steady-state mean\n", hist_mean(hop) / hist_mean(steady));
+out:
+    free(repin);
+    free(hop);
+    free(steady);
 }
 
 static void *worker(void *arg) {
     worker_data_t *data = (worker_data_t *)arg;
-    struct timespec start, end;
-    
-    pin_to_node_first_cpu(WORKER_NODE);
     
-    data->region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (data->region == MAP_FAILED) {
-        perror("mmap");
-        return NULL;
-    }
+    pin_to_cpu(data->cpu);
     
     /* Touch pages to fault them in on worker's node */
-    memset(data->region, 0xAB, REGION_SIZE);
-    
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
+    if (region_memfd()) {
+        data->region = slice_region_get(&slices, data->id);
+        memset(data->region, 0xAB, region_size);
+    } else {
+        data->region = region_alloc(region_size);
+    }
+    if (!data->region) {
+        barrier_arrive_and_wait(data->barrier);
+        return NULL;
     }
     
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    
-    for (int i = 0; i < NUM_OPS; i++) {
-        mprotect(data->region, REGION_SIZE, PROT_READ);
-        mprotect(data->region, REGION_SIZE, PROT_READ | PROT_WRITE);
-        data->ops += 2;
+    /* Pilot for --target-rse; before the barrier so it is never timed */
+    if (run_calibrating()) {
+        run_load(data, run_budget_fixed(RUN_PILOT_ITERS));
+        run_calibrate_report(data, LAT_RW_TO_RO, 1);
     }
     
-    clock_gettime(CLOCK_MONOTONIC, &end);
+    barrier_arrive_and_wait(data->barrier);
     
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
+    perf_thread_start(&data->perf);
+    run_load(data, run_budget(NUM_OPS));
+    perf_thread_stop(&data->perf);
     
-    munmap(data->region, REGION_SIZE);
+    if (!region_memfd())
+        region_free(data->region, region_size);
     return NULL;
 }
 
 static void print_usage(const char *prog) {
     fprintf(stderr, "Usage: %s -s <spinners_per_node>\n", prog);
-    fprintf(stderr, "  -s, --spinners  Number of spinner threads per remote node (default: 0)\n");
-    fprintf(stderr, "  -h, --help      Show this help\n");
+    fprintf(stderr, "  -s, --spinners N      Number of spinner threads per remote node (default: 0)\n");
+    fprintf(stderr, "  -w, --worker-node N   Node of the mprotect worker (default: 0)\n");
+    fprintf(stderr, "      --workers LIST    One worker per listed node, e.g. 0,0,2\n");
+    fprintf(stderr, "      --hop-every M     Re-pin each worker to another node every M pairs\n");
+    fprintf(stderr, "      --hop-order O     rr (default, round robin) or random\n");
+    fprintf(stderr, "      --numa-balancing  Enable kernel.numa_balancing during the run (root)\n");
+    fprintf(stderr, "  -h, --help            Show this help\n");
     fprintf(stderr, "\nExample: %s -s 4  (4 spinners on each of nodes 1-7)\n", prog);
     fprintf(stderr, "\nRun with Hydra: numactl -r all %s -s <n>\n", prog);
+    harness_print_usage();
+    spinner_print_usage();
+    antagonist_print_usage();
+    process_print_usage();
+}
+
+static void emit_record(const worker_data_t *data, int total_spinners,
+                        uint64_t total_ops, double max_time) {
+    rec_begin("microbenchmark3");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("worker_node", worker_nodes[0]);
+    rec_int("workers", num_workers);
+    rec_int("spinners_per_node", spinners_per_node);
+    rec_int("total_spinners", total_spinners);
+    rec_str("spinner_mode", spinner_mode_name(spinner_mode()));
+    rec_int("spinner_ws_bytes", (long long)spinner_working_set());
+    rec_str("spinner_placement", placement_name(spinner_placement()));
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("hop_every", hop_every);
+    rec_str("hop_order", hop_every ? (hop_random ? "random" : "rr") : "");
+    rec_int("numa_balancing", numa_balancing_on ? read_numa_balancing() : -1);
+    rec_str("worker_mode", worker_mode_name());
+    rec_int("memfd", region_memfd());
+    rec_int("iterations", (long long)run_ops(NUM_OPS));
+    rec_run_budget(NUM_OPS);
+    rec_close();
+    rec_object("results");
+    rec_int("total_ops", (long long)total_ops);
+    rec_double("wall_time_sec", max_time);
+    rec_double("throughput_ops_per_sec", total_ops / max_time);
+    rec_double("latency_per_op_us", (max_time * 1e6) / (total_ops / num_workers));
+    rec_close();
+    rec_workers(data, num_workers);
+    rec_start_skew(barrier);
+    rec_latency(data, num_workers, cur_lat_names());
+    rec_perf(data, num_workers, num_nodes);
+    if (antagonists_enabled())
+        rec_antagonists(&antagonists);
+    rec_hydra();
+    rec_end();
 }
 
 int main(int argc, char **argv) {
-    pthread_t worker_thread;
-    pthread_t *spinner_threads = NULL;
-    spinner_data_t *spinner_data = NULL;
-    worker_data_t worker_data = {0};
+    worker_handle_t workers[MAX_WORKERS];
+    spinner_pool_t spinners;
+    worker_data_t *data;
+    unsigned long worker_mask = 0;
+    uint64_t total_ops = 0;
+    double max_time = 0;
     int total_spinners;
-    int expected_ready;
     
     spinners_per_node = 0;
     
     static struct option long_opts[] = {
         {"spinners", required_argument, 0, 's'},
+        {"worker-node", required_argument, 0, 'w'},
+        {"workers", required_argument, 0, 'W'},
+        {"hop-every", required_argument, 0, 'H'},
+        {"hop-order", required_argument, 0, 'O'},
+        {"numa-balancing", no_argument, 0, 'B'},
         {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        SPINNER_LONG_OPTS,
+        ANTAGONIST_LONG_OPTS,
+        PROCESS_LONG_OPTS,
         {0, 0, 0, 0}
     };
     
     int opt;
-    while ((opt = getopt_long(argc, argv, "s:h", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "s:w:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 's':
             spinners_per_node = atoi(optarg);
             break;
+        case 'w':
+            worker_nodes[0] = atoi(optarg);
+            num_workers = 1;
+            break;
+        case 'W':
+            num_workers = parse_int_list(optarg, worker_nodes, MAX_WORKERS);
+            if (num_workers < 1) {
+                fprintf(stderr, "Invalid worker list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            hop_every = atoi(optarg);
+            if (hop_every < 1) {
+                fprintf(stderr, "Invalid hop interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'O':
+            if (strcmp(optarg, "random") == 0)
+                hop_random = 1;
+            else if (strcmp(optarg, "rr") == 0)
+                hop_random = 0;
+            else {
+                fprintf(stderr, "Unknown hop order: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'B':
+            numa_balancing_on = 1;
+            break;
         case 'h':
+            print_usage(argv[0]);
+            return 0;
         default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
             print_usage(argv[0]);
-            return (opt == 'h') ? 0 : 1;
+            return 1;
         }
     }
     
-    if (numa_available() < 0) {
-        fprintf(stderr, "NUMA not available\n");
+    if (ab_active())
+        return ab_run(argv);
+    
+    num_nodes = harness_init();
+    if (num_nodes < 0)
         return 1;
+    region_size = region_round(REGION_SIZE);
+    if (num_nodes > MAX_NODES)
+        num_nodes = MAX_NODES;
+    
+    for (int i = 0; i < num_workers; i++) {
+        if (worker_nodes[i] < 0 || worker_nodes[i] >= num_nodes) {
+            fprintf(stderr, "Worker node %d out of range (0-%d)\n", worker_nodes[i], num_nodes - 1);
+            return 1;
+        }
+        worker_mask |= 1UL << worker_nodes[i];
     }
+    /*
+     * Last CPU of each node, where compact spinners land last, or the one
+     * below the antagonists, which take the top CPUs of the remote nodes
+     */
+    for (int node = 0; node < num_nodes && hop_every; node++) {
+        int index = node_cpu_count(node) - 1;
+    
+        if (topo_cpus(node) == 0)
+            continue;
+        if (antagonists_enabled() && !(worker_mask & (1UL << node)))
+            index -= antagonist_cpus_per_node();
+        hop_cpus[node] = get_cpu_for_node(node, index > 0 ? index : 0);
+        if (hop_cpus[node] < 0) {
+            fprintf(stderr, "Node %d has no CPU to hop to\n", node);
+            return 1;
+        }
+    }
+    data = shared_calloc(num_workers, sizeof(worker_data_t));
+    barrier = shared_calloc(1, sizeof(*barrier));
+    if (!data || !barrier || workers_place(data, worker_nodes, num_workers) != 0)
+        return 1;
     
-    num_nodes = numa_num_configured_nodes();
-    
-    /* Spinners on all nodes except WORKER_NODE */
-    total_spinners = spinners_per_node * (num_nodes - 1);
-    expected_ready = total_spinners + 1; /* spinners + worker */
+    /* Spinners on all nodes with CPUs and without a worker */
+    total_spinners = 0;
+    for (int node = 0; node < num_nodes; node++) {
+        if (topo_cpus(node) > 0 && !(worker_mask & (1UL << node)))
+            total_spinners += spinners_per_node;
+    }
     
-    printf("========================================\n");
-    printf("Microbenchmark 3: Spinning Thread Interference\n");
-    printf("========================================\n");
+    print_banner("Microbenchmark 3: Spinning Thread Interference");
     printf("NUMA nodes: %d\n", num_nodes);
-    printf("Worker node: %d\n", WORKER_NODE);
+    printf("Workers:");
+    for (int i = 0; i < num_workers; i++) {
+        printf(" node %d CPU %d%s", data[i].node, data[i].cpu, i + 1 < num_workers ? "," : "\n");
+    }
     printf("Spinners per remote node: %d\n", spinners_per_node);
     printf("Total spinner threads: %d\n", total_spinners);
-    printf("Region size: %d KB\n", REGION_SIZE / 1024);
-    printf("Ops (mprotect pairs): %d\n", NUM_OPS);
+    if (worker_processes())
+        printf("Workers: one forked process each (own mm, spinners stay in the parent)\n");
+    printf("Spinner mode: %s (touch working set %zu KB)\n",
+           spinner_mode_name(spinner_mode()), spinner_working_set() / 1024);
+    printf("Spinner placement: %s\n", placement_name(spinner_placement()));
+    print_antagonist_config();
+    if (hop_every)
+        printf("Hops: every %d pairs, %s, to the last CPU of a node\n", hop_every,
+               hop_random ? "random" : "round robin");
+    printf("Region size: %zu KB\n", region_size / 1024);
+    print_page_layout(region_size);
+    if (region_memfd()) {
+        if (slice_region_map(&slices, num_workers, region_size, region_size) != 0)
+            return 1;
+        print_slice_layout(&slices, num_workers);
+    }
+    print_run_budget("Ops (mprotect pairs)", NUM_OPS);
     printf("\n");
     
-    /* Allocate spinner resources */
-    if (total_spinners > 0) {
-        spinner_threads = calloc(total_spinners, sizeof(pthread_t));
-        spinner_data = calloc(total_spinners, sizeof(spinner_data_t));
-        
-        /* Create spinner threads on remote nodes */
-        int idx = 0;
-        for (int node = 0; node < num_nodes; node++) {
-            if (node == WORKER_NODE) continue;
-            
-            for (int s = 0; s < spinners_per_node; s++) {
-                int cpu = get_cpu_for_node(node, s);
-                if (cpu < 0) {
-                    fprintf(stderr, "Warning: cannot get CPU %d on node %d\n", s, node);
-                    continue;
-                }
-                
-                spinner_data[idx].id = idx;
-                spinner_data[idx].node = node;
-                spinner_data[idx].cpu = cpu;
-                spinner_data[idx].spin_count = 0;
-                
-                if (pthread_create(&spinner_threads[idx], NULL, spinner, &spinner_data[idx]) != 0) {
-                    perror("pthread_create spinner");
-                    return 1;
-                }
-                idx++;
-            }
+    if (numa_balancing_on) {
+        int was = read_numa_balancing();
+    
+        if (write_numa_balancing(1) != 0) {
+            fprintf(stderr, "Warning: cannot enable NUMA balancing (need root)\n");
+        } else {
+            printf("NUMA balancing: enabled for the run (was %d)\n\n", was);
+            old_balancing = was;
+            atexit(restore_numa_balancing);
         }
-        total_spinners = idx; /* Adjust for any failures */
-        expected_ready = total_spinners + 1;
     }
     
-    /* Create worker thread */
-    if (pthread_create(&worker_thread, NULL, worker, &worker_data) != 0) {
-        perror("pthread_create worker");
+    /* Background load on the same remote nodes, set up before the spinners */
+    if (antagonists_start(&antagonists, num_nodes, worker_mask) < 0)
+        return 1;
+    
+    /* Create spinner threads on remote nodes */
+    total_spinners = spinners_start(&spinners, barrier, num_nodes,
+                                    worker_mask, spinners_per_node);
+    if (total_spinners < 0)
         return 1;
-    }
     
-    /* Wait for all threads ready */
-    while (ready_count < expected_ready) {
-        usleep(1000);
+    /* Create worker threads */
+    for (int i = 0; i < num_workers; i++) {
+        data[i].barrier = barrier;
+        if (worker_start(&workers[i], worker, &data[i]) != 0)
+            return 1;
     }
     
-    printf("All threads ready (%d spinners + 1 worker). Starting benchmark...\n\n", total_spinners);
+    /* Wait for all threads ready (spinners + workers) */
+    barrier_wait_ready(barrier, total_spinners + num_workers);
+    print_run_calibration(NUM_OPS);
     
-    /* GO! */
-    go = 1;
-    __sync_synchronize();
+    printf("All threads ready (%d spinners + %d workers). Starting benchmark...\n\n",
+           total_spinners, num_workers);
     
-    /* Wait for worker to complete */
-    pthread_join(worker_thread, NULL);
+    antagonists_mark(&antagonists);
+    hydra_trial_begin();
+    perf_trial_begin();
     
-    /* Stop spinners */
-    stop_spinners = 1;
-    __sync_synchronize();
+    /* GO! */
+    barrier_release(barrier);
     
-    if (total_spinners > 0) {
-        for (int i = 0; i < total_spinners; i++) {
-            pthread_join(spinner_threads[i], NULL);
-        }
+    /* Wait for workers to complete */
+    for (int i = 0; i < num_workers; i++) {
+        worker_join(&workers[i]);
     }
+    perf_trial_end();
+    hydra_trial_end();
+    antagonists_stop(&antagonists);
     
-    printf("Worker completed: %.3f sec, %lu ops\n", 
-           worker_data.elapsed_sec, (unsigned long)worker_data.ops);
-    
-    printf("\n========================================\n");
-    printf("RESULTS (spinners_per_node=%d):\n", spinners_per_node);
-    printf("========================================\n");
-    printf("Total mprotect ops: %lu\n", (unsigned long)worker_data.ops);
-    printf("Wall time: %.3f sec\n", worker_data.elapsed_sec);
-    printf("Throughput: %.0f ops/sec\n", worker_data.ops / worker_data.elapsed_sec);
-    printf("Latency per op: %.2f us\n", (worker_data.elapsed_sec * 1e6) / worker_data.ops);
-    printf("========================================\n");
+    /* Stop spinners */
+    spinners_stop(&spinners);
     
-    if (spinner_threads) free(spinner_threads);
-    if (spinner_data) free(spinner_data);
+    report_workers(data, num_workers, &total_ops, &max_time);
     
+    printf("\n");
+    print_rule();
+    printf("RESULTS (spinners_per_node=%d):\n", spinners_per_node);
+    print_rule();
+    printf("Total mprotect ops: %lu\n", (unsigned long)total_ops);
+    printf("Wall time: %.3f sec\n", max_time);
+    printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
+    printf("Latency per op: %.2f us\n", (max_time * 1e6) / (total_ops / num_workers));
+    print_start_skew(barrier);
+    report_latency(data, num_workers, cur_lat_names());
+    if (hop_every)
+        report_hops(data);
+    report_perf(data, num_workers, num_nodes);
+    report_antagonists(&antagonists);
+    report_ab_metrics(data, num_workers, cur_lat_names(), total_ops / max_time,
+                      (max_time * 1e6) / (total_ops / num_workers));
+    hydra_print_delta();
+    print_rule();
+    
+    if (report_structured())
+        emit_record(data, total_spinners, total_ops, max_time);
+    
+    slice_region_unmap(&slices);
+    shared_free(barrier, 1, sizeof(*barrier));
+    shared_free(data, num_workers, sizeof(worker_data_t));
     return 0;
 }
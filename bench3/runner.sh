@@ -6,7 +6,7 @@
 # Runs each configuration WITHOUT and WITH Hydra for comparison
 #
 # Compile benchmark first:
-#   gcc -O2 -o microbenchmark3 microbenchmark3.c -lpthread -lnuma
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
 #
 # Run as root: sudo ./microbenchmark3_runner.sh
 
@@ -15,13 +15,49 @@ set -e
 BENCH="./microbenchmark3"
 HYDRA_HISTORY="/proc/hydra/history"
 
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# STORE=results.jsonl appends every run to a results store, LABEL names
+# the kernel build (default: uname -r) and COMPARE=baseline tests each run
+# against the stored runs of that label; the runner then exits 3 if any
+# configuration regressed
+STORE="${STORE:-}"
+LABEL="${LABEL:-}"
+COMPARE="${COMPARE:-}"
+STORE_ARGS=()
+if [ -n "$STORE" ]; then
+    STORE_ARGS+=(--store "$STORE")
+    [ -n "$LABEL" ] && STORE_ARGS+=(--label "$LABEL")
+    [ -n "$COMPARE" ] && STORE_ARGS+=(--compare "$COMPARE")
+fi
+REGRESSED=0
+
+# ANTAGONIST=bandwidth,pagecache,pressure loads the remote nodes too, at
+# ANTAGONIST_INTENSITY percent (default 100)
+ANTAGONIST="${ANTAGONIST:-}"
+LOAD_ARGS=()
+if [ -n "$ANTAGONIST" ]; then
+    LOAD_ARGS+=(--antagonist "$ANTAGONIST")
+    [ -n "$ANTAGONIST_INTENSITY" ] && LOAD_ARGS+=(--antagonist-intensity "$ANTAGONIST_INTENSITY")
+fi
+
 # Spinner counts per remote node
 SPINNER_COUNTS=(0 1 2 4 8 16)
 
+# threads share one mm with the spinners; processes fork the workers so
+# only cpumask narrowing, not replication, keeps the spinners out
+WORKER_MODES=(threads processes)
+
 # Check prerequisites
 if [ ! -x "$BENCH" ]; then
     echo "Error: $BENCH not found or not executable"
-    echo "Compile with: gcc -O2 -o microbenchmark3 microbenchmark3.c -lpthread -lnuma"
+    echo "Compile with: make (from the repository root)"
     exit 1
 fi
 
@@ -30,64 +66,88 @@ if [ ! -f "$HYDRA_HISTORY" ]; then
     exit 1
 fi
 
+# Exit status 3 is a --compare regression: note it and keep sweeping
+check_status() {
+    if [ "$1" -ne 3 ]; then
+        exit "$1"
+    fi
+    REGRESSED=1
+}
+
 echo "========================================================"
 echo "Microbenchmark 3: Spinning Thread Interference"
 echo "========================================================"
 echo "Spinner counts per node: ${SPINNER_COUNTS[*]}"
+echo "Worker modes: ${WORKER_MODES[*]}"
+echo "Antagonists: ${ANTAGONIST:-none}"
 echo "Each test runs WITHOUT Hydra, then WITH Hydra"
 echo "========================================================"
 echo ""
 
-for spinners in "${SPINNER_COUNTS[@]}"; do
-    echo ""
-    echo "########################################################"
-    echo "# Testing with $spinners spinners per remote node"
-    echo "########################################################"
-    
-    # --- WITHOUT HYDRA ---
-    echo ""
-    echo ">>> WITHOUT HYDRA (baseline Linux):"
-    echo ""
-    
-    sync
-    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
-    echo -1 > "$HYDRA_HISTORY"
-    sleep 0.5
+for mode in "${WORKER_MODES[@]}"; do
+    MODE_FLAG=""
+    if [ "$mode" = "processes" ]; then
+        MODE_FLAG="--processes"
+    fi
     
-    # Run WITHOUT numactl -r all
-    $BENCH -s $spinners
-    
-    echo ""
-    echo "Hydra IPI Statistics (without Hydra):"
-    echo "----------------------------------------"
-    cat "$HYDRA_HISTORY"
-    echo "----------------------------------------"
-    
-    sleep 1
-    
-    # --- WITH HYDRA ---
-    echo ""
-    echo ">>> WITH HYDRA (numactl -r all):"
-    echo ""
-    
-    sync
-    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
-    echo -1 > "$HYDRA_HISTORY"
-    sleep 0.5
-    
-    # Run WITH numactl -r all
-    numactl -r all $BENCH -s $spinners
-    
-    echo ""
-    echo "Hydra IPI Statistics (with Hydra):"
-    echo "----------------------------------------"
-    cat "$HYDRA_HISTORY"
-    echo "----------------------------------------"
-    
-    sleep 1
+    for spinners in "${SPINNER_COUNTS[@]}"; do
+        echo ""
+        echo "########################################################"
+        echo "# Testing with $spinners spinners per remote node ($mode)"
+        echo "########################################################"
+        
+        # --- WITHOUT HYDRA ---
+        echo ""
+        echo ">>> WITHOUT HYDRA (baseline Linux):"
+        echo ""
+        
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+        
+        # Run WITHOUT numactl -r all
+        $BENCH -s $spinners $MODE_FLAG --format=$FORMAT "${LOAD_ARGS[@]}" \
+            "${STORE_ARGS[@]}" ${STORE:+--variant linux} >&3 || check_status $?
+        
+        echo ""
+        echo "Hydra IPI Statistics (without Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+        
+        sleep 1
+        
+        # --- WITH HYDRA ---
+        echo ""
+        echo ">>> WITH HYDRA (numactl -r all):"
+        echo ""
+        
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+        
+        # Run WITH numactl -r all
+        numactl -r all $BENCH -s $spinners $MODE_FLAG --format=$FORMAT "${LOAD_ARGS[@]}" \
+            "${STORE_ARGS[@]}" ${STORE:+--variant hydra} >&3 || check_status $?
+        
+        echo ""
+        echo "Hydra IPI Statistics (with Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+        
+        sleep 1
+    done
 done
 
 echo ""
 echo "========================================================"
 echo "All tests completed"
 echo "========================================================"
+
+if [ "$REGRESSED" -ne 0 ]; then
+    echo "Regressions against $COMPARE, see the BASELINE COMPARISON sections"
+    exit 3
+fi
@@ -2,9 +2,16 @@
  * microbenchmark4.c - Memory Operation Comparison Benchmark
  * 
  * Compares Hydra's effectiveness across mprotect, munmap, and mmap operations.
- * Based on Hydra paper Figure 9.
+ * Based on Hydra paper Figure 9. The madv_*, mmap_fixed and mremap operations
+ * cover the paths allocators such as jemalloc and tcmalloc use to return
+ * memory without unmapping it.
  *
- * Compile: gcc -O2 -o microbenchmark4 microbenchmark4.c -lpthread -lnuma
+ * --mix interleaves several of them, picked by weight on every iteration,
+ * on sizes drawn from a fixed list, a log-uniform range or a replayed
+ * size histogram, and reports each operation's latency from the same run
+ * next to the mean over the whole mix.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
  * Run:     numactl -r all ./microbenchmark4 -o <operation> -s <spinners_per_node>
  */
 
@@ -13,237 +20,940 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
-#include <sched.h>
-#include <numa.h>
-#include <numaif.h>
-#include <time.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <getopt.h>
 
+#include "ab.h"
+#include "antagonist.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
 #define NUM_OPS 10000
-#define REGION_SIZE (64 * 1024)  /* 64KB */
-#define WORKER_NODE 0
+#define REGION_SIZE (64 * 1024)  /* 64KB, rounded up to the page size */
+#define MAX_WORKERS 64
+#define DEFAULT_RANGES 16
+#define MAX_RANGES 1024           /* UIO_MAXIOV for process_madvise */
+#define TOUCH_STRIDE_PAGES 8
+#define MAX_SIZE_BINS 256         /* --sizes list or histogram entries */
 
 typedef enum {
     OP_MPROTECT,    /* mprotect toggle (baseline) */
     OP_MUNMAP,      /* munmap + mmap cycle */
-    OP_MMAP_FULL    /* mmap + touch + munmap cycle */
+    OP_MMAP_FULL,   /* mmap + touch + munmap cycle */
+    OP_SCATTER_MPROTECT,  /* mprotect K scattered ranges, one call each */
+    OP_SCATTER_MADVISE,   /* MADV_DONTNEED K ranges, one call each */
+    OP_SCATTER_PMADVISE,  /* MADV_DONTNEED K ranges in one process_madvise */
+    OP_MADV_DONTNEED,     /* touch + madvise(MADV_DONTNEED) on one mapping */
+    OP_MADV_FREE,         /* touch + madvise(MADV_FREE) on one mapping */
+    OP_MMAP_FIXED,        /* touch + mmap(MAP_FIXED) over the old mapping */
+    OP_MREMAP,            /* mremap shrink to half, grow back, touch */
+    OP_MIX                /* --mix: weighted choice of the above per iteration */
 } op_type_t;
 
+typedef enum {
+    TOUCH_DEFAULT = -1,   /* none for munmap, first-last otherwise */
+    TOUCH_NONE,
+    TOUCH_FIRST_LAST,
+    TOUCH_ALL,
+    TOUCH_STRIDE          /* one page every touch_stride pages */
+} touch_mode_t;
+
 static int num_nodes;
+static size_t region_size;
 static int spinners_per_node;
+static antagonist_pool_t antagonists;
 static op_type_t operation;
-static volatile int ready_count = 0;
-static volatile int go = 0;
-static volatile int stop_spinners = 0;
+static start_barrier_t barrier;
 
-typedef struct {
-    int id;
-    int node;
-    int cpu;
-    uint64_t spin_count;
-} spinner_data_t;
+/* One worker per entry (--worker-node / --workers), spinners elsewhere */
+static int worker_nodes[MAX_WORKERS] = { 0 };
+static int num_workers = 1;
 
+/* Scattered ranges: K ranges of range_size, range_stride apart */
+static int num_ranges = DEFAULT_RANGES;
+static size_t range_size;
+static size_t range_stride;
+
+/* Pages written before each shootdown-causing call (--touch) */
+static touch_mode_t touch_mode = TOUCH_DEFAULT;
+static int touch_stride = TOUCH_STRIDE_PAGES;
+
+/* --mix: one latency slot per entry, in the order given */
 typedef struct {
-    void *region;
-    double elapsed_sec;
-    uint64_t ops;
-} worker_data_t;
+    op_type_t op;
+    double weight;
+} mix_entry_t;
+
+typedef enum {
+    SIZES_FIXED,         /* uniform over a list */
+    SIZES_LOG_UNIFORM,   /* log-uniform between two sizes */
+    SIZES_HIST           /* replayed "size count" histogram */
+} size_dist_t;
+
+static mix_entry_t mix[LAT_SLOTS];
+static int mix_len;
+static double mix_total;
+static char mix_spec[256];
+static const char *mix_names[LAT_SLOTS];
+
+static size_dist_t size_dist = SIZES_FIXED;
+static char sizes_spec[256];
+static size_t size_vals[MAX_SIZE_BINS];
+static double size_cum[MAX_SIZE_BINS];  /* cumulative weight */
+static int num_size_vals;
+static size_t size_lo, size_hi;         /* log-uniform bounds */
+
+/* munmap + mmap cycles where the kernel ignored the address hint */
+static uint64_t remap_moved;
+
+/* Latency slot names per operation, see the do_*_workload functions */
+static const char *const lat_names[][LAT_SLOTS] = {
+    [OP_MPROTECT]  = { "RW->RO", "RO->RW" },
+    [OP_MUNMAP]    = { "munmap", "mmap", "touch" },
+    [OP_MMAP_FULL] = { "mmap", "touch", "munmap" },
+    [OP_SCATTER_MPROTECT] = { "range RW->RO", "range RO->RW" },
+    [OP_SCATTER_MADVISE]  = { "range zap", "refault" },
+    [OP_SCATTER_PMADVISE] = { "batch zap", "refault" },
+    [OP_MADV_DONTNEED] = { "dontneed", "touch" },
+    [OP_MADV_FREE]     = { "free", "touch" },
+    [OP_MMAP_FIXED]    = { "mmap fixed", "touch" },
+    [OP_MREMAP]        = { "shrink", "grow", "touch" },
+};
+
+static int op_is_scatter(op_type_t op) {
+    return op >= OP_SCATTER_MPROTECT && op <= OP_SCATTER_PMADVISE;
+}
+
+static const char *const *cur_lat_names(void) {
+    return operation == OP_MIX ? mix_names : lat_names[operation];
+}
+
+static const char *touch_name(touch_mode_t t) {
+    switch (t) {
+    case TOUCH_NONE:       return "none";
+    case TOUCH_FIRST_LAST: return "first-last";
+    case TOUCH_ALL:        return "all";
+    case TOUCH_STRIDE:     return "stride";
+    default:               return "default";
+    }
+}
+
+/* Fault in pages of a fresh or zapped mapping according to --touch */
+HOT_INLINE void touch_region_as(char *region, size_t size, size_t page) {
+    size_t step = touch_mode == TOUCH_STRIDE ? page * touch_stride : page;
+    
+    switch (touch_mode) {
+    case TOUCH_FIRST_LAST:
+        ((volatile char *)region)[0] = 0xAB;
+        ((volatile char *)region)[size - 1] = 0xCD;
+        break;
+    case TOUCH_ALL:
+    case TOUCH_STRIDE:
+        for (size_t off = 0; off < size; off += step) {
+            ((volatile char *)region)[off] = 0xAB;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* One touch loop per page size, so mmap_full's timed touch has a constant stride */
+static void touch_region(char *region, size_t size) {
+    switch (region_page_size()) {
+    case PMD_SIZE:
+        touch_region_as(region, size, PMD_SIZE);
+        break;
+    case PUD_SIZE:
+        touch_region_as(region, size, PUD_SIZE);
+        break;
+    default:
+        touch_region_as(region, size, PAGE_SIZE_4K);
+        break;
+    }
+}
 
 static const char *op_name(op_type_t op) {
     switch (op) {
     case OP_MPROTECT: return "mprotect";
     case OP_MUNMAP:   return "munmap";
     case OP_MMAP_FULL: return "mmap_full";
+    case OP_SCATTER_MPROTECT: return "scatter_mprotect";
+    case OP_SCATTER_MADVISE:  return "scatter_madvise";
+    case OP_SCATTER_PMADVISE: return "scatter_pmadvise";
+    case OP_MADV_DONTNEED: return "madv_dontneed";
+    case OP_MADV_FREE:     return "madv_free";
+    case OP_MMAP_FIXED:    return "mmap_fixed";
+    case OP_MREMAP:        return "mremap";
+    case OP_MIX:           return "mix";
     default: return "unknown";
     }
 }
 
-static int get_cpu_for_node(int node, int index) {
-    struct bitmask *cpus = numa_allocate_cpumask();
-    int cpu = -1;
-    int count = 0;
-    
-    if (numa_node_to_cpus(node, cpus) < 0) {
-        numa_free_cpumask(cpus);
-        return -1;
+/* Operation by name; -1 if unknown. OP_MIX is only reached through --mix */
+static int parse_op(const char *name) {
+    for (int op = OP_MPROTECT; op < OP_MIX; op++) {
+        if (strcmp(name, op_name(op)) == 0)
+            return op;
     }
-    
-    for (int i = 0; i < numa_num_configured_cpus(); i++) {
-        if (numa_bitmask_isbitset(cpus, i)) {
-            if (count == index) {
-                cpu = i;
-                break;
+    return -1;
+}
+
+/* "mprotect:50,munmap:30,mmap_full:20"; a missing weight counts as 1 */
+static int parse_mix(const char *arg) {
+    char *copy = strdup(arg), *tok, *save, *colon;
+    int op;
+
+    mix_len = 0;
+    mix_total = 0;
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        colon = strchr(tok, ':');
+        if (colon)
+            *colon = '\0';
+        op = parse_op(tok);
+        if (op < 0 || op_is_scatter(op) || mix_len == LAT_SLOTS) {
+            fprintf(stderr, "Invalid mix entry: %s\n", tok);
+            free(copy);
+            return -1;
+        }
+        for (int i = 0; i < mix_len; i++) {
+            if (mix[i].op == (op_type_t)op) {
+                fprintf(stderr, "Operation listed twice in mix: %s\n", tok);
+                free(copy);
+                return -1;
             }
-            count++;
         }
+        mix[mix_len].op = op;
+        mix[mix_len].weight = colon ? atof(colon + 1) : 1.0;
+        if (mix[mix_len].weight <= 0) {
+            fprintf(stderr, "Invalid mix weight: %s\n", colon + 1);
+            free(copy);
+            return -1;
+        }
+        mix_names[mix_len] = op_name(op);
+        mix_total += mix[mix_len].weight;
+        mix_len++;
+    }
+    free(copy);
+    snprintf(mix_spec, sizeof(mix_spec), "%s", arg);
+    return mix_len > 0 ? 0 : -1;
+}
+
+static int add_size(size_t size, double weight) {
+    if (size == 0 || weight <= 0 || num_size_vals == MAX_SIZE_BINS)
+        return -1;
+    size_vals[num_size_vals] = size;
+    size_cum[num_size_vals] = weight + (num_size_vals ? size_cum[num_size_vals - 1] : 0);
+    num_size_vals++;
+    return 0;
+}
+
+/* Histogram file: one "<size> <count>" per line, '#' starts a comment */
+static int load_size_hist(const char *path) {
+    char line[256], size[64];
+    double count;
+    FILE *f = fopen(path, "r");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", size, &count) != 2)
+            continue;
+        if (count == 0)
+            continue;
+        if (add_size(parse_size(size), count) != 0) {
+            fprintf(stderr, "Invalid histogram line: %s", line);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return num_size_vals > 0 ? 0 : -1;
+}
+
+/* fixed:4k,64k,2m | loguniform:4k-16m | hist:<file> */
+static int parse_sizes(const char *arg) {
+    char *copy, *tok, *save, *dash;
+    int ret = 0;
+
+    num_size_vals = 0;
+    snprintf(sizes_spec, sizeof(sizes_spec), "%s", arg);
+    if (strncmp(arg, "hist:", 5) == 0) {
+        size_dist = SIZES_HIST;
+        return load_size_hist(arg + 5);
+    }
+    if (strncmp(arg, "loguniform:", 11) == 0) {
+        size_dist = SIZES_LOG_UNIFORM;
+        copy = strdup(arg + 11);
+        dash = strchr(copy, '-');
+        if (dash) {
+            *dash = '\0';
+            size_lo = parse_size(copy);
+            size_hi = parse_size(dash + 1);
+        }
+        free(copy);
+        return dash && size_lo > 0 && size_hi >= size_lo ? 0 : -1;
+    }
+    if (strncmp(arg, "fixed:", 6) != 0)
+        return -1;
+    size_dist = SIZES_FIXED;
+    copy = strdup(arg + 6);
+    for (tok = strtok_r(copy, ",", &save); tok && ret == 0; tok = strtok_r(NULL, ",", &save)) {
+        ret = add_size(parse_size(tok), 1.0);
+    }
+    free(copy);
+    return ret == 0 && num_size_vals > 0 ? 0 : -1;
+}
+
+static size_t max_mix_size(void) {
+    size_t max = size_hi;
+
+    for (int i = 0; i < num_size_vals; i++) {
+        if (size_vals[i] > max)
+            max = size_vals[i];
     }
-    numa_free_cpumask(cpus);
-    return cpu;
+    return region_round(max);
 }
 
-static void pin_to_cpu(int cpu) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(cpu, &cpuset);
-    sched_setaffinity(0, sizeof(cpuset), &cpuset);
+/* xorshift64* uniform in [0, 1), per-worker state */
+static double mix_rand(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return ((*s * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
 }
 
-static void pin_to_node_first_cpu(int node) {
-    int cpu = get_cpu_for_node(node, 0);
-    if (cpu >= 0) {
-        pin_to_cpu(cpu);
+static int pick_mix_slot(uint64_t *seed) {
+    double u = mix_rand(seed) * mix_total;
+    int i;
+
+    for (i = 0; i < mix_len - 1 && u >= mix[i].weight; i++) {
+        u -= mix[i].weight;
     }
+    return i;
 }
 
-static void *spinner(void *arg) {
-    spinner_data_t *data = (spinner_data_t *)arg;
+/* Next size from the distribution, whole pages of the current mode */
+static size_t pick_size(uint64_t *seed) {
+    double u = mix_rand(seed);
+    int i;
+
+    if (size_dist == SIZES_LOG_UNIFORM)
+        return region_round((size_t)exp(log((double)size_lo) +
+                                        u * (log((double)size_hi) - log((double)size_lo))));
+    u *= size_cum[num_size_vals - 1];
+    for (i = 0; i < num_size_vals - 1 && u >= size_cum[i]; i++)
+        ;
+    return region_round(size_vals[i]);
+}
+
+static void do_mprotect_workload(worker_data_t *data, run_budget_t budget) {
+    /* Pre-allocate region */
+    data->region = region_alloc(region_size);
+    if (!data->region)
+        return;
     
-    pin_to_cpu(data->cpu);
+    run_mprotect_toggle(data, region_size, budget);
     
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
+    region_free(data->region, region_size);
+}
+
+HOT_INLINE void do_munmap_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    /* Pre-allocate region */
+    char *region = region_alloc(region_size);
+    uint64_t ops = 0;
+    
+    if (!region)
+        return;
+    
+    uint64_t start = now_ns();
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        /* Unmap then immediately remap at same address hint */
+        char *addr = region;
+        touch_region(region, region_size);
+        uint64_t t0 = now_ns();
+        munmap(region, region_size);
+        uint64_t t1 = now_ns();
+        region = region_map_at(addr, region_size, 0);
+        uint64_t t2 = now_ns();
+        if (region == MAP_FAILED) {
+            perror("mmap in loop");
+            break;
+        }
+        /* A moved mapping means a fresh VA range, not a reuse of the old one */
+        if (region != addr)
+            __atomic_fetch_add(&remap_moved, 1, __ATOMIC_RELAXED);
+        hist_record(&data->lat[0], t1 - t0);
+        hist_record(&data->lat[1], t2 - t1);
+        ops += 1;  /* Count munmap as the operation */
     }
     
-    while (!stop_spinners) {
-        data->spin_count++;
-        __asm__ __volatile__("pause" ::: "memory");
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+    
+    if (region != MAP_FAILED)
+        munmap(region, region_size);
+}
+
+HOT_INLINE void do_mmap_full_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    uint64_t ops = 0;
+    uint64_t start = now_ns();
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        /* Full cycle: mmap, touch, munmap */
+        uint64_t t0 = now_ns();
+        char *region = region_map_at(NULL, region_size, 0);
+        uint64_t t1 = now_ns();
+        if (region == MAP_FAILED) {
+            perror("mmap in loop");
+            break;
+        }
+        touch_region(region, region_size);
+        uint64_t t2 = now_ns();
+        
+        munmap(region, region_size);
+        uint64_t t3 = now_ns();
+        hist_record(&data->lat[0], t1 - t0);
+        hist_record(&data->lat[1], t2 - t1);
+        hist_record(&data->lat[2], t3 - t2);
+        ops += 1;  /* Count full cycle as one operation */
     }
     
-    return NULL;
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
 }
 
-static void do_mprotect_workload(worker_data_t *data) {
-    /* Pre-allocate region */
-    data->region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (data->region == MAP_FAILED) {
-        perror("mmap");
+/*
+ * Allocator-style purge: the mapping stays, its pages are zapped (or, for
+ * MADV_FREE, marked clean and lazily reclaimed) and touched again.
+ */
+HOT_INLINE void do_madvise_workload(worker_data_t *data, run_budget_t budget, int advice,
+                                    int deadline) {
+    char *region = region_alloc(region_size);
+    uint64_t ops = 0;
+    
+    if (!region)
         return;
+    
+    uint64_t start = now_ns();
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        touch_region(region, region_size);
+        uint64_t t1 = now_ns();
+        if (madvise(region, region_size, advice) != 0) {
+            perror(advice == MADV_FREE ? "madvise MADV_FREE" : "madvise MADV_DONTNEED");
+            break;
+        }
+        uint64_t t2 = now_ns();
+        hist_record(&data->lat[0], t2 - t1);
+        hist_record(&data->lat[1], t1 - t0);
+        ops += 1;
     }
-    memset(data->region, 0xAB, REGION_SIZE);
     
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+    region_free(region, region_size);
+}
+
+/* Replace the mapping in place; the kernel unmaps the old pages first */
+HOT_INLINE void do_mmap_fixed_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    char *region = region_alloc(region_size);
+    uint64_t ops = 0;
     
-    for (int i = 0; i < NUM_OPS; i++) {
-        mprotect(data->region, REGION_SIZE, PROT_READ);
-        mprotect(data->region, REGION_SIZE, PROT_READ | PROT_WRITE);
-        data->ops += 2;
+    if (!region)
+        return;
+    
+    uint64_t start = now_ns();
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        touch_region(region, region_size);
+        uint64_t t1 = now_ns();
+        if (region_map_at(region, region_size, MAP_FIXED) == MAP_FAILED) {
+            perror("mmap MAP_FIXED in loop");
+            break;
+        }
+        uint64_t t2 = now_ns();
+        hist_record(&data->lat[0], t2 - t1);
+        hist_record(&data->lat[1], t1 - t0);
+        ops += 1;
     }
     
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+    region_free(region, region_size);
+}
+
+/*
+ * Realloc-style resize: shrinking unmaps the upper half (the shootdown),
+ * growing extends the mapping again, in place unless the kernel moves it.
+ */
+HOT_INLINE void do_mremap_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    size_t half = region_round(region_size / 2);
+    size_t size = region_size;
+    char *region = region_alloc(region_size);
+    uint64_t ops = 0;
+    
+    if (!region)
+        return;
+    
+    uint64_t start = now_ns();
     
-    munmap(data->region, REGION_SIZE);
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        touch_region(region, region_size);
+        uint64_t t1 = now_ns();
+        if (mremap(region, region_size, half, 0) == MAP_FAILED) {
+            perror("mremap shrink");
+            break;
+        }
+        uint64_t t2 = now_ns();
+        char *grown = mremap(region, half, region_size, MREMAP_MAYMOVE);
+        uint64_t t3 = now_ns();
+        if (grown == MAP_FAILED) {
+            perror("mremap grow");
+            size = half;
+            break;
+        }
+        if (grown != region)
+            __atomic_fetch_add(&remap_moved, 1, __ATOMIC_RELAXED);
+        region = grown;
+        hist_record(&data->lat[0], t2 - t1);
+        hist_record(&data->lat[1], t3 - t2);
+        hist_record(&data->lat[2], t1 - t0);
+        ops += 1;  /* Count the shrink as the operation */
+    }
+    
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+    region_free(region, size);
 }
 
-static void do_munmap_workload(worker_data_t *data) {
-    /* Pre-allocate region */
-    data->region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (data->region == MAP_FAILED) {
-        perror("mmap");
+/*
+ * Scattered protection changes, as done by GC write barriers. Every call
+ * changes one range, so ops counts ranges and the time per op is the
+ * amortized cost of one range.
+ */
+HOT_INLINE void do_scatter_mprotect_workload(worker_data_t *data, run_budget_t budget,
+                                             int deadline) {
+    char *base = region_alloc(region_size);
+    uint64_t busy = 0, ops = 0;
+    
+    if (!base)
         return;
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        for (int r = 0; r < num_ranges; r++) {
+            uint64_t t0 = now_ns();
+            mprotect(base + r * range_stride, range_size, PROT_READ);
+            uint64_t t1 = now_ns();
+            hist_record(&data->lat[0], t1 - t0);
+            busy += t1 - t0;
+        }
+        for (int r = 0; r < num_ranges; r++) {
+            uint64_t t0 = now_ns();
+            mprotect(base + r * range_stride, range_size, PROT_READ | PROT_WRITE);
+            uint64_t t1 = now_ns();
+            hist_record(&data->lat[1], t1 - t0);
+            busy += t1 - t0;
+        }
+        ops += 2 * num_ranges;
     }
-    memset(data->region, 0xAB, REGION_SIZE);
     
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+    data->ops += ops;
+    data->elapsed_sec = busy / 1e9;
+    region_free(base, region_size);
+}
+
+/* Fault the ranges back in so the next zap has PTEs to clear */
+static uint64_t refault_ranges(worker_data_t *data, char *base) {
+    uint64_t t0 = now_ns();
     
-    for (int i = 0; i < NUM_OPS; i++) {
-        /* Unmap then immediately remap at same address hint */
-        void *addr = data->region;
-        munmap(data->region, REGION_SIZE);
-        data->region = mmap(addr, REGION_SIZE, PROT_READ | PROT_WRITE,
-                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (data->region == MAP_FAILED) {
-            perror("mmap in loop");
-            break;
+    for (int r = 0; r < num_ranges; r++) {
+        for (size_t off = 0; off < range_size; off += region_page_size()) {
+            ((volatile char *)base)[r * range_stride + off] = 0xAB;
         }
-        data->ops += 1;  /* Count munmap as the operation */
     }
+    uint64_t t1 = now_ns();
+    hist_record(&data->lat[1], t1 - t0);
+    return t1 - t0;
+}
+
+HOT_INLINE void do_scatter_madvise_workload(worker_data_t *data, run_budget_t budget,
+                                            int deadline) {
+    char *base = region_alloc(region_size);
+    uint64_t busy = 0, ops = 0;
     
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (!base)
+        return;
     
-    if (data->region != MAP_FAILED)
-        munmap(data->region, REGION_SIZE);
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        for (int r = 0; r < num_ranges; r++) {
+            uint64_t t0 = now_ns();
+            madvise(base + r * range_stride, range_size, MADV_DONTNEED);
+            uint64_t t1 = now_ns();
+            hist_record(&data->lat[0], t1 - t0);
+            busy += t1 - t0;
+        }
+        ops += num_ranges;
+        refault_ranges(data, base);
+    }
+    
+    data->ops += ops;
+    data->elapsed_sec = busy / 1e9;
+    region_free(base, region_size);
 }
 
-static void do_mmap_full_workload(worker_data_t *data) {
-    struct timespec start, end;
-    clock_gettime(CLOCK_MONOTONIC, &start);
+/*
+ * One process_madvise() over K iovecs on our own pidfd. Kernels before
+ * 6.13 only accept cold/pageout advice here and fail with EINVAL.
+ */
+HOT_INLINE void do_scatter_pmadvise_workload(worker_data_t *data, run_budget_t budget,
+                                             int deadline) {
+    struct iovec iov[MAX_RANGES];
+    char *base;
+    uint64_t busy = 0, ops = 0;
+    int pidfd;
     
-    for (int i = 0; i < NUM_OPS; i++) {
-        /* Full cycle: mmap, touch, munmap */
-        data->region = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
-                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-        if (data->region == MAP_FAILED) {
-            perror("mmap in loop");
+    pidfd = (int)syscall(SYS_pidfd_open, getpid(), 0);
+    if (pidfd < 0) {
+        perror("pidfd_open");
+        return;
+    }
+    base = region_alloc(region_size);
+    if (!base) {
+        close(pidfd);
+        return;
+    }
+    for (int r = 0; r < num_ranges; r++) {
+        iov[r].iov_base = base + r * range_stride;
+        iov[r].iov_len = range_size;
+    }
+    
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        long ret = syscall(SYS_process_madvise, pidfd, iov, num_ranges, MADV_DONTNEED, 0);
+        uint64_t t1 = now_ns();
+        if (ret < 0) {
+            perror("process_madvise MADV_DONTNEED");
             break;
         }
-        /* Touch first and last page to fault them in */
-        ((volatile char *)data->region)[0] = 0xAB;
-        ((volatile char *)data->region)[REGION_SIZE - 1] = 0xCD;
-        
-        munmap(data->region, REGION_SIZE);
-        data->ops += 1;  /* Count full cycle as one operation */
+        hist_record(&data->lat[0], t1 - t0);
+        busy += t1 - t0;
+        ops += num_ranges;
+        refault_ranges(data, base);
     }
     
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    data->elapsed_sec = (end.tv_sec - start.tv_sec) + 
-                        (end.tv_nsec - start.tv_nsec) / 1e9;
+    data->ops += ops;
+    data->elapsed_sec = busy / 1e9;
+    region_free(base, region_size);
+    close(pidfd);
 }
 
-static void *worker(void *arg) {
-    worker_data_t *data = (worker_data_t *)arg;
+/*
+ * One operation of the mix on the first size bytes of the pool, which is
+ * mapped again afterwards where the operation removed it. The time of the
+ * operation's own call is recorded in slot and added to busy; returns 1
+ * after an operation, 0 when it was skipped and -1 if the pool could not be
+ * restored.
+ */
+static int mix_step(worker_data_t *data, char *pool, op_type_t op, size_t size, int slot,
+                    uint64_t *busy) {
+    size_t half = region_round(size / 2);
+    void *ret = pool;
+    uint64_t t0, t1;
+    char *fresh;
+    
+    /* A single page cannot be shrunk */
+    if (op == OP_MREMAP && half >= size)
+        return 0;
+    if (op != OP_MMAP_FULL)
+        touch_region(pool, size);
+    
+    t0 = now_ns();
+    switch (op) {
+    case OP_MPROTECT:
+        mprotect(pool, size, PROT_READ);
+        t1 = now_ns();
+        mprotect(pool, size, PROT_READ | PROT_WRITE);
+        break;
+    case OP_MUNMAP:
+        munmap(pool, size);
+        t1 = now_ns();
+        ret = region_map_at(pool, size, MAP_FIXED);
+        break;
+    case OP_MMAP_FULL:
+        fresh = region_map_at(NULL, size, 0);
+        if (fresh == MAP_FAILED) {
+            perror("mmap in mix");
+            return -1;
+        }
+        touch_region(fresh, size);
+        munmap(fresh, size);
+        t1 = now_ns();
+        break;
+    case OP_MADV_DONTNEED:
+    case OP_MADV_FREE:
+        madvise(pool, size, op == OP_MADV_FREE ? MADV_FREE : MADV_DONTNEED);
+        t1 = now_ns();
+        break;
+    case OP_MMAP_FIXED:
+        ret = region_map_at(pool, size, MAP_FIXED);
+        t1 = now_ns();
+        break;
+    case OP_MREMAP:
+        if (mremap(pool, size, half, 0) == MAP_FAILED) {
+            perror("mremap shrink in mix");
+            return -1;
+        }
+        t1 = now_ns();
+        /* The upper half was just freed, so growing in place succeeds */
+        if (mremap(pool, half, size, 0) == MAP_FAILED)
+            ret = region_map_at(pool + half, size - half, MAP_FIXED);
+        break;
+    default:
+        return -1;
+    }
+    if (ret == MAP_FAILED) {
+        perror("mmap MAP_FIXED in mix");
+        return -1;
+    }
     
-    pin_to_node_first_cpu(WORKER_NODE);
+    hist_record(&data->lat[slot], t1 - t0);
+    *busy += t1 - t0;
+    return 1;
+}
+
+/*
+ * --mix: every iteration picks an operation by weight and a size from the
+ * distribution. elapsed_sec is the time spent in the operations
+ * themselves, without the re-mapping and touching around them.
+ */
+HOT_INLINE void do_mix_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (data->id + 1);
+    size_t pool_size = max_mix_size();
+    uint64_t busy = 0, ops = 0;
+    char *pool = region_alloc(pool_size);
+    
+    if (!pool)
+        return;
     
-    __sync_fetch_and_add(&ready_count, 1);
-    while (!go) {
-        __asm__ __volatile__("pause" ::: "memory");
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        int slot = pick_mix_slot(&seed);
+        int done = mix_step(data, pool, mix[slot].op, pick_size(&seed), slot, &busy);
+        
+        if (done < 0)
+            break;
+        ops += done;
     }
     
+    data->ops += ops;
+    data->elapsed_sec = busy / 1e9;
+    region_free(pool, pool_size);
+}
+
+/* Mean of every mix call and each entry's share, from the merged slots */
+static double report_mix(const worker_data_t *data) {
+    hist_t *merged = malloc(sizeof(*merged));
+    uint64_t calls = 0, sum = 0;
+    
+    if (!merged)
+        return 0;
+    for (int slot = 0; slot < mix_len; slot++) {
+        latency_merge(data, num_workers, slot, merged);
+        calls += merged->count;
+        sum += merged->sum;
+    }
+    printf("Mix (%s, sizes %s):\n", mix_spec, sizes_spec);
+    printf("  %-14s %8s %10s %8s %10s %8s\n", "op", "weight", "calls", "share", "mean (us)", "time");
+    for (int slot = 0; slot < mix_len; slot++) {
+        latency_merge(data, num_workers, slot, merged);
+        printf("  %-14s %7.1f%% %10lu %7.1f%% %10.2f %7.1f%%\n", mix_names[slot],
+               100.0 * mix[slot].weight / mix_total, (unsigned long)merged->count,
+               calls ? 100.0 * merged->count / calls : 0, hist_mean(merged) / 1e3,
+               sum ? 100.0 * merged->sum / sum : 0);
+    }
+    free(merged);
+    printf("Mix mean latency: %.2f us per operation\n", calls ? sum / 1e3 / calls : 0);
+    return calls ? sum / 1e3 / calls : 0;
+}
+
+/* One copy of every workload per budget kind, see run_workload() */
+HOT_INLINE void run_workload_as(worker_data_t *data, run_budget_t budget, int deadline) {
     switch (operation) {
     case OP_MPROTECT:
-        do_mprotect_workload(data);
+        do_mprotect_workload(data, budget);
         break;
     case OP_MUNMAP:
-        do_munmap_workload(data);
+        do_munmap_workload(data, budget, deadline);
         break;
     case OP_MMAP_FULL:
-        do_mmap_full_workload(data);
+        do_mmap_full_workload(data, budget, deadline);
+        break;
+    case OP_SCATTER_MPROTECT:
+        do_scatter_mprotect_workload(data, budget, deadline);
+        break;
+    case OP_SCATTER_MADVISE:
+        do_scatter_madvise_workload(data, budget, deadline);
         break;
+    case OP_SCATTER_PMADVISE:
+        do_scatter_pmadvise_workload(data, budget, deadline);
+        break;
+    case OP_MADV_DONTNEED:
+        do_madvise_workload(data, budget, MADV_DONTNEED, deadline);
+        break;
+    case OP_MADV_FREE:
+        do_madvise_workload(data, budget, MADV_FREE, deadline);
+        break;
+    case OP_MMAP_FIXED:
+        do_mmap_fixed_workload(data, budget, deadline);
+        break;
+    case OP_MREMAP:
+        do_mremap_workload(data, budget, deadline);
+        break;
+    case OP_MIX:
+        do_mix_workload(data, budget, deadline);
+        break;
+    }
+}
+
+static void run_workload(worker_data_t *data, run_budget_t budget) {
+    if (budget.deadline_ns)
+        run_workload_as(data, budget, 1);
+    else
+        run_workload_as(data, budget, 0);
+}
+
+static void *worker(void *arg) {
+    worker_data_t *data = (worker_data_t *)arg;
+    
+    pin_to_cpu(data->cpu);
+    
+    /*
+     * Pilot for --target-rse; before the barrier so it is never timed. The
+     * per-range scatter loops record num_ranges slot-0 samples an iteration,
+     * and every mix entry only its weight's share of one, so each entry must
+     * reach the target on its own
+     */
+    if (run_calibrating()) {
+        int per_range = operation == OP_SCATTER_MPROTECT || operation == OP_SCATTER_MADVISE;
+    
+        run_workload(data, run_budget_fixed(RUN_PILOT_ITERS));
+        if (operation == OP_MIX) {
+            for (int slot = 0; slot < mix_len; slot++) {
+                run_calibrate_need(data, slot, mix[slot].weight / mix_total);
+            }
+            worker_reset_stats(data);
+        } else {
+            run_calibrate_report(data, 0, per_range ? num_ranges : 1);
+        }
     }
     
+    barrier_arrive_and_wait(data->barrier);
+    
+    perf_thread_start(&data->perf);
+    run_workload(data, run_budget(NUM_OPS));
+    perf_thread_stop(&data->perf);
+    
     return NULL;
 }
 
 static void print_usage(const char *prog) {
     fprintf(stderr, "Usage: %s -o <operation> [-s <spinners_per_node>]\n", prog);
-    fprintf(stderr, "  -o, --operation  Operation type: mprotect, munmap, mmap_full\n");
-    fprintf(stderr, "  -s, --spinners   Spinners per remote node (default: 8)\n");
-    fprintf(stderr, "  -h, --help       Show this help\n");
+    fprintf(stderr, "  -o, --operation OP    Operation type, see below (default: mprotect)\n");
+    fprintf(stderr, "  -s, --spinners N      Spinners per remote node (default: 8)\n");
+    fprintf(stderr, "  -w, --worker-node N   Node of the worker (default: 0)\n");
+    fprintf(stderr, "      --workers LIST    One worker per listed node, e.g. 0,0,2\n");
+    fprintf(stderr, "  -k, --ranges K        Ranges per iteration for scatter_* (default: %d)\n",
+            DEFAULT_RANGES);
+    fprintf(stderr, "      --range-size SIZE    Length of each range (default: one page)\n");
+    fprintf(stderr, "      --range-stride SIZE  Distance between range starts (default: 4 pages)\n");
+    fprintf(stderr, "      --touch MODE      Pages faulted in before each operation:\n");
+    fprintf(stderr, "                        none, first-last, all, stride[:N] (every N pages, default %d)\n",
+            TOUCH_STRIDE_PAGES);
+    fprintf(stderr, "                        (default: none for munmap, first-last otherwise)\n");
+    fprintf(stderr, "      --mix SPEC        Weighted mix instead of -o, e.g. mprotect:50,munmap:30,mmap_full:20\n");
+    fprintf(stderr, "      --sizes DIST      Mix sizes: fixed:4k,64k,2m, loguniform:4k-16m or hist:<file>\n");
+    fprintf(stderr, "                        (<size> <count> per line; default: fixed:64k)\n");
+    fprintf(stderr, "  -h, --help            Show this help\n");
     fprintf(stderr, "\nOperations:\n");
     fprintf(stderr, "  mprotect  - Toggle protection flags (baseline)\n");
     fprintf(stderr, "  munmap    - Unmap + remap cycle\n");
     fprintf(stderr, "  mmap_full - Full mmap + touch + munmap cycle\n");
+    fprintf(stderr, "  scatter_mprotect - mprotect K scattered ranges, one call per range\n");
+    fprintf(stderr, "  scatter_madvise  - MADV_DONTNEED K ranges, one call per range\n");
+    fprintf(stderr, "  scatter_pmadvise - MADV_DONTNEED K ranges in one process_madvise call\n");
+    fprintf(stderr, "  madv_dontneed - Touch + madvise(MADV_DONTNEED), mapping kept\n");
+    fprintf(stderr, "  madv_free     - Touch + madvise(MADV_FREE), mapping kept\n");
+    fprintf(stderr, "  mmap_fixed    - Touch + mmap(MAP_FIXED) over the same range\n");
+    fprintf(stderr, "  mremap        - Touch + mremap shrink to half + grow back\n");
+    harness_print_usage();
+    spinner_print_usage();
+    antagonist_print_usage();
+}
+
+static void emit_record(const worker_data_t *data, int total_spinners,
+                        uint64_t total_ops, double max_time, double mix_mean_us) {
+    rec_begin("microbenchmark4");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("worker_node", worker_nodes[0]);
+    rec_int("workers", num_workers);
+    rec_str("operation", op_name(operation));
+    rec_str("mix", operation == OP_MIX ? mix_spec : "");
+    rec_str("sizes", operation == OP_MIX ? sizes_spec : "");
+    rec_int("spinners_per_node", spinners_per_node);
+    rec_int("total_spinners", total_spinners);
+    rec_str("spinner_mode", spinner_mode_name(spinner_mode()));
+    rec_int("spinner_ws_bytes", (long long)spinner_working_set());
+    rec_str("spinner_placement", placement_name(spinner_placement()));
+    rec_int("region_bytes", (long long)region_size);
+    rec_int("ranges", op_is_scatter(operation) ? num_ranges : 0);
+    rec_int("range_bytes", op_is_scatter(operation) ? (long long)range_size : 0);
+    rec_int("range_stride_bytes", op_is_scatter(operation) ? (long long)range_stride : 0);
+    rec_str("touch", touch_name(touch_mode));
+    rec_int("touch_stride_pages", touch_mode == TOUCH_STRIDE ? touch_stride : 0);
+    rec_str("page_size", page_mode_name());
+    rec_int("iterations", (long long)run_ops(NUM_OPS));
+    rec_run_budget(NUM_OPS);
+    rec_close();
+    rec_object("results");
+    rec_int("total_ops", (long long)total_ops);
+    rec_double("wall_time_sec", max_time);
+    rec_double("throughput_ops_per_sec", total_ops / max_time);
+    rec_double("latency_per_op_us", (max_time * 1e6) / (total_ops / num_workers));
+    rec_int("remap_moved", (long long)remap_moved);
+    rec_double("mix_mean_us", mix_mean_us);
+    rec_close();
+    rec_workers(data, num_workers);
+    rec_start_skew(&barrier);
+    rec_latency(data, num_workers, cur_lat_names());
+    rec_perf(data, num_workers, num_nodes);
+    if (antagonists_enabled())
+        rec_antagonists(&antagonists);
+    rec_hydra();
+    rec_end();
 }
 
 int main(int argc, char **argv) {
-    pthread_t worker_thread;
-    pthread_t *spinner_threads = NULL;
-    spinner_data_t *spinner_data = NULL;
-    worker_data_t worker_data = {0};
+    pthread_t worker_threads[MAX_WORKERS];
+    spinner_pool_t spinners;
+    worker_data_t *data;
+    unsigned long worker_mask = 0;
+    uint64_t total_ops = 0;
+    double max_time = 0;
     int total_spinners;
-    int expected_ready;
+    double mix_mean_us = 0;
     
     spinners_per_node = 8;  /* Default */
     operation = OP_MPROTECT;
@@ -251,125 +961,270 @@ int main(int argc, char **argv) {
     static struct option long_opts[] = {
         {"operation", required_argument, 0, 'o'},
         {"spinners", required_argument, 0, 's'},
+        {"worker-node", required_argument, 0, 'w'},
+        {"workers", required_argument, 0, 'W'},
+        {"ranges", required_argument, 0, 'k'},
+        {"range-size", required_argument, 0, 'Z'},
+        {"range-stride", required_argument, 0, 'T'},
+        {"touch", required_argument, 0, 'X'},
+        {"mix", required_argument, 0, 'M'},
+        {"sizes", required_argument, 0, 'z'},
         {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        SPINNER_LONG_OPTS,
+        ANTAGONIST_LONG_OPTS,
         {0, 0, 0, 0}
     };
     
-    int opt;
-    while ((opt = getopt_long(argc, argv, "o:s:h", long_opts, NULL)) != -1) {
+    int opt, op;
+    while ((opt = getopt_long(argc, argv, "o:s:w:k:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 'o':
-            if (strcmp(optarg, "mprotect") == 0)
-                operation = OP_MPROTECT;
-            else if (strcmp(optarg, "munmap") == 0)
-                operation = OP_MUNMAP;
-            else if (strcmp(optarg, "mmap_full") == 0)
-                operation = OP_MMAP_FULL;
-            else {
+            op = parse_op(optarg);
+            if (op < 0) {
                 fprintf(stderr, "Unknown operation: %s\n", optarg);
                 print_usage(argv[0]);
                 return 1;
             }
+            operation = (op_type_t)op;
             break;
         case 's':
             spinners_per_node = atoi(optarg);
             break;
+        case 'k':
+            num_ranges = atoi(optarg);
+            if (num_ranges < 1 || num_ranges > MAX_RANGES) {
+                fprintf(stderr, "Ranges must be 1-%d\n", MAX_RANGES);
+                return 1;
+            }
+            break;
+        case 'Z':
+            range_size = parse_size(optarg);
+            if (range_size == 0) {
+                fprintf(stderr, "Invalid range size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            range_stride = parse_size(optarg);
+            if (range_stride == 0) {
+                fprintf(stderr, "Invalid range stride: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'X':
+            if (strcmp(optarg, "none") == 0)
+                touch_mode = TOUCH_NONE;
+            else if (strcmp(optarg, "first-last") == 0)
+                touch_mode = TOUCH_FIRST_LAST;
+            else if (strcmp(optarg, "all") == 0)
+                touch_mode = TOUCH_ALL;
+            else if (strncmp(optarg, "stride", 6) == 0 &&
+                     (optarg[6] == '\0' || optarg[6] == ':')) {
+                touch_mode = TOUCH_STRIDE;
+                if (optarg[6] == ':')
+                    touch_stride = atoi(optarg + 7);
+                if (touch_stride < 1) {
+                    fprintf(stderr, "Invalid touch stride: %s\n", optarg);
+                    return 1;
+                }
+            } else {
+                fprintf(stderr, "Unknown touch mode: %s\n", optarg);
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'M':
+            if (parse_mix(optarg) != 0) {
+                fprintf(stderr, "Invalid mix: %s\n", optarg);
+                return 1;
+            }
+            operation = OP_MIX;
+            break;
+        case 'z':
+            if (parse_sizes(optarg) != 0) {
+                fprintf(stderr, "Invalid size distribution: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            worker_nodes[0] = atoi(optarg);
+            num_workers = 1;
+            break;
+        case 'W':
+            num_workers = parse_int_list(optarg, worker_nodes, MAX_WORKERS);
+            if (num_workers < 1) {
+                fprintf(stderr, "Invalid worker list: %s\n", optarg);
+                return 1;
+            }
+            break;
         case 'h':
+            print_usage(argv[0]);
+            return 0;
         default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
             print_usage(argv[0]);
-            return (opt == 'h') ? 0 : 1;
+            return 1;
         }
     }
     
-    if (numa_available() < 0) {
-        fprintf(stderr, "NUMA not available\n");
+    if (ab_active())
+        return ab_run(argv);
+    
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    region_size = region_round(REGION_SIZE);
+    if (op_is_scatter(operation)) {
+        /* Keep at least a page between ranges so they never merge */
+        range_size = region_round(range_size ? range_size : 1);
+        if (range_stride < range_size + region_page_size())
+            range_stride = range_stride ? range_size + region_page_size() : 4 * range_size;
+        range_stride = region_round(range_stride);
+        region_size = num_ranges * range_stride;
+    }
+    if (operation == OP_MREMAP && region_size < 2 * region_page_size())
+        region_size = 2 * region_page_size();
+    if (sizes_spec[0] && operation != OP_MIX) {
+        fprintf(stderr, "--sizes needs --mix\n");
         return 1;
     }
+    if (operation == OP_MIX && !sizes_spec[0]) {
+        snprintf(sizes_spec, sizeof(sizes_spec), "fixed:%zuk", region_size / 1024);
+        add_size(region_size, 1.0);
+    }
+    if (operation == OP_MIX)
+        region_size = max_mix_size();
+    if (touch_mode == TOUCH_DEFAULT)
+        touch_mode = operation == OP_MUNMAP ? TOUCH_NONE : TOUCH_FIRST_LAST;
     
-    num_nodes = numa_num_configured_nodes();
-    total_spinners = spinners_per_node * (num_nodes - 1);
-    expected_ready = total_spinners + 1;
+    for (int i = 0; i < num_workers; i++) {
+        if (worker_nodes[i] < 0 || worker_nodes[i] >= num_nodes) {
+            fprintf(stderr, "Worker node %d out of range (0-%d)\n", worker_nodes[i], num_nodes - 1);
+            return 1;
+        }
+        worker_mask |= 1UL << worker_nodes[i];
+    }
+    data = aligned_calloc(num_workers, sizeof(worker_data_t));
+    if (!data || workers_place(data, worker_nodes, num_workers) != 0)
+        return 1;
     
-    printf("========================================\n");
-    printf("Microbenchmark 4: Memory Operation Comparison\n");
-    printf("========================================\n");
+    /* Spinners on all nodes with CPUs and without a worker */
+    total_spinners = 0;
+    for (int node = 0; node < num_nodes; node++) {
+        if (topo_cpus(node) > 0 && !(worker_mask & (1UL << node)))
+            total_spinners += spinners_per_node;
+    }
+    
+    print_banner("Microbenchmark 4: Memory Operation Comparison");
     printf("NUMA nodes: %d\n", num_nodes);
-    printf("Worker node: %d\n", WORKER_NODE);
+    printf("Workers:");
+    for (int i = 0; i < num_workers; i++) {
+        printf(" node %d CPU %d%s", data[i].node, data[i].cpu, i + 1 < num_workers ? "," : "\n");
+    }
     printf("Operation: %s\n", op_name(operation));
     printf("Spinners per remote node: %d\n", spinners_per_node);
     printf("Total spinner threads: %d\n", total_spinners);
-    printf("Region size: %d KB\n", REGION_SIZE / 1024);
-    printf("Iterations: %d\n", NUM_OPS);
-    printf("\n");
-    
-    /* Allocate spinner resources */
-    if (total_spinners > 0) {
-        spinner_threads = calloc(total_spinners, sizeof(pthread_t));
-        spinner_data = calloc(total_spinners, sizeof(spinner_data_t));
-        
-        int idx = 0;
-        for (int node = 0; node < num_nodes; node++) {
-            if (node == WORKER_NODE) continue;
-            
-            for (int s = 0; s < spinners_per_node; s++) {
-                int cpu = get_cpu_for_node(node, s);
-                if (cpu < 0) continue;
-                
-                spinner_data[idx].id = idx;
-                spinner_data[idx].node = node;
-                spinner_data[idx].cpu = cpu;
-                spinner_data[idx].spin_count = 0;
-                
-                if (pthread_create(&spinner_threads[idx], NULL, spinner, &spinner_data[idx]) != 0) {
-                    perror("pthread_create spinner");
-                    return 1;
-                }
-                idx++;
-            }
+    printf("Spinner mode: %s (touch working set %zu KB)\n",
+           spinner_mode_name(spinner_mode()), spinner_working_set() / 1024);
+    printf("Spinner placement: %s\n", placement_name(spinner_placement()));
+    print_antagonist_config();
+    if (operation == OP_MIX) {
+        printf("Mix:");
+        for (int i = 0; i < mix_len; i++) {
+            printf(" %s %.1f%%%s", mix_names[i], 100.0 * mix[i].weight / mix_total,
+                   i + 1 < mix_len ? "," : "\n");
         }
-        total_spinners = idx;
-        expected_ready = total_spinners + 1;
+        printf("Sizes: %s\n", sizes_spec);
+        printf("Pool per worker: %zu KB\n", region_size / 1024);
+    } else {
+        printf("Region size: %zu KB\n", region_size / 1024);
     }
+    print_page_layout(region_size);
+    if (!op_is_scatter(operation) && operation != OP_MPROTECT) {
+        if (touch_mode == TOUCH_STRIDE)
+            printf("Touch: every %d pages\n", touch_stride);
+        else
+            printf("Touch: %s\n", touch_name(touch_mode));
+    }
+    if (op_is_scatter(operation))
+        printf("Ranges: %d x %zu KB, %zu KB apart\n", num_ranges, range_size / 1024,
+               range_stride / 1024);
+    print_run_budget("Iterations", NUM_OPS);
+    printf("\n");
     
-    if (pthread_create(&worker_thread, NULL, worker, &worker_data) != 0) {
-        perror("pthread_create worker");
+    if (antagonists_start(&antagonists, num_nodes, worker_mask) < 0)
+        return 1;
+    total_spinners = spinners_start(&spinners, &barrier, num_nodes,
+                                    worker_mask, spinners_per_node);
+    if (total_spinners < 0)
         return 1;
-    }
     
-    while (ready_count < expected_ready) {
-        usleep(1000);
+    for (int i = 0; i < num_workers; i++) {
+        data[i].barrier = &barrier;
+        if (pthread_create(&worker_threads[i], NULL, worker, &data[i]) != 0) {
+            perror("pthread_create worker");
+            return 1;
+        }
     }
     
-    printf("All threads ready (%d spinners + 1 worker). Starting benchmark...\n\n", total_spinners);
+    barrier_wait_ready(&barrier, total_spinners + num_workers);
+    print_run_calibration(NUM_OPS);
     
-    go = 1;
-    __sync_synchronize();
+    /* The --target-rse pilots remapped too; count the trial only */
+    __atomic_store_n(&remap_moved, 0, __ATOMIC_RELAXED);
     
-    pthread_join(worker_thread, NULL);
+    printf("All threads ready (%d spinners + %d workers). Starting benchmark...\n\n",
+           total_spinners, num_workers);
     
-    stop_spinners = 1;
-    __sync_synchronize();
+    antagonists_mark(&antagonists);
+    hydra_trial_begin();
+    perf_trial_begin();
+    barrier_release(&barrier);
     
-    if (total_spinners > 0) {
-        for (int i = 0; i < total_spinners; i++) {
-            pthread_join(spinner_threads[i], NULL);
-        }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(worker_threads[i], NULL);
     }
+    perf_trial_end();
+    hydra_trial_end();
+    antagonists_stop(&antagonists);
     
-    printf("Worker completed: %.3f sec, %lu ops\n", 
-           worker_data.elapsed_sec, (unsigned long)worker_data.ops);
+    spinners_stop(&spinners);
     
-    printf("\n========================================\n");
+    report_workers(data, num_workers, &total_ops, &max_time);
+    
+    printf("\n");
+    print_rule();
     printf("RESULTS (%s, %d spinners/node):\n", op_name(operation), spinners_per_node);
-    printf("========================================\n");
-    printf("Total ops: %lu\n", (unsigned long)worker_data.ops);
-    printf("Wall time: %.3f sec\n", worker_data.elapsed_sec);
-    printf("Throughput: %.0f ops/sec\n", worker_data.ops / worker_data.elapsed_sec);
-    printf("Latency per op: %.2f us\n", (worker_data.elapsed_sec * 1e6) / worker_data.ops);
-    printf("========================================\n");
+    print_rule();
+    printf("Total ops: %lu\n", (unsigned long)total_ops);
+    printf("Wall time: %.3f sec\n", max_time);
+    printf("Throughput: %.0f ops/sec\n", total_ops / max_time);
+    printf("Latency per op: %.2f us\n", (max_time * 1e6) / (total_ops / num_workers));
+    if (op_is_scatter(operation))
+        printf("Amortized cost per range: %.2f us (%d range%s per call)\n",
+               (max_time * 1e6) / (total_ops / num_workers),
+               operation == OP_SCATTER_PMADVISE ? num_ranges : 1,
+               operation == OP_SCATTER_PMADVISE && num_ranges > 1 ? "s" : "");
+    if (operation == OP_MUNMAP || operation == OP_MREMAP)
+        printf("Remaps at a different address: %lu\n", (unsigned long)remap_moved);
+    print_start_skew(&barrier);
+    report_latency(data, num_workers, cur_lat_names());
+    if (operation == OP_MIX)
+        mix_mean_us = report_mix(data);
+    report_perf(data, num_workers, num_nodes);
+    report_antagonists(&antagonists);
+    report_ab_metrics(data, num_workers, cur_lat_names(), total_ops / max_time,
+                      (max_time * 1e6) / (total_ops / num_workers));
+    if (operation == OP_MIX)
+        ab_report_metric("mix mean latency (us)", mix_mean_us, 0);
+    hydra_print_delta();
+    print_rule();
     
-    if (spinner_threads) free(spinner_threads);
-    if (spinner_data) free(spinner_data);
+    if (report_structured())
+        emit_record(data, total_spinners, total_ops, max_time, mix_mean_us);
     
+    free(data);
     return 0;
 }
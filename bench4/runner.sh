@@ -6,7 +6,7 @@
 # Based on Hydra paper Figure 9
 #
 # Compile benchmark first:
-#   gcc -O2 -o microbenchmark4 microbenchmark4.c -lpthread -lnuma
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
 #
 # Run as root: sudo ./microbenchmark4_runner.sh
 
@@ -14,15 +14,23 @@ set -e
 
 BENCH="./microbenchmark4"
 HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
 SPINNERS=8  # Spinners per remote node
 
 # Operations to test
-OPERATIONS=(mprotect munmap mmap_full)
+OPERATIONS=(mprotect munmap mmap_full madv_dontneed madv_free mmap_fixed mremap scatter_mprotect scatter_madvise scatter_pmadvise)
 
 # Check prerequisites
 if [ ! -x "$BENCH" ]; then
     echo "Error: $BENCH not found or not executable"
-    echo "Compile with: gcc -O2 -o microbenchmark4 microbenchmark4.c -lpthread -lnuma"
+    echo "Compile with: make (from the repository root)"
     exit 1
 fi
 
@@ -56,7 +64,7 @@ for op in "${OPERATIONS[@]}"; do
     echo -1 > "$HYDRA_HISTORY"
     sleep 0.5
     
-    $BENCH -o $op -s $SPINNERS
+    $BENCH -o $op -s $SPINNERS --format=$FORMAT >&3
     
     echo ""
     echo "Hydra IPI Statistics (without Hydra):"
@@ -76,7 +84,7 @@ for op in "${OPERATIONS[@]}"; do
     echo -1 > "$HYDRA_HISTORY"
     sleep 0.5
     
-    numactl -r all $BENCH -o $op -s $SPINNERS
+    numactl -r all $BENCH -o $op -s $SPINNERS --format=$FORMAT >&3
     
     echo ""
     echo "Hydra IPI Statistics (with Hydra):"
@@ -0,0 +1,379 @@
+/*
+ * microbenchmark5.c - Page Fault / PTE Update Cost Benchmark
+ *
+ * Measures fault-in throughput. Under Hydra every new PTE must also be
+ * written to each page-table replica, so first-touch faults are where the
+ * replication cost of an update shows up.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark5 -m <mode> -s <size>
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <getopt.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
+#define DEFAULT_ITERS 50
+#define PILOT_ITERS 5
+#define DEFAULT_SIZE (4UL * 1024 * 1024)  /* 4MB */
+
+typedef enum {
+    FAULT_TOUCH,     /* mmap, write one byte per page, munmap */
+    FAULT_POPULATE,  /* mmap(MAP_POPULATE), munmap */
+    FAULT_DONTNEED   /* one mapping: madvise(MADV_DONTNEED), then refault */
+} fault_mode_t;
+
+static int num_nodes;
+static int worker_node;
+static size_t region_size;
+static size_t region_pages;
+static int iterations;
+static fault_mode_t mode;
+static start_barrier_t barrier;
+
+static const char *const lat_names[][LAT_SLOTS] = {
+    [FAULT_TOUCH]    = { "fault", "mmap", "munmap" },
+    [FAULT_POPULATE] = { "populate", "munmap" },
+    [FAULT_DONTNEED] = { "refault", "dontneed" },
+};
+
+static const char *mode_name(fault_mode_t m) {
+    switch (m) {
+    case FAULT_TOUCH:    return "touch";
+    case FAULT_POPULATE: return "populate";
+    case FAULT_DONTNEED: return "dontneed";
+    }
+    return "unknown";
+}
+
+/* Write one byte per page, timing each fault; returns the ns spent faulting */
+HOT_INLINE uint64_t touch_pages_as(worker_data_t *data, char *region, size_t page) {
+    size_t size = region_size;
+    uint64_t total = 0;
+
+    for (size_t off = 0; off < size; off += page) {
+        uint64_t t0 = now_ns();
+        ((volatile char *)region)[off] = 0xAB;
+        uint64_t t1 = now_ns();
+        hist_record(&data->lat[0], t1 - t0);
+        total += t1 - t0;
+    }
+    return total;
+}
+
+/* Instantiated per page size: the timed store is all that sits between the stamps */
+static uint64_t touch_pages(worker_data_t *data, char *region) {
+    switch (region_page_size()) {
+    case PMD_SIZE:
+        return touch_pages_as(data, region, PMD_SIZE);
+    case PUD_SIZE:
+        return touch_pages_as(data, region, PUD_SIZE);
+    default:
+        return touch_pages_as(data, region, PAGE_SIZE_4K);
+    }
+}
+
+HOT_INLINE void do_touch_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    uint64_t fault_ns = 0;
+    uint64_t ops = 0;
+
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        char *region = region_map_at(NULL, region_size, 0);
+        uint64_t t1 = now_ns();
+        if (region == MAP_FAILED) {
+            perror("mmap in loop");
+            break;
+        }
+        hist_record(&data->lat[1], t1 - t0);
+
+        fault_ns += touch_pages(data, region);
+        ops += region_pages;
+
+        uint64_t t2 = now_ns();
+        munmap(region, region_size);
+        hist_record(&data->lat[2], now_ns() - t2);
+    }
+
+    data->ops += ops;
+    data->elapsed_sec = fault_ns / 1e9;
+}
+
+HOT_INLINE void do_populate_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    uint64_t fault_ns = 0;
+    uint64_t ops = 0;
+
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        char *region = region_map_at(NULL, region_size, MAP_POPULATE);
+        uint64_t t1 = now_ns();
+        if (region == MAP_FAILED) {
+            perror("mmap in loop");
+            break;
+        }
+        hist_record(&data->lat[0], t1 - t0);
+        fault_ns += t1 - t0;
+        ops += region_pages;
+
+        munmap(region, region_size);
+        hist_record(&data->lat[1], now_ns() - t1);
+    }
+
+    data->ops += ops;
+    data->elapsed_sec = fault_ns / 1e9;
+}
+
+HOT_INLINE void do_dontneed_workload(worker_data_t *data, run_budget_t budget, int deadline) {
+    char *region = data->region;
+    uint64_t fault_ns = 0;
+    uint64_t ops = 0;
+
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        if (madvise(region, region_size, MADV_DONTNEED) != 0) {
+            perror("madvise MADV_DONTNEED");
+            break;
+        }
+        hist_record(&data->lat[1], now_ns() - t0);
+
+        fault_ns += touch_pages(data, region);
+        ops += region_pages;
+    }
+
+    data->ops += ops;
+    data->elapsed_sec = fault_ns / 1e9;
+}
+
+/* One copy of every workload per budget kind, see run_workload() */
+HOT_INLINE void run_workload_as(worker_data_t *data, run_budget_t budget, int deadline) {
+    switch (mode) {
+    case FAULT_TOUCH:
+        do_touch_workload(data, budget, deadline);
+        break;
+    case FAULT_POPULATE:
+        do_populate_workload(data, budget, deadline);
+        break;
+    case FAULT_DONTNEED:
+        do_dontneed_workload(data, budget, deadline);
+        break;
+    }
+}
+
+static void run_workload(worker_data_t *data, run_budget_t budget) {
+    if (budget.deadline_ns)
+        run_workload_as(data, budget, 1);
+    else
+        run_workload_as(data, budget, 0);
+}
+
+static void *worker(void *arg) {
+    worker_data_t *data = (worker_data_t *)arg;
+
+    data->cpu = pin_to_node(worker_node);
+
+    if (mode == FAULT_DONTNEED) {
+        data->region = region_alloc(region_size);
+        if (!data->region) {
+            barrier_arrive_and_wait(data->barrier);
+            return NULL;
+        }
+    }
+
+    /* Pilot for --target-rse; the populate slot gets one sample per mmap */
+    if (run_calibrating()) {
+        run_workload(data, run_budget_fixed(PILOT_ITERS));
+        run_calibrate_report(data, 0, mode == FAULT_POPULATE ? 1 : region_pages);
+    }
+
+    barrier_arrive_and_wait(data->barrier);
+
+    perf_thread_start(&data->perf);
+    run_workload(data, run_budget(iterations));
+    perf_thread_stop(&data->perf);
+
+    if (mode == FAULT_DONTNEED)
+        region_free(data->region, region_size);
+    return NULL;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-m <mode>] [-s <size>] [-i <iterations>]\n", prog);
+    fprintf(stderr, "  -m, --mode        Fault mode: touch, populate, dontneed (default: touch)\n");
+    fprintf(stderr, "  -s, --size        Region size, e.g. 64k, 4m, 1g (default: 4m)\n");
+    fprintf(stderr, "  -i, --iterations  Times the region is faulted in (default: %d)\n", DEFAULT_ITERS);
+    fprintf(stderr, "  -w, --worker-node Node of the faulting worker (default: 0)\n");
+    fprintf(stderr, "  -h, --help        Show this help\n");
+    fprintf(stderr, "\nModes:\n");
+    fprintf(stderr, "  touch     - mmap, write one byte per page, munmap\n");
+    fprintf(stderr, "  populate  - mmap with MAP_POPULATE, munmap\n");
+    fprintf(stderr, "  dontneed  - madvise(MADV_DONTNEED) one mapping, then refault it\n");
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s -m <mode>\n", prog);
+    harness_print_usage();
+}
+
+static void emit_record(const worker_data_t *data) {
+    rec_begin("microbenchmark5");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("worker_node", worker_node);
+    rec_str("mode", mode_name(mode));
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("pages", (long long)region_pages);
+    rec_int("iterations", (long long)run_ops(iterations));
+    rec_run_budget(iterations);
+    rec_close();
+    rec_object("results");
+    rec_int("total_faults", (long long)data->ops);
+    rec_double("fault_time_sec", data->elapsed_sec);
+    rec_double("faults_per_sec", data->ops / data->elapsed_sec);
+    rec_double("ns_per_fault", (data->elapsed_sec * 1e9) / data->ops);
+    rec_close();
+    rec_workers(data, 1);
+    rec_start_skew(&barrier);
+    rec_latency(data, 1, lat_names[mode]);
+    rec_perf(data, 1, num_nodes);
+    rec_hydra();
+    rec_end();
+}
+
+int main(int argc, char **argv) {
+    pthread_t worker_thread;
+    worker_data_t worker_data = {0};
+    size_t size = DEFAULT_SIZE;
+
+    iterations = DEFAULT_ITERS;
+    mode = FAULT_TOUCH;
+
+    static struct option long_opts[] = {
+        {"mode", required_argument, 0, 'm'},
+        {"size", required_argument, 0, 's'},
+        {"iterations", required_argument, 0, 'i'},
+        {"worker-node", required_argument, 0, 'w'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "m:s:i:w:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'm':
+            if (strcmp(optarg, "touch") == 0)
+                mode = FAULT_TOUCH;
+            else if (strcmp(optarg, "populate") == 0)
+                mode = FAULT_POPULATE;
+            else if (strcmp(optarg, "dontneed") == 0)
+                mode = FAULT_DONTNEED;
+            else {
+                fprintf(stderr, "Unknown mode: %s\n", optarg);
+                print_usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            size = parse_size(optarg);
+            if (size == 0) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'i':
+            iterations = atoi(optarg);
+            if (iterations < 1) {
+                fprintf(stderr, "Invalid iterations: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'w':
+            worker_node = atoi(optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    if (worker_node < 0 || worker_node >= num_nodes) {
+        fprintf(stderr, "Worker node %d out of range (0-%d)\n", worker_node, num_nodes - 1);
+        return 1;
+    }
+    region_size = region_round(size);
+    region_pages = region_size / region_page_size();
+
+    print_banner("Microbenchmark 5: Page Fault Cost");
+    printf("NUMA nodes: %d\n", num_nodes);
+    printf("Worker node: %d\n", worker_node);
+    printf("Mode: %s\n", mode_name(mode));
+    printf("Region size: %zu KB\n", region_size / 1024);
+    print_page_layout(region_size);
+    print_run_budget("Iterations", iterations);
+    printf("\n");
+
+    worker_data.node = worker_node;
+    worker_data.barrier = &barrier;
+    if (pthread_create(&worker_thread, NULL, worker, &worker_data) != 0) {
+        perror("pthread_create worker");
+        return 1;
+    }
+
+    barrier_wait_ready(&barrier, 1);
+    print_run_calibration(iterations);
+
+    printf("Worker ready. Starting benchmark...\n\n");
+
+    hydra_trial_begin();
+    perf_trial_begin();
+    barrier_release(&barrier);
+
+    pthread_join(worker_thread, NULL);
+    perf_trial_end();
+    hydra_trial_end();
+
+    printf("Worker completed: %.3f sec faulting, %lu faults\n",
+           worker_data.elapsed_sec, (unsigned long)worker_data.ops);
+
+    printf("\n");
+    print_rule();
+    printf("RESULTS (%s, %zuKB):\n", mode_name(mode), region_size / 1024);
+    print_rule();
+    printf("Total faults: %lu\n", (unsigned long)worker_data.ops);
+    printf("Fault time: %.3f sec\n", worker_data.elapsed_sec);
+    printf("Throughput: %.0f faults/sec\n", worker_data.ops / worker_data.elapsed_sec);
+    printf("Cost per fault: %.1f ns\n", (worker_data.elapsed_sec * 1e9) / worker_data.ops);
+    print_start_skew(&barrier);
+    report_latency(&worker_data, 1, lat_names[mode]);
+    report_perf(&worker_data, 1, num_nodes);
+    report_ab_metrics(&worker_data, 1, lat_names[mode],
+                      worker_data.ops / worker_data.elapsed_sec,
+                      (worker_data.elapsed_sec * 1e6) / worker_data.ops);
+    hydra_print_delta();
+    print_rule();
+
+    if (report_structured())
+        emit_record(&worker_data);
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+#!/bin/bash
+
+# microbenchmark5_runner.sh - Page Fault Cost Benchmark Runner
+#
+# Measures fault-in throughput per mode and region size, WITHOUT and WITH
+# Hydra, to expose the cost of writing every new PTE to each replica
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark5_runner.sh
+
+set -e
+
+BENCH="./microbenchmark5"
+HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Fault modes and region sizes to test
+MODES=(touch populate dontneed)
+SIZES=(64k 1m 16m 256m)
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+echo "========================================================"
+echo "Microbenchmark 5: Page Fault Cost"
+echo "========================================================"
+echo "Modes: ${MODES[*]}"
+echo "Region sizes: ${SIZES[*]}"
+echo "Each test runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for mode in "${MODES[@]}"; do
+    for size in "${SIZES[@]}"; do
+        echo ""
+        echo "########################################################"
+        echo "# Testing mode: $mode, region: $size"
+        echo "########################################################"
+
+        # --- WITHOUT HYDRA ---
+        echo ""
+        echo ">>> WITHOUT HYDRA (baseline Linux):"
+        echo ""
+
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+
+        $BENCH -m $mode -s $size --format=$FORMAT >&3
+
+        echo ""
+        echo "Hydra IPI Statistics (without Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+
+        sleep 1
+
+        # --- WITH HYDRA ---
+        echo ""
+        echo ">>> WITH HYDRA (numactl -r all):"
+        echo ""
+
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+
+        numactl -r all $BENCH -m $mode -s $size --format=$FORMAT >&3
+
+        echo ""
+        echo "Hydra IPI Statistics (with Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+
+        sleep 1
+    done
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
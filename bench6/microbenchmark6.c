@@ -0,0 +1,430 @@
+/*
+ * microbenchmark6.c - Page-Table Walk Locality Benchmark
+ *
+ * The other benchmarks measure the update side of replication (IPIs and
+ * PTE writes). This one measures the access side: a dependent pointer chase
+ * visits one cache line per 4KB slot of a region far larger than the STLB
+ * covers, so nearly every load needs a page walk. The region is faulted in
+ * from one node, which is where a non-replicated page table lives, and then
+ * chased from every node in turn. Data pages are interleaved across nodes
+ * so only the page-table location differs between readers; under Hydra
+ * each reader walks its local replica instead.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark6 -s <size> [--pt-node N] [--perf]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <getopt.h>
+#include <numa.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
+#define DEFAULT_SIZE (1UL << 30)   /* 1GB, ~500x the reach of a 1536-entry STLB */
+#define NUM_BATCHES 2000
+#define CHASE_BATCH 4096           /* dependent loads per timed batch */
+#define SLOT_SIZE 4096             /* one chain element per 4KB, for any page size */
+
+static int num_nodes;
+static int pt_node;
+static size_t region_size;
+static size_t num_slots;
+static char *region;
+static int pilot_pass;
+static void *volatile chase_sink;
+
+static const char *const lat_names[LAT_SLOTS] = {
+    "ns/access",
+};
+
+/* xorshift64*, fixed seed so every run builds the same chain */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Element of slot s; the line offset rotates so slots spread over cache sets */
+static void **slot_addr(size_t s) {
+    return (void **)(region + s * SLOT_SIZE + (s % (SLOT_SIZE / CACHE_LINE)) * CACHE_LINE);
+}
+
+/* Link every slot into one random cycle */
+static int build_chain(void) {
+    uint32_t *perm = malloc(num_slots * sizeof(*perm));
+
+    if (!perm) {
+        perror("malloc chain");
+        return -1;
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+        perm[i] = (uint32_t)i;
+    }
+    for (size_t i = num_slots - 1; i > 0; i--) {
+        size_t j = rng_next() % (i + 1);
+        uint32_t t = perm[i];
+
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+        *slot_addr(perm[i]) = slot_addr(perm[(i + 1) % num_slots]);
+    }
+    free(perm);
+    return 0;
+}
+
+/*
+ * Runs on the page-table node over the untouched region, so this first
+ * touch is what places the (non-replicated) page tables there, while the
+ * interleave policy set by main() spreads the data pages.
+ */
+static void *builder(void *arg) {
+    int *ret = (int *)arg;
+
+    pin_to_node(pt_node);
+    memset(region, 0xAB, region_size);
+    *ret = build_chain();
+    return NULL;
+}
+
+static void *reader(void *arg) {
+    worker_data_t *data = (worker_data_t *)arg;
+    run_budget_t budget;
+    void **p = slot_addr(0);
+    uint64_t busy = 0;
+    uint64_t ops = 0;
+
+    pin_to_cpu(data->cpu);
+
+    /* One untimed lap of a batch so the first samples are not cold in cache */
+    for (int k = 0; k < CHASE_BATCH; k++) {
+        p = (void **)*p;
+    }
+
+    budget = pilot_pass ? run_budget_fixed(RUN_PILOT_ITERS) : run_budget(NUM_BATCHES);
+    perf_thread_start(&data->perf);
+    for (uint64_t i = 0; run_budget_more(&budget, i); i++) {
+        uint64_t t0 = now_ns();
+        for (int k = 0; k < CHASE_BATCH; k++) {
+            p = (void **)*p;
+        }
+        uint64_t t1 = now_ns();
+        hist_record(&data->lat[0], (t1 - t0) / CHASE_BATCH);
+        busy += t1 - t0;
+        ops += CHASE_BATCH;
+    }
+    perf_thread_stop(&data->perf);
+    data->ops += ops;
+
+    /* Keep the chase live */
+    chase_sink = p;
+    data->elapsed_sec = busy / 1e9;
+
+    if (pilot_pass)
+        run_calibrate_report(data, 0, 1);
+    return NULL;
+}
+
+/* Chase from each node in turn, one reader at a time */
+static int run_readers(worker_data_t *data) {
+    pthread_t thread;
+
+    for (int node = 0; node < num_nodes; node++) {
+        if (topo_cpus(node) == 0)
+            continue;
+        if (pthread_create(&thread, NULL, reader, &data[node]) != 0) {
+            perror("pthread_create reader");
+            return -1;
+        }
+        pthread_join(thread, NULL);
+    }
+    return 0;
+}
+
+static double ns_per_access(const worker_data_t *d) {
+    return d->ops ? d->elapsed_sec * 1e9 / d->ops : 0;
+}
+
+static double per_access(const worker_data_t *d, int ev) {
+    return d->ops ? (double)d->perf.count[ev] / d->ops : 0;
+}
+
+/* Mean ns/access of the readers in each distance class from the page-table node */
+static void class_means(const worker_data_t *data, double *mean, int *nodes) {
+    double sum[DIST_CLASSES] = {0};
+
+    for (int c = 0; c < DIST_CLASSES; c++) {
+        nodes[c] = 0;
+    }
+    for (int node = 0; node < num_nodes; node++) {
+        dist_class_t c;
+
+        if (topo_cpus(node) == 0)
+            continue;
+        c = topo_class(pt_node, node);
+        sum[c] += ns_per_access(&data[node]);
+        nodes[c]++;
+    }
+    for (int c = 0; c < DIST_CLASSES; c++) {
+        mean[c] = nodes[c] ? sum[c] / nodes[c] : 0;
+    }
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s <size>] [--pt-node N]\n", prog);
+    fprintf(stderr, "  -s, --size SIZE   Region chased, e.g. 1g, 16g (default: 1g)\n");
+    fprintf(stderr, "  -n, --pt-node N   Node that faults the region in and so holds the\n");
+    fprintf(stderr, "                    page tables without Hydra (default: 0)\n");
+    fprintf(stderr, "  -h, --help        Show this help\n");
+    fprintf(stderr, "\nEach timed iteration is a batch of %d dependent loads; --ops counts batches.\n",
+            CHASE_BATCH);
+    fprintf(stderr, "Add --perf for dTLB miss and walk-cycle counts per access.\n");
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s -s <size>\n", prog);
+    harness_print_usage();
+}
+
+static void emit_record(const worker_data_t *data) {
+    double mean[DIST_CLASSES];
+    int nodes[DIST_CLASSES];
+
+    rec_begin("microbenchmark6");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("pt_node", pt_node);
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("slots", (long long)num_slots);
+    rec_int("accesses_per_batch", CHASE_BATCH);
+    rec_int("batches", (long long)run_ops(NUM_BATCHES));
+    rec_run_budget(NUM_BATCHES);
+    rec_close();
+    rec_array("readers");
+    for (int node = 0; node < num_nodes; node++) {
+        const worker_data_t *d = &data[node];
+
+        if (topo_cpus(node) == 0)
+            continue;
+        rec_object(NULL);
+        rec_int("node", d->node);
+        rec_int("cpu", d->cpu);
+        rec_int("pt_local", d->node == pt_node);
+        rec_int("distance", topo_distance(pt_node, node));
+        rec_str("class", dist_class_name(topo_class(pt_node, node)));
+        rec_int("accesses", (long long)d->ops);
+        rec_double("ns_per_access", ns_per_access(d));
+        if (d->perf.valid & (1u << PERF_DTLB_MISSES))
+            rec_double("dtlb_misses_per_access", per_access(d, PERF_DTLB_MISSES));
+        if (d->perf.valid & (1u << PERF_WALK_CYCLES))
+            rec_double("walk_cycles_per_access", per_access(d, PERF_WALK_CYCLES));
+        rec_close();
+    }
+    rec_close();
+    class_means(data, mean, nodes);
+    rec_array("classes");
+    for (int c = 0; c < DIST_CLASSES; c++) {
+        if (!nodes[c])
+            continue;
+        rec_object(NULL);
+        rec_str("class", dist_class_name(c));
+        rec_int("nodes", nodes[c]);
+        rec_double("ns_per_access", mean[c]);
+        rec_close();
+    }
+    rec_close();
+    rec_topology();
+    rec_latency(data, num_nodes, lat_names);
+    rec_perf(data, num_nodes, num_nodes);
+    rec_hydra();
+    rec_end();
+}
+
+int main(int argc, char **argv) {
+    pthread_t build_thread;
+    worker_data_t *data;
+    size_t size = DEFAULT_SIZE;
+    uint64_t total_ops = 0;
+    double total_time = 0, local_ns;
+    double class_ns[DIST_CLASSES];
+    int class_nodes[DIST_CLASSES];
+    int build_ret = -1;
+    int perf_cols;
+    char name[64];
+
+    static struct option long_opts[] = {
+        {"size", required_argument, 0, 's'},
+        {"pt-node", required_argument, 0, 'n'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:n:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            size = parse_size(optarg);
+            if (size == 0) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            pt_node = atoi(optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    if (pt_node < 0 || pt_node >= num_nodes) {
+        fprintf(stderr, "Page-table node %d out of range (0-%d)\n", pt_node, num_nodes - 1);
+        return 1;
+    }
+    if (topo_cpus(pt_node) == 0) {
+        fprintf(stderr, "Page-table node %d has no CPUs\n", pt_node);
+        return 1;
+    }
+    region_size = region_round(size);
+    num_slots = region_size / SLOT_SIZE;
+    if (num_slots < 2 || num_slots > UINT32_MAX) {
+        fprintf(stderr, "Region must hold 2 to 2^32 slots of %d bytes\n", SLOT_SIZE);
+        return 1;
+    }
+
+    print_banner("Microbenchmark 6: Page-Table Walk Locality");
+    printf("NUMA nodes: %d\n", num_nodes);
+    print_topology();
+    printf("Region size: %zu MB\n", region_size >> 20);
+    print_page_layout(region_size);
+    printf("Chain: %zu slots of %d bytes, random cycle\n", num_slots, SLOT_SIZE);
+    printf("Page tables first touched on node %d, data interleaved over all nodes\n", pt_node);
+    print_run_budget("Batches per reader", NUM_BATCHES);
+    printf("\n");
+
+    region = region_map(region_size);
+    if (!region)
+        return 1;
+    if (num_nodes > 1)
+        numa_interleave_memory(region, region_size, numa_all_nodes_ptr);
+
+    printf("Building chain on node %d...\n", pt_node);
+    if (pthread_create(&build_thread, NULL, builder, &build_ret) != 0) {
+        perror("pthread_create builder");
+        return 1;
+    }
+    pthread_join(build_thread, NULL);
+    if (build_ret != 0)
+        return 1;
+
+    data = aligned_calloc(num_nodes, sizeof(worker_data_t));
+    if (!data)
+        return 1;
+    for (int node = 0; node < num_nodes; node++) {
+        data[node].id = node;
+        data[node].node = node;
+        data[node].cpu = get_cpu_for_node(node, 0);
+    }
+
+    if (run_calibrating()) {
+        pilot_pass = 1;
+        if (run_readers(data) != 0)
+            return 1;
+        pilot_pass = 0;
+        print_run_calibration(NUM_BATCHES);
+    }
+
+    printf("Chasing from every node in turn...\n\n");
+
+    hydra_trial_begin();
+    perf_trial_begin();
+    if (run_readers(data) != 0)
+        return 1;
+    perf_trial_end();
+    hydra_trial_end();
+
+    for (int node = 0; node < num_nodes; node++) {
+        total_ops += data[node].ops;
+        total_time += data[node].elapsed_sec;
+    }
+    local_ns = ns_per_access(&data[pt_node]);
+    perf_cols = perf_enabled() && (data[pt_node].perf.valid & (1u << PERF_DTLB_MISSES));
+
+    printf("\n");
+    print_rule();
+    printf("RESULTS (%zuMB, %s pages, page tables on node %d):\n",
+           region_size >> 20, page_mode_name(), pt_node);
+    print_rule();
+    printf("  %-6s %5s %12s %10s %9s %9s", "node", "cpu", "accesses", "ns/access", "p50", "p99");
+    if (perf_cols)
+        printf(" %12s %12s", "dTLB miss/a", "walk cyc/a");
+    printf(" %8s\n", "vs pt");
+    for (int node = 0; node < num_nodes; node++) {
+        const worker_data_t *d = &data[node];
+
+        if (topo_cpus(node) == 0)
+            continue;
+        printf("  %-6d %5d %12lu %10.1f %9lu %9lu", node, d->cpu, (unsigned long)d->ops,
+               ns_per_access(d), (unsigned long)hist_percentile(&d->lat[0], 50.0),
+               (unsigned long)hist_percentile(&d->lat[0], 99.0));
+        if (perf_cols) {
+            printf(" %12.3f", per_access(d, PERF_DTLB_MISSES));
+            if (d->perf.valid & (1u << PERF_WALK_CYCLES))
+                printf(" %12.1f", per_access(d, PERF_WALK_CYCLES));
+            else
+                printf(" %12s", "n/a");
+        }
+        printf(" %7.2fx%s\n", local_ns > 0 ? ns_per_access(d) / local_ns : 0,
+               node == pt_node ? " (pt node)" : "");
+
+        snprintf(name, sizeof(name), "ns/access node %d", node);
+        ab_report_metric(name, ns_per_access(d), 0);
+    }
+    printf("Mean: %.1f ns/access over %lu accesses\n",
+           total_ops ? total_time * 1e9 / total_ops : 0, (unsigned long)total_ops);
+    if (topo_cpu_nodes() > 1) {
+        class_means(data, class_ns, class_nodes);
+        printf("By distance from the page-table node:\n");
+        printf("  %-12s %6s %10s %8s\n", "class", "nodes", "ns/access", "vs pt");
+        for (int c = 0; c < DIST_CLASSES; c++) {
+            if (!class_nodes[c])
+                continue;
+            printf("  %-12s %6d %10.1f %7.2fx\n", dist_class_name(c), class_nodes[c],
+                   class_ns[c], local_ns > 0 ? class_ns[c] / local_ns : 0);
+        }
+    }
+    report_perf(data, num_nodes, num_nodes);
+    hydra_print_delta();
+    print_rule();
+
+    if (report_structured())
+        emit_record(data);
+
+    region_free(region, region_size);
+    return 0;
+}
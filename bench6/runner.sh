@@ -0,0 +1,104 @@
+#!/bin/bash
+
+# microbenchmark6_runner.sh - Page-Table Walk Locality Benchmark Runner
+#
+# Measures pointer-chase latency from every node over regions far beyond
+# STLB reach, WITHOUT Hydra (one page table on node 0) and WITH Hydra
+# (a local replica per node), for 4K and THP pages
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark6_runner.sh
+
+set -e
+
+BENCH="./microbenchmark6"
+HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Page sizes and region sizes to test
+PAGESIZES=(4k thp)
+SIZES=(1g 4g 16g)
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+echo "========================================================"
+echo "Microbenchmark 5: Page Fault Cost"
+echo "========================================================"
+echo "Page sizes: ${PAGESIZES[*]}"
+echo "Region sizes: ${SIZES[*]}"
+echo "Each test runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for pagesize in "${PAGESIZES[@]}"; do
+    for size in "${SIZES[@]}"; do
+        echo ""
+        echo "########################################################"
+        echo "# Testing pages: $pagesize, region: $size"
+        echo "########################################################"
+
+        # --- WITHOUT HYDRA ---
+        echo ""
+        echo ">>> WITHOUT HYDRA (baseline Linux):"
+        echo ""
+
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+
+        $BENCH -s $size --pagesize $pagesize --perf --format=$FORMAT >&3
+
+        echo ""
+        echo "Hydra IPI Statistics (without Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+
+        sleep 1
+
+        # --- WITH HYDRA ---
+        echo ""
+        echo ">>> WITH HYDRA (numactl -r all):"
+        echo ""
+
+        sync
+        echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+        echo -1 > "$HYDRA_HISTORY"
+        sleep 0.5
+
+        numactl -r all $BENCH -s $size --pagesize $pagesize --perf --format=$FORMAT >&3
+
+        echo ""
+        echo "Hydra IPI Statistics (with Hydra):"
+        echo "----------------------------------------"
+        cat "$HYDRA_HISTORY"
+        echo "----------------------------------------"
+
+        sleep 1
+    done
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
@@ -0,0 +1,342 @@
+/*
+ * microbenchmark7.c - Page-Table Memory Overhead Reporter
+ *
+ * Replication trades memory for locality: every node holds its own copy of
+ * the page tables. This maps and faults in a region per page size and
+ * reports how much page-table memory it cost, from the mm (VmPTE in
+ * /proc/self/status), the system (nr_page_table_pages in /proc/vmstat) and
+ * each node (PageTables in /sys/devices/system/node/nodeN/meminfo, the
+ * source numastat -m reads), next to the Hydra /proc delta. The overhead
+ * is given as a ratio of the mapped size and as copies of the minimal
+ * single page table, which is the number capacity planning needs.
+ *
+ * The vmstat and per-node counters are system wide, so run on a quiet box
+ * (as root, so the per-CPU counter caches can be flushed first).
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark7 -s <size> [-p 4k,thp,2m]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <getopt.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
+#define DEFAULT_SIZE (1UL << 30)  /* 1GB */
+#define DEFAULT_PAGESIZES "4k,thp"
+#define MAX_PAGESIZES 4
+#define MAX_NODES 64
+#define PT_PAGE 4096UL
+#define PUD_SPAN (PUD_SIZE * PT_ENTRIES)  /* reach of one PUD table, 512GB */
+#define DELTA_NA LLONG_MIN                /* counter missing before or after */
+
+/* Page-table usage at one point in time, bytes */
+typedef struct {
+    long long vm_pte;
+    long long vmstat;
+    long long node[MAX_NODES];
+} pt_snapshot_t;
+
+typedef struct {
+    char name[8];
+    size_t mapped;
+    int ok;
+    pt_snapshot_t delta;
+    long long node_sum;
+    long long minimal;
+} pt_result_t;
+
+static int num_nodes;
+static int worker_node;
+
+/* "Key: value kB" style line value from path, -1 if missing */
+static long long read_field(const char *path, const char *key, long long scale) {
+    char line[256];
+    size_t len = strlen(key);
+    long long v = -1;
+    FILE *f = fopen(path, "r");
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, key);
+
+        /* Per-node meminfo lines start with "Node N ", match after it */
+        if (!p || (p != line && p[-1] != ' ') || (p[len] != ':' && p[len] != ' '))
+            continue;
+        v = strtoll(p + len + 1, NULL, 10) * scale;
+        break;
+    }
+    fclose(f);
+    return v;
+}
+
+/* Fold the per-CPU vmstat deltas so the counters below are exact (root only) */
+static void stat_refresh(void) {
+    FILE *f = fopen("/proc/sys/vm/stat_refresh", "w");
+
+    if (f) {
+        fputs("1\n", f);
+        fclose(f);
+    }
+}
+
+static void pt_snapshot(pt_snapshot_t *s) {
+    char path[128];
+
+    stat_refresh();
+
+    s->vm_pte = read_field("/proc/self/status", "VmPTE", 1024);
+    s->vmstat = read_field("/proc/vmstat", "nr_page_table_pages", PT_PAGE);
+    for (int node = 0; node < num_nodes && node < MAX_NODES; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", node);
+        s->node[node] = read_field(path, "PageTables", 1024);
+    }
+}
+
+static long long diff(long long after, long long before) {
+    return after < 0 || before < 0 ? DELTA_NA : after - before;
+}
+
+/* Smallest possible page table for size: every level below the PGD, one copy */
+static long long minimal_tables(size_t size) {
+    long long bytes = 0;
+
+    for (size_t span = region_page_size() * PT_ENTRIES; span <= PUD_SPAN; span *= PT_ENTRIES) {
+        bytes += (long long)((size + span - 1) / span) * PT_PAGE;
+    }
+    return bytes;
+}
+
+static void measure(const char *name, size_t size, pt_result_t *r) {
+    pt_snapshot_t before, after;
+    void *region;
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    set_page_mode(name);
+    r->mapped = region_round(size);
+    r->minimal = minimal_tables(r->mapped);
+
+    pt_snapshot(&before);
+    region = region_alloc(r->mapped);
+    if (!region)
+        return;
+    pt_snapshot(&after);
+
+    r->delta.vm_pte = diff(after.vm_pte, before.vm_pte);
+    r->delta.vmstat = diff(after.vmstat, before.vmstat);
+    for (int node = 0; node < num_nodes; node++) {
+        r->delta.node[node] = diff(after.node[node], before.node[node]);
+        if (r->delta.node[node] != DELTA_NA)
+            r->node_sum += r->delta.node[node];
+    }
+    r->ok = 1;
+
+    region_free(region, r->mapped);
+}
+
+/* Best total of the three sources: per-node sum, then vmstat, then VmPTE */
+static long long total_bytes(const pt_result_t *r) {
+    if (r->node_sum > 0)
+        return r->node_sum;
+    if (r->delta.vmstat > 0)
+        return r->delta.vmstat;
+    return r->delta.vm_pte != DELTA_NA ? r->delta.vm_pte : 0;
+}
+
+/* Missing counters become null in the record */
+static void rec_bytes(const char *key, long long bytes) {
+    if (bytes == DELTA_NA)
+        rec_double(key, NAN);
+    else
+        rec_int(key, bytes);
+}
+
+static void print_kb(long long bytes) {
+    if (bytes == DELTA_NA)
+        printf(" %10s", "n/a");
+    else
+        printf(" %10lld", bytes / 1024);
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-s <size>] [-p <pagesizes>]\n", prog);
+    fprintf(stderr, "  -s, --size SIZE        Region mapped per page size (default: 1g)\n");
+    fprintf(stderr, "  -p, --pagesizes LIST   Page sizes to compare: 4k, thp, 2m, 1g (default: %s)\n",
+            DEFAULT_PAGESIZES);
+    fprintf(stderr, "  -w, --worker-node N    Node that faults the region in (default: 0)\n");
+    fprintf(stderr, "  -h, --help             Show this help\n");
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s -s <size>\n", prog);
+    harness_print_usage();
+}
+
+static void emit_record(const pt_result_t *res, int n) {
+    rec_begin("microbenchmark7");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_int("worker_node", worker_node);
+    rec_close();
+    rec_array("results");
+    for (int i = 0; i < n; i++) {
+        const pt_result_t *r = &res[i];
+
+        if (!r->ok)
+            continue;
+        rec_object(NULL);
+        rec_str("page_size", r->name);
+        rec_int("mapped_bytes", (long long)r->mapped);
+        rec_bytes("vm_pte_bytes", r->delta.vm_pte);
+        rec_bytes("vmstat_bytes", r->delta.vmstat);
+        rec_array("node_bytes");
+        for (int node = 0; node < num_nodes; node++) {
+            rec_bytes(NULL, r->delta.node[node]);
+        }
+        rec_close();
+        rec_int("minimal_bytes", r->minimal);
+        rec_double("overhead_ratio", (double)total_bytes(r) / r->mapped);
+        rec_double("copies", r->minimal ? (double)total_bytes(r) / r->minimal : 0);
+        rec_close();
+    }
+    rec_close();
+    rec_hydra();
+    rec_end();
+}
+
+int main(int argc, char **argv) {
+    pt_result_t res[MAX_PAGESIZES];
+    char pagesizes[64] = DEFAULT_PAGESIZES;
+    char *names[MAX_PAGESIZES], *tok, *save;
+    size_t size = DEFAULT_SIZE;
+    char metric[64];
+    int n = 0;
+
+    static struct option long_opts[] = {
+        {"size", required_argument, 0, 's'},
+        {"pagesizes", required_argument, 0, 'p'},
+        {"worker-node", required_argument, 0, 'w'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:p:w:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            size = parse_size(optarg);
+            if (size == 0) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            snprintf(pagesizes, sizeof(pagesizes), "%s", optarg);
+            break;
+        case 'w':
+            worker_node = atoi(optarg);
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    if (num_nodes > MAX_NODES)
+        num_nodes = MAX_NODES;
+    if (worker_node < 0 || worker_node >= num_nodes) {
+        fprintf(stderr, "Worker node %d out of range (0-%d)\n", worker_node, num_nodes - 1);
+        return 1;
+    }
+    for (tok = strtok_r(pagesizes, ",", &save); tok && n < MAX_PAGESIZES;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (set_page_mode(tok) != 0) {
+            fprintf(stderr, "Unknown page size: %s\n", tok);
+            return 1;
+        }
+        names[n++] = tok;
+    }
+
+    print_banner("Microbenchmark 7: Page-Table Memory Overhead");
+    printf("NUMA nodes: %d\n", num_nodes);
+    printf("Faulting node: %d\n", worker_node);
+    printf("Region size: %zu MB\n", size >> 20);
+    printf("Page sizes:");
+    for (int i = 0; i < n; i++) {
+        printf(" %s", names[i]);
+    }
+    printf("\n");
+    printf("\n");
+
+    pin_to_node(worker_node);
+
+    hydra_trial_begin();
+    for (int i = 0; i < n; i++) {
+        printf("Mapping %zu MB with %s pages...\n", size >> 20, names[i]);
+        measure(names[i], size, &res[i]);
+    }
+    hydra_trial_end();
+
+    printf("\n");
+    print_rule();
+    printf("RESULTS (page-table KB added by the mapping):\n");
+    print_rule();
+    printf("  %-6s %10s %10s %10s", "pages", "mapped MB", "VmPTE", "vmstat");
+    for (int node = 0; node < num_nodes; node++) {
+        snprintf(metric, sizeof(metric), "node %d", node);
+        printf(" %10s", metric);
+    }
+    printf(" %10s %9s %7s\n", "minimal", "overhead", "copies");
+    for (int i = 0; i < n; i++) {
+        const pt_result_t *r = &res[i];
+        long long total = total_bytes(r);
+
+        if (!r->ok) {
+            printf("  %-6s (mapping failed)\n", r->name);
+            continue;
+        }
+        printf("  %-6s %10zu", r->name, r->mapped >> 20);
+        print_kb(r->delta.vm_pte);
+        print_kb(r->delta.vmstat);
+        for (int node = 0; node < num_nodes; node++) {
+            print_kb(r->delta.node[node]);
+        }
+        print_kb(r->minimal);
+        printf(" %8.3f%% %6.2fx\n", 100.0 * total / r->mapped,
+               r->minimal ? (double)total / r->minimal : 0);
+
+        snprintf(metric, sizeof(metric), "page-table overhead (%%) [%.7s]", r->name);
+        ab_report_metric(metric, 100.0 * total / r->mapped, 0);
+    }
+    printf("\nOverhead is the per-node total over the mapped size; copies compares it\n");
+    printf("with one minimal page table (every level below the PGD).\n");
+    hydra_print_delta();
+    print_rule();
+
+    if (report_structured())
+        emit_record(res, n);
+
+    return 0;
+}
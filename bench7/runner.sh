@@ -0,0 +1,102 @@
+#!/bin/bash
+
+# microbenchmark7_runner.sh - Page-Table Memory Overhead Runner
+#
+# Reports the page-table memory a mapping costs per node, WITHOUT Hydra
+# (one copy) and WITH Hydra (one replica per node), for 4K and 2M pages
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark7_runner.sh
+
+set -e
+
+BENCH="./microbenchmark7"
+HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Page sizes (compared within one run) and region sizes to test;
+# 2m needs hugetlb pages reserved, drop it from the list otherwise
+PAGESIZES="4k,thp,2m"
+SIZES=(1g 16g 64g)
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+echo "========================================================"
+echo "Microbenchmark 5: Page Fault Cost"
+echo "========================================================"
+echo "Page sizes: $PAGESIZES"
+echo "Region sizes: ${SIZES[*]}"
+echo "Each test runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for size in "${SIZES[@]}"; do
+    echo ""
+    echo "########################################################"
+    echo "# Testing region: $size"
+    echo "########################################################"
+
+    # --- WITHOUT HYDRA ---
+    echo ""
+    echo ">>> WITHOUT HYDRA (baseline Linux):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    $BENCH -s $size -p $PAGESIZES --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (without Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+
+    # --- WITH HYDRA ---
+    echo ""
+    echo ">>> WITH HYDRA (numactl -r all):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    numactl -r all $BENCH -s $size -p $PAGESIZES --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (with Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
@@ -0,0 +1,695 @@
+/*
+ * microbenchmark8.c - Memory-Map Trace Replay
+ *
+ * The other benchmarks drive one operation in a fixed loop. This replays
+ * a recorded sequence of mmap, munmap, mprotect and madvise calls, so the
+ * shootdown pattern of a real allocator or runtime can be compared with
+ * and without Hydra. Each traced thread becomes a replay thread pinned to
+ * a CPU of its node, cycling through the nodes (or --nodes) in order of
+ * first appearance. All addresses land in one PROT_NONE arena sized from
+ * the trace, so the replay never collides with the process's own maps.
+ *
+ * Trace file (little endian): a 16-byte header, "HTRC", uint32 version 1
+ * and uint64 span, the bytes of address space the trace covers, followed
+ * by 32-byte records:
+ *
+ *   uint64 ts_ns    time since the start of the recording
+ *   uint32 thread   recorded thread id, any value
+ *   uint8  op       0 mmap, 1 munmap, 2 mprotect, 3 madvise
+ *   uint8  prot     PROT_* bits, or the advice for madvise
+ *   uint16 pad
+ *   uint64 offset   start address minus the lowest address of the trace
+ *   uint64 len
+ *
+ * Records of a thread are replayed in file order. Threads do not wait for
+ * each other, so a call that depended on another thread's mapping can
+ * fail; failures are counted, not fatal. --synth writes a small synthetic
+ * trace in this format to try the tool without a recording.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark8 -t <trace> [--speed recorded]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <getopt.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
+#define TRACE_MAGIC "HTRC"
+#define TRACE_VERSION 1
+#define MAX_THREADS 64
+#define MAX_NODES 64
+#define SYNTH_THREADS 4
+#define SYNTH_ROUNDS 2000
+#define SYNTH_SLOTS 8
+#define SYNTH_SLOT_SIZE (2UL << 20)  /* largest synthetic mapping */
+#define SYNTH_STEP_NS 20000           /* 20us between a thread's calls */
+
+typedef enum {
+    TRACE_MMAP,
+    TRACE_MUNMAP,
+    TRACE_MPROTECT,
+    TRACE_MADVISE,
+    TRACE_OPS
+} trace_op_t;
+
+enum { LAT_TOUCH = TRACE_OPS };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t span;
+} __attribute__((packed)) trace_header_t;
+
+typedef struct {
+    uint64_t ts_ns;
+    uint32_t thread;
+    uint8_t op;
+    uint8_t prot;
+    uint16_t pad;
+    uint64_t offset;
+    uint64_t len;
+} __attribute__((packed)) trace_rec_t;
+
+/* Replay state of one traced thread, next to its worker_data_t */
+typedef struct {
+    uint32_t tid;
+    trace_rec_t *recs;
+    size_t nrecs;
+    uint64_t busy_ns;
+    uint64_t end_ns;
+    uint64_t max_lag_ns;
+    uint64_t failed[TRACE_OPS];
+} replay_thread_t;
+
+static int num_nodes;
+static int num_threads;
+static replay_thread_t threads[MAX_THREADS];
+static trace_rec_t *trace;
+static size_t trace_len;
+static uint64_t trace_span;
+static uint64_t trace_t0;
+static uint64_t trace_ns;
+static char *arena;
+static double speed;  /* 0 replays as fast as possible */
+static int loops = 1;
+static int touch = 1;
+static start_barrier_t barrier;
+
+static const char *const op_names[TRACE_OPS] = {
+    [TRACE_MMAP]     = "mmap",
+    [TRACE_MUNMAP]   = "munmap",
+    [TRACE_MPROTECT] = "mprotect",
+    [TRACE_MADVISE]  = "madvise",
+};
+
+static const char *const lat_names[LAT_SLOTS] = {
+    [TRACE_MMAP]     = "mmap",
+    [TRACE_MUNMAP]   = "munmap",
+    [TRACE_MPROTECT] = "mprotect",
+    [TRACE_MADVISE]  = "madvise",
+    [LAT_TOUCH]      = "touch",
+};
+
+/* xorshift64, fixed seed so --synth always writes the same trace */
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int put_rec(FILE *f, uint64_t ts, uint32_t thread, trace_op_t op, int prot,
+                   uint64_t offset, uint64_t len) {
+    trace_rec_t r = {
+        .ts_ns = ts, .thread = thread, .op = op, .prot = (uint8_t)prot,
+        .offset = offset, .len = len,
+    };
+
+    return fwrite(&r, sizeof(r), 1, f) == 1 ? 0 : -1;
+}
+
+/*
+ * Allocator-like churn: each thread cycles through its own slots, mapping
+ * a chunk, write-protecting and re-enabling it, dropping its pages and
+ * finally unmapping it, with sizes from 64KB to 2MB.
+ */
+static int write_synth(const char *path) {
+    trace_header_t h = { .version = TRACE_VERSION,
+                         .span = SYNTH_THREADS * SYNTH_SLOTS * SYNTH_SLOT_SIZE };
+    FILE *f = fopen(path, "wb");
+    int err = 0;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    err |= fwrite(&h, sizeof(h), 1, f) == 1 ? 0 : -1;
+
+    for (uint32_t t = 0; t < SYNTH_THREADS; t++) {
+        uint64_t ts = t * (SYNTH_STEP_NS / SYNTH_THREADS);
+
+        for (int i = 0; i < SYNTH_ROUNDS && !err; i++) {
+            uint64_t off = (t * SYNTH_SLOTS + i % SYNTH_SLOTS) * SYNTH_SLOT_SIZE;
+            uint64_t len = (64UL << 10) << (rng_next() % 6);
+
+            err |= put_rec(f, ts, t, TRACE_MMAP, PROT_READ | PROT_WRITE, off, len);
+            err |= put_rec(f, ts += SYNTH_STEP_NS, t, TRACE_MPROTECT, PROT_READ, off, len);
+            err |= put_rec(f, ts += SYNTH_STEP_NS, t, TRACE_MPROTECT,
+                           PROT_READ | PROT_WRITE, off, len);
+            err |= put_rec(f, ts += SYNTH_STEP_NS, t, TRACE_MADVISE, MADV_DONTNEED, off, len);
+            err |= put_rec(f, ts += SYNTH_STEP_NS, t, TRACE_MUNMAP, 0, off, len);
+            ts += SYNTH_STEP_NS;
+        }
+    }
+
+    if (fclose(f) != 0)
+        err = -1;
+    if (err) {
+        fprintf(stderr, "Error writing %s\n", path);
+        return -1;
+    }
+    printf("Wrote %d threads x %d calls to %s\n", SYNTH_THREADS, SYNTH_ROUNDS * 5, path);
+    return 0;
+}
+
+/* Read and validate the whole trace; returns 0 or -1 with a message */
+static int load_trace(const char *path) {
+    size_t page = region_page_size();
+    trace_header_t h;
+    struct stat st;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fileno(f), &st) != 0 || fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0 || h.version != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    trace_span = align_up(h.span, page);
+    trace_len = ((size_t)st.st_size - sizeof(h)) / sizeof(trace_rec_t);
+    trace = malloc(trace_len * sizeof(*trace) + 1);
+    if (!trace || fread(trace, sizeof(*trace), trace_len, f) != trace_len) {
+        fprintf(stderr, "%s: short read\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    if (trace_len == 0) {
+        fprintf(stderr, "%s: no records\n", path);
+        return -1;
+    }
+
+    trace_t0 = UINT64_MAX;
+    for (size_t i = 0; i < trace_len; i++) {
+        const trace_rec_t *r = &trace[i];
+
+        if (r->op >= TRACE_OPS || r->len == 0 || r->offset > trace_span ||
+            r->len > trace_span - r->offset) {
+            fprintf(stderr, "%s: record %zu is malformed or outside the span\n", path, i);
+            return -1;
+        }
+        if (r->offset % page || (r->op != TRACE_MADVISE && r->len % page)) {
+            fprintf(stderr, "%s: record %zu is not aligned to %s pages\n",
+                    path, i, page_mode_name());
+            return -1;
+        }
+        if (r->ts_ns < trace_t0)
+            trace_t0 = r->ts_ns;
+        if (r->ts_ns > trace_ns)
+            trace_ns = r->ts_ns;
+    }
+    trace_ns -= trace_t0;
+    return 0;
+}
+
+static replay_thread_t *thread_for(uint32_t tid) {
+    for (int i = 0; i < num_threads; i++) {
+        if (threads[i].tid == tid)
+            return &threads[i];
+    }
+    if (num_threads == MAX_THREADS)
+        return NULL;
+    threads[num_threads].tid = tid;
+    return &threads[num_threads++];
+}
+
+/* Split the trace by thread, keeping each thread's records in file order */
+static int split_threads(void) {
+    trace_rec_t *sorted = malloc(trace_len * sizeof(*sorted));
+    size_t pos = 0;
+
+    if (!sorted) {
+        perror("malloc");
+        return -1;
+    }
+    for (size_t i = 0; i < trace_len; i++) {
+        replay_thread_t *t = thread_for(trace[i].thread);
+
+        if (!t) {
+            fprintf(stderr, "Trace has more than %d threads\n", MAX_THREADS);
+            free(sorted);
+            return -1;
+        }
+        t->nrecs++;
+    }
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].recs = sorted + pos;
+        pos += threads[i].nrecs;
+        threads[i].nrecs = 0;
+    }
+    for (size_t i = 0; i < trace_len; i++) {
+        replay_thread_t *t = thread_for(trace[i].thread);
+
+        t->recs[t->nrecs++] = trace[i];
+    }
+    free(trace);
+    trace = sorted;
+    return 0;
+}
+
+/* Write one byte per page of a fresh writable mapping */
+static void touch_range(worker_data_t *data, char *addr, size_t len) {
+    size_t page = region_page_size();
+    uint64_t t0 = now_ns();
+
+    for (size_t off = 0; off < len; off += page) {
+        ((volatile char *)addr)[off] = 0xAB;
+    }
+    hist_record(&data->lat[LAT_TOUCH], now_ns() - t0);
+}
+
+static int replay_call(worker_data_t *data, replay_thread_t *t, const trace_rec_t *r) {
+    char *addr = arena + r->offset;
+    uint64_t t0 = now_ns(), t1;
+    int ret = 0;
+
+    switch (r->op) {
+    case TRACE_MMAP:
+        if (mmap(addr, r->len, r->prot, region_mmap_flags() | MAP_FIXED, -1, 0) == MAP_FAILED)
+            ret = -1;
+        t1 = now_ns();
+        if (ret == 0 && page_mode() == PAGE_THP)
+            madvise(addr, r->len, MADV_HUGEPAGE);
+        break;
+    case TRACE_MUNMAP:
+        ret = munmap(addr, r->len);
+        t1 = now_ns();
+        /* Reserve the hole again so nothing else is placed inside the arena */
+        mmap(addr, r->len, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        break;
+    case TRACE_MPROTECT:
+        ret = mprotect(addr, r->len, r->prot);
+        t1 = now_ns();
+        break;
+    default:
+        ret = madvise(addr, r->len, r->prot);
+        t1 = now_ns();
+        break;
+    }
+
+    hist_record(&data->lat[r->op], t1 - t0);
+    t->busy_ns += t1 - t0;
+    if (ret != 0) {
+        t->failed[r->op]++;
+        return ret;
+    }
+    if (touch && r->op == TRACE_MMAP && (r->prot & PROT_WRITE))
+        touch_range(data, addr, r->len);
+    return 0;
+}
+
+static void *worker(void *arg) {
+    worker_data_t *data = (worker_data_t *)arg;
+    replay_thread_t *t = &threads[data->id];
+    uint64_t start;
+
+    pin_to_cpu(data->cpu);
+    barrier_arrive_and_wait(data->barrier);
+    start = data->barrier->release_ns;
+
+    perf_thread_start(&data->perf);
+    for (int loop = 0; loop < loops; loop++) {
+        uint64_t base = loop * (trace_ns + 1);
+
+        for (size_t i = 0; i < t->nrecs; i++) {
+            const trace_rec_t *r = &t->recs[i];
+
+            if (speed > 0) {
+                uint64_t due = start + (uint64_t)((r->ts_ns - trace_t0 + base) / speed);
+                uint64_t now = now_ns();
+
+                while (now < due) {
+                    cpu_relax();
+                    now = now_ns();
+                }
+                if (now - due > t->max_lag_ns)
+                    t->max_lag_ns = now - due;
+            }
+            replay_call(data, t, r);
+            data->ops++;
+        }
+    }
+    t->end_ns = now_ns();
+    perf_thread_stop(&data->perf);
+
+    data->elapsed_sec = (t->end_ns - start) / 1e9;
+    return NULL;
+}
+
+/*
+ * Replay thread i goes to nodes[i % n] and takes the node's next CPU; a
+ * trace with more threads than a node has CPUs shares them round-robin.
+ */
+static int place_threads(worker_data_t *data, const int *nodes, int n) {
+    for (int i = 0; i < num_threads; i++) {
+        int node = nodes[i % n];
+        int ncpus = node_cpu_count(node);
+        int index = 0;
+
+        for (int j = 0; j < i; j++) {
+            if (nodes[j % n] == node)
+                index++;
+        }
+        if (ncpus < 1) {
+            fprintf(stderr, "Node %d has no CPUs\n", node);
+            return -1;
+        }
+        data[i].id = i;
+        data[i].node = node;
+        data[i].cpu = get_cpu_for_node(node, index % ncpus);
+        data[i].barrier = &barrier;
+    }
+    return 0;
+}
+
+static uint64_t total_failed(const replay_thread_t *t) {
+    uint64_t sum = 0;
+
+    for (int op = 0; op < TRACE_OPS; op++) {
+        sum += t->failed[op];
+    }
+    return sum;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s -t <trace> [-n <nodes>] [-S <speed>] [-l <loops>]\n", prog);
+    fprintf(stderr, "  -t, --trace FILE   Trace to replay (format in the source header)\n");
+    fprintf(stderr, "  -n, --nodes LIST   Nodes the traced threads are placed on, cycled in\n");
+    fprintf(stderr, "                     order of first appearance (default: all nodes with CPUs)\n");
+    fprintf(stderr, "  -S, --speed SPEED  max (as fast as possible), recorded, or a factor\n");
+    fprintf(stderr, "                     of the recorded speed, e.g. 2 (default: max)\n");
+    fprintf(stderr, "  -l, --loops N      Times the trace is replayed (default: 1)\n");
+    fprintf(stderr, "      --no-touch     Do not write the pages of new writable mappings\n");
+    fprintf(stderr, "      --synth FILE   Write a synthetic %d-thread trace to FILE and exit\n",
+            SYNTH_THREADS);
+    fprintf(stderr, "  -h, --help         Show this help\n");
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s -t <trace>\n", prog);
+    harness_print_usage();
+}
+
+static void emit_record(const worker_data_t *data, const char *path, double total_sec,
+                        uint64_t calls, uint64_t failed, uint64_t busy_ns, uint64_t max_lag_ns) {
+    rec_begin("microbenchmark8");
+    rec_object("config");
+    rec_int("nodes", num_nodes);
+    rec_str("trace", path);
+    rec_int("records", (long long)trace_len);
+    rec_int("threads", num_threads);
+    rec_int("span_bytes", (long long)trace_span);
+    rec_double("trace_sec", trace_ns / 1e9);
+    if (speed > 0)
+        rec_double("speed", speed);
+    else
+        rec_str("speed", "max");
+    rec_int("loops", loops);
+    rec_int("touch", touch);
+    rec_str("page_size", page_mode_name());
+    rec_close();
+    rec_object("results");
+    rec_double("total_sec", total_sec);
+    rec_int("calls", (long long)calls);
+    rec_double("calls_per_sec", calls / total_sec);
+    rec_double("us_per_call", calls ? busy_ns / 1e3 / calls : 0);
+    rec_int("failed", (long long)failed);
+    rec_object("failed_by_op");
+    for (int op = 0; op < TRACE_OPS; op++) {
+        uint64_t n = 0;
+
+        for (int i = 0; i < num_threads; i++) {
+            n += threads[i].failed[op];
+        }
+        rec_int(op_names[op], (long long)n);
+    }
+    rec_close();
+    if (speed > 0)
+        rec_double("max_lag_us", max_lag_ns / 1e3);
+    rec_close();
+    rec_workers(data, num_threads);
+    rec_nodes(data, num_threads, num_nodes);
+    rec_start_skew(&barrier);
+    rec_latency(data, num_threads, lat_names);
+    rec_perf(data, num_threads, num_nodes);
+    rec_hydra();
+    rec_end();
+}
+
+int main(int argc, char **argv) {
+    worker_data_t *data;
+    pthread_t *tids;
+    const char *path = NULL;
+    int node_list[MAX_NODES], n_list = 0;
+    uint64_t calls = 0, failed = 0, busy_ns = 0, max_lag_ns = 0, last_end = 0;
+    double total_sec;
+    char *end;
+
+    static struct option long_opts[] = {
+        {"trace", required_argument, 0, 't'},
+        {"nodes", required_argument, 0, 'n'},
+        {"speed", required_argument, 0, 'S'},
+        {"loops", required_argument, 0, 'l'},
+        {"no-touch", no_argument, 0, 'T'},
+        {"synth", required_argument, 0, 'g'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "t:n:S:l:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            path = optarg;
+            break;
+        case 'n':
+            n_list = parse_int_list(optarg, node_list, MAX_NODES);
+            if (n_list < 1) {
+                fprintf(stderr, "Invalid node list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'S':
+            if (strcmp(optarg, "max") == 0) {
+                speed = 0;
+            } else if (strcmp(optarg, "recorded") == 0) {
+                speed = 1;
+            } else {
+                speed = strtod(optarg, &end);
+                if (end == optarg || *end || speed <= 0) {
+                    fprintf(stderr, "Invalid speed: %s\n", optarg);
+                    return 1;
+                }
+            }
+            break;
+        case 'l':
+            loops = atoi(optarg);
+            if (loops < 1) {
+                fprintf(stderr, "Invalid loops: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            touch = 0;
+            break;
+        case 'g':
+            return write_synth(optarg) == 0 ? 0 : 1;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!path) {
+        fprintf(stderr, "No trace given (-t FILE, or --synth FILE to make one)\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    if (num_nodes > MAX_NODES)
+        num_nodes = MAX_NODES;
+    if (n_list == 0) {
+        for (int node = 0; node < num_nodes; node++) {
+            if (topo_cpus(node) > 0)
+                node_list[n_list++] = node;
+        }
+    }
+    for (int i = 0; i < n_list; i++) {
+        if (node_list[i] < 0 || node_list[i] >= num_nodes) {
+            fprintf(stderr, "Node %d out of range (0-%d)\n", node_list[i], num_nodes - 1);
+            return 1;
+        }
+        if (topo_cpus(node_list[i]) == 0) {
+            fprintf(stderr, "Node %d has no CPUs\n", node_list[i]);
+            return 1;
+        }
+    }
+
+    if (load_trace(path) != 0 || split_threads() != 0)
+        return 1;
+
+    arena = mmap(NULL, trace_span, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        perror("mmap arena");
+        return 1;
+    }
+    if (page_mode() != PAGE_4K) {
+        /* Arena start must be aligned for the huge mappings placed in it */
+        size_t page = region_page_size();
+
+        munmap(arena, trace_span);
+        arena = mmap(NULL, trace_span + page, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (arena == MAP_FAILED) {
+            perror("mmap arena");
+            return 1;
+        }
+        arena = (char *)align_up((size_t)arena, page);
+    }
+
+    data = aligned_calloc(num_threads, sizeof(*data));
+    tids = calloc(num_threads, sizeof(*tids));
+    if (!data || !tids) {
+        perror("calloc");
+        return 1;
+    }
+    if (place_threads(data, node_list, n_list) != 0)
+        return 1;
+
+    print_banner("Microbenchmark 8: Memory-Map Trace Replay");
+    printf("NUMA nodes: %d\n", num_nodes);
+    printf("Trace: %s (%zu calls, %d threads, %.3f sec recorded)\n",
+           path, trace_len, num_threads, trace_ns / 1e9);
+    printf("Address span: %lu MB\n", (unsigned long)(trace_span >> 20));
+    if (speed > 0)
+        printf("Speed: %gx recorded\n", speed);
+    else
+        printf("Speed: as fast as possible\n");
+    printf("Loops: %d\n", loops);
+    printf("Touch new writable mappings: %s\n", touch ? "yes" : "no");
+    printf("Page size: %s\n", page_mode_name());
+    printf("Thread placement:");
+    for (int i = 0; i < num_threads; i++) {
+        printf(" %u->%d/cpu%d", threads[i].tid, data[i].node, data[i].cpu);
+    }
+    printf("\n\n");
+
+    for (int i = 0; i < num_threads; i++) {
+        if (pthread_create(&tids[i], NULL, worker, &data[i]) != 0) {
+            perror("pthread_create worker");
+            return 1;
+        }
+    }
+
+    barrier_wait_ready(&barrier, num_threads);
+    printf("Replay threads ready. Starting replay...\n\n");
+
+    hydra_trial_begin();
+    perf_trial_begin();
+    barrier_release(&barrier);
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    perf_trial_end();
+    hydra_trial_end();
+
+    for (int i = 0; i < num_threads; i++) {
+        calls += data[i].ops;
+        failed += total_failed(&threads[i]);
+        busy_ns += threads[i].busy_ns;
+        if (threads[i].max_lag_ns > max_lag_ns)
+            max_lag_ns = threads[i].max_lag_ns;
+        if (threads[i].end_ns > last_end)
+            last_end = threads[i].end_ns;
+    }
+    total_sec = (last_end - barrier.release_ns) / 1e9;
+
+    printf("\n");
+    print_rule();
+    printf("RESULTS (%s, %d threads):\n", path, num_threads);
+    print_rule();
+    printf("Total time: %.3f sec\n", total_sec);
+    printf("Calls replayed: %lu (%.0f calls/sec)\n", (unsigned long)calls, calls / total_sec);
+    printf("Time in calls: %.3f sec (%.2f us/call)\n",
+           busy_ns / 1e9, calls ? busy_ns / 1e3 / calls : 0);
+    printf("Failed calls: %lu", (unsigned long)failed);
+    for (int op = 0; op < TRACE_OPS && failed; op++) {
+        uint64_t n = 0;
+
+        for (int i = 0; i < num_threads; i++) {
+            n += threads[i].failed[op];
+        }
+        if (n)
+            printf(" %s:%lu", op_names[op], (unsigned long)n);
+    }
+    printf("\n");
+    if (speed > 0)
+        printf("Max lag behind the recorded schedule: %.2f us\n", max_lag_ns / 1e3);
+    print_start_skew(&barrier);
+    report_nodes(data, num_threads, num_nodes);
+    report_latency(data, num_threads, lat_names);
+    report_perf(data, num_threads, num_nodes);
+    report_ab_metrics(data, num_threads, lat_names, calls / total_sec,
+                      calls ? busy_ns / 1e3 / calls : 0);
+    ab_report_metric("replay time (sec)", total_sec, 0);
+    hydra_print_delta();
+    print_rule();
+
+    if (report_structured())
+        emit_record(data, path, total_sec, calls, failed, busy_ns, max_lag_ns);
+
+    free(tids);
+    free(data);
+    return 0;
+}
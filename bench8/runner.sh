@@ -0,0 +1,106 @@
+#!/bin/bash
+
+# microbenchmark8_runner.sh - Memory-Map Trace Replay Runner
+#
+# Replays a recorded mmap/mprotect/munmap trace WITHOUT Hydra and WITH
+# Hydra, as fast as possible and at the recorded speed. Without a trace
+# argument a synthetic trace is written first
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark8_runner.sh [trace]
+
+set -e
+
+BENCH="./microbenchmark8"
+HYDRA_HISTORY="/proc/hydra/history"
+TRACE="${1:-synthetic.trace}"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Replay speeds to test
+SPEEDS=(max recorded)
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+if [ ! -f "$TRACE" ]; then
+    $BENCH --synth "$TRACE"
+fi
+
+echo "========================================================"
+echo "Microbenchmark 8: Memory-Map Trace Replay"
+echo "========================================================"
+echo "Trace: $TRACE"
+echo "Speeds: ${SPEEDS[*]}"
+echo "Each test runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for speed in "${SPEEDS[@]}"; do
+    echo ""
+    echo "########################################################"
+    echo "# Testing speed: $speed"
+    echo "########################################################"
+
+    # --- WITHOUT HYDRA ---
+    echo ""
+    echo ">>> WITHOUT HYDRA (baseline Linux):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    $BENCH -t "$TRACE" --speed $speed --perf --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (without Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+
+    # --- WITH HYDRA ---
+    echo ""
+    echo ">>> WITH HYDRA (numactl -r all):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    numactl -r all $BENCH -t "$TRACE" --speed $speed --perf --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (with Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
@@ -0,0 +1,528 @@
+/*
+ * microbenchmark9.c - Cross-Node IPI Latency Matrix
+ *
+ * microbenchmark3 reports what a shootdown costs with spinners on every
+ * other node; this breaks the cost down per link. For every (source,
+ * target) node pair the main thread runs on the source and exactly one
+ * resident thread of the same mm spins on the target, reading the region
+ * so its TLB holds the entries being flushed. The source times the
+ * mprotect RW->RO->RW toggle, whose flushes IPI only the resident, and
+ * membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED), a bare IPI round trip to
+ * the same CPU that needs no page-table work. A run with no resident gives
+ * each source's flush-free baseline.
+ *
+ * The diagonal uses a second CPU of the node. --heatmap writes the N x N
+ * matrices as CSV, so a slow UPI or Infinity Fabric link shows up as a hot
+ * cell against the other pairs of its distance class.
+ *
+ * Compile: ./compileall.sh (from the repository root, links common/)
+ * Run:     numactl -r all ./microbenchmark9 [--heatmap matrix.csv]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/membarrier.h>
+#include <getopt.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "hydra.h"
+#include "report.h"
+
+#define NUM_OPS 5000
+#define DEFAULT_SIZE (64 * 1024)  /* 64KB, 16 PTEs flushed per call */
+#define MAX_NODES 64
+
+enum {
+    LAT_MEMBARRIER = 2
+};
+
+typedef enum {
+    OP_RW_TO_RO,
+    OP_RO_TO_RW,
+    OP_MEMBARRIER,
+    PAIR_OPS
+} pair_op_t;
+
+typedef struct {
+    uint64_t calls;
+    double mean, p50, p99, p999, max;  /* us */
+} lat_stats_t;
+
+/* One cell of the matrix; ok is 0 if a CPU was missing */
+typedef struct {
+    int ok;
+    int src_cpu;
+    int dst_cpu;
+    lat_stats_t op[PAIR_OPS];
+} pair_result_t;
+
+/* The one other thread of the mm during a pair */
+typedef struct {
+    int cpu;
+    char *region;
+    volatile int ready;
+    volatile int stop;
+} resident_t;
+
+static int num_nodes;
+static int nodes[MAX_NODES];
+static int n_nodes;
+static size_t region_size;
+static int have_membarrier;
+static pair_result_t *matrix;  /* n_nodes * n_nodes, by list index */
+static pair_result_t solo[MAX_NODES];
+static volatile char resident_sink;
+
+static const char *const op_keys[PAIR_OPS] = {
+    [OP_RW_TO_RO]   = "mprotect_ro",
+    [OP_RO_TO_RW]   = "mprotect_rw",
+    [OP_MEMBARRIER] = "membarrier",
+};
+
+static pair_result_t *cell(int src, int dst) {
+    return &matrix[src * n_nodes + dst];
+}
+
+static int membarrier(int cmd) {
+    return (int)syscall(__NR_membarrier, cmd, 0, 0);
+}
+
+static void *resident(void *arg) {
+    resident_t *r = (resident_t *)arg;
+    size_t page = region_page_size();
+    char sum = 0;
+
+    pin_to_cpu(r->cpu);
+    for (size_t off = 0; off < region_size; off += page) {
+        sum += r->region[off];
+    }
+    __atomic_store_n(&r->ready, 1, __ATOMIC_RELEASE);
+
+    /* Keep the region's translations hot until the pair is done */
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        for (size_t off = 0; off < region_size; off += page) {
+            sum += ((volatile char *)r->region)[off];
+        }
+        cpu_relax();
+    }
+    resident_sink = sum;
+    return NULL;
+}
+
+static void summarize(const hist_t *h, lat_stats_t *s) {
+    s->calls = h->count;
+    s->mean = hist_mean(h) / 1e3;
+    s->p50 = hist_percentile(h, 50.0) / 1e3;
+    s->p99 = hist_percentile(h, 99.0) / 1e3;
+    s->p999 = hist_percentile(h, 99.9) / 1e3;
+    s->max = h->max / 1e3;
+}
+
+/* Time both operations on the calling thread, already pinned to src_cpu */
+static void measure(worker_data_t *data, pair_result_t *res) {
+    run_budget_t budget = run_budget(NUM_OPS);
+
+    worker_reset_stats(data);
+    run_mprotect_toggle(data, region_size, budget);
+
+    if (have_membarrier) {
+        budget = run_budget(NUM_OPS);
+        for (uint64_t i = 0; run_budget_more(&budget, i); i++) {
+            uint64_t t0 = now_ns();
+            membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED);
+            hist_record(&data->lat[LAT_MEMBARRIER], now_ns() - t0);
+        }
+    }
+
+    summarize(&data->lat[LAT_RW_TO_RO], &res->op[OP_RW_TO_RO]);
+    summarize(&data->lat[LAT_RO_TO_RW], &res->op[OP_RO_TO_RW]);
+    summarize(&data->lat[LAT_MEMBARRIER], &res->op[OP_MEMBARRIER]);
+    res->ok = 1;
+}
+
+static int run_pair(worker_data_t *data, int src, int dst) {
+    pair_result_t *res = cell(src, dst);
+    resident_t r = { .region = data->region };
+    pthread_t thread;
+
+    res->src_cpu = data->cpu;
+    res->dst_cpu = get_cpu_for_node(nodes[dst], src == dst ? 1 : 0);
+    if (res->dst_cpu < 0)
+        return 0;
+
+    r.cpu = res->dst_cpu;
+    if (pthread_create(&thread, NULL, resident, &r) != 0) {
+        perror("pthread_create resident");
+        return -1;
+    }
+    while (!__atomic_load_n(&r.ready, __ATOMIC_ACQUIRE)) {
+        cpu_relax();
+    }
+
+    measure(data, res);
+
+    __atomic_store_n(&r.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    return 0;
+}
+
+/* One matrix row: the region is faulted in from the source node */
+static int run_source(worker_data_t *data, int src) {
+    data->node = nodes[src];
+    data->cpu = get_cpu_for_node(nodes[src], 0);
+    if (pin_to_cpu(data->cpu) < 0)
+        return -1;
+    data->region = region_alloc(region_size);
+    if (!data->region)
+        return -1;
+
+    solo[src].src_cpu = data->cpu;
+    solo[src].dst_cpu = -1;
+    measure(data, &solo[src]);
+
+    for (int dst = 0; dst < n_nodes; dst++) {
+        if (run_pair(data, src, dst) != 0)
+            return -1;
+    }
+    region_free(data->region, region_size);
+    return 0;
+}
+
+static void print_matrix(const char *title, pair_op_t op, int p99) {
+    printf("%s:\n", title);
+    printf("  %-8s %8s", "src\\dst", "solo");
+    for (int dst = 0; dst < n_nodes; dst++) {
+        printf(" %8d", nodes[dst]);
+    }
+    printf("\n");
+    for (int src = 0; src < n_nodes; src++) {
+        const lat_stats_t *s = &solo[src].op[op];
+
+        printf("  %-8d %8.2f", nodes[src], p99 ? s->p99 : s->p50);
+        for (int dst = 0; dst < n_nodes; dst++) {
+            const pair_result_t *c = cell(src, dst);
+
+            if (!c->ok)
+                printf(" %8s", "-");
+            else
+                printf(" %8.2f", p99 ? c->op[op].p99 : c->op[op].p50);
+        }
+        printf("\n");
+    }
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Pair whose RW->RO p99 is furthest above the median p99 of its distance
+ * class; returns the ratio, *worst gets the cell index or -1.
+ */
+static double worst_link(int *worst) {
+    double *vals = malloc(n_nodes * n_nodes * sizeof(double));
+    double median[DIST_CLASSES] = {0};
+    double best = 0;
+
+    *worst = -1;
+    if (!vals)
+        return 0;
+    for (int c = 0; c < DIST_CLASSES; c++) {
+        int n = 0;
+
+        for (int i = 0; i < n_nodes * n_nodes; i++) {
+            if (matrix[i].ok &&
+                topo_class(nodes[i / n_nodes], nodes[i % n_nodes]) == (dist_class_t)c)
+                vals[n++] = matrix[i].op[OP_RW_TO_RO].p99;
+        }
+        if (n == 0)
+            continue;
+        qsort(vals, n, sizeof(double), cmp_double);
+        median[c] = vals[n / 2];
+    }
+    for (int i = 0; i < n_nodes * n_nodes; i++) {
+        dist_class_t c;
+
+        if (!matrix[i].ok)
+            continue;
+        c = topo_class(nodes[i / n_nodes], nodes[i % n_nodes]);
+        if (median[c] > 0 && matrix[i].op[OP_RW_TO_RO].p99 / median[c] > best) {
+            best = matrix[i].op[OP_RW_TO_RO].p99 / median[c];
+            *worst = i;
+        }
+    }
+    free(vals);
+    return best;
+}
+
+/* Mean over the off-diagonal pairs of one op's p50 */
+static double remote_mean(pair_op_t op) {
+    double sum = 0;
+    int n = 0;
+
+    for (int src = 0; src < n_nodes; src++) {
+        for (int dst = 0; dst < n_nodes; dst++) {
+            if (src == dst || !cell(src, dst)->ok)
+                continue;
+            sum += cell(src, dst)->op[op].p50;
+            n++;
+        }
+    }
+    return n ? sum / n : 0;
+}
+
+/* One row per (metric, source): metric,src,<one column per target node> */
+static int write_heatmap(const char *path) {
+    static const char *const stats[] = { "p50", "p99", "p999" };
+    FILE *f = fopen(path, "w");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "metric,src,solo");
+    for (int dst = 0; dst < n_nodes; dst++) {
+        fprintf(f, ",%d", nodes[dst]);
+    }
+    fprintf(f, "\n");
+    for (int op = 0; op < PAIR_OPS; op++) {
+        if (op == OP_MEMBARRIER && !have_membarrier)
+            continue;
+        for (int st = 0; st < 3; st++) {
+            for (int src = 0; src < n_nodes; src++) {
+                const lat_stats_t *s = &solo[src].op[op];
+
+                fprintf(f, "%s_%s_us,%d,%.3f", op_keys[op], stats[st], nodes[src],
+                        st == 0 ? s->p50 : st == 1 ? s->p99 : s->p999);
+                for (int dst = 0; dst < n_nodes; dst++) {
+                    const pair_result_t *c = cell(src, dst);
+
+                    s = &c->op[op];
+                    if (!c->ok)
+                        fprintf(f, ",");
+                    else
+                        fprintf(f, ",%.3f", st == 0 ? s->p50 : st == 1 ? s->p99 : s->p999);
+                }
+                fprintf(f, "\n");
+            }
+        }
+    }
+    if (fclose(f) != 0) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n <nodes>] [-s <size>] [--heatmap FILE]\n", prog);
+    fprintf(stderr, "  -n, --nodes LIST   Nodes of the matrix (default: all nodes with CPUs)\n");
+    fprintf(stderr, "  -s, --size SIZE    Region toggled by mprotect (default: 64k)\n");
+    fprintf(stderr, "      --heatmap FILE Write the N x N p50/p99/p99.9 matrices as CSV\n");
+    fprintf(stderr, "  -h, --help         Show this help\n");
+    fprintf(stderr, "\n--ops counts mprotect pairs and membarrier calls per matrix cell (default: %d).\n",
+            NUM_OPS);
+    fprintf(stderr, "\nRun with Hydra: numactl -r all %s\n", prog);
+    harness_print_usage();
+}
+
+static void rec_stats(const char *key, const lat_stats_t *s) {
+    rec_object(key);
+    rec_int("calls", (long long)s->calls);
+    rec_double("mean", s->mean);
+    rec_double("p50", s->p50);
+    rec_double("p99", s->p99);
+    rec_double("p999", s->p999);
+    rec_double("max", s->max);
+    rec_close();
+}
+
+static void rec_pair(const pair_result_t *c, int src, int dst) {
+    rec_object(NULL);
+    rec_int("src", nodes[src]);
+    if (dst >= 0) {
+        rec_int("dst", nodes[dst]);
+        rec_int("distance", topo_distance(nodes[src], nodes[dst]));
+        rec_str("class", dist_class_name(topo_class(nodes[src], nodes[dst])));
+    }
+    rec_int("src_cpu", c->src_cpu);
+    rec_int("dst_cpu", c->dst_cpu);
+    for (int op = 0; op < PAIR_OPS; op++) {
+        if (op != OP_MEMBARRIER || have_membarrier)
+            rec_stats(op_keys[op], &c->op[op]);
+    }
+    rec_close();
+}
+
+static void emit_record(void) {
+    rec_begin("microbenchmark9");
+    rec_object("config");
+    rec_int("nodes", n_nodes);
+    rec_int("region_bytes", (long long)region_size);
+    rec_str("page_size", page_mode_name());
+    rec_int("ops_per_cell", (long long)run_ops(NUM_OPS));
+    rec_run_budget(NUM_OPS);
+    rec_int("membarrier", have_membarrier);
+    rec_close();
+    rec_topology();
+    rec_array("solo");
+    for (int src = 0; src < n_nodes; src++) {
+        rec_pair(&solo[src], src, -1);
+    }
+    rec_close();
+    rec_array("pairs");
+    for (int src = 0; src < n_nodes; src++) {
+        for (int dst = 0; dst < n_nodes; dst++) {
+            if (cell(src, dst)->ok)
+                rec_pair(cell(src, dst), src, dst);
+        }
+    }
+    rec_close();
+    rec_hydra();
+    rec_end();
+}
+
+int main(int argc, char **argv) {
+    worker_data_t *data;
+    const char *heatmap = NULL;
+    size_t size = DEFAULT_SIZE;
+    double ratio;
+    int worst;
+
+    static struct option long_opts[] = {
+        {"nodes", required_argument, 0, 'n'},
+        {"size", required_argument, 0, 's'},
+        {"heatmap", required_argument, 0, 'H'},
+        {"help", no_argument, 0, 'h'},
+        HARNESS_LONG_OPTS,
+        {0, 0, 0, 0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:s:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            n_nodes = parse_int_list(optarg, nodes, MAX_NODES);
+            if (n_nodes < 1) {
+                fprintf(stderr, "Invalid node list: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 's':
+            size = parse_size(optarg);
+            if (size == 0) {
+                fprintf(stderr, "Invalid size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'H':
+            heatmap = optarg;
+            break;
+        case 'h':
+            print_usage(argv[0]);
+            return 0;
+        default:
+            if (harness_parse_opt(opt, optarg) == 0)
+                break;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (ab_active())
+        return ab_run(argv);
+
+    num_nodes = harness_init();
+    if (num_nodes < 0)
+        return 1;
+    if (n_nodes == 0) {
+        for (int node = 0; node < num_nodes && n_nodes < MAX_NODES; node++) {
+            if (topo_cpus(node) > 0)
+                nodes[n_nodes++] = node;
+        }
+    }
+    for (int i = 0; i < n_nodes; i++) {
+        if (nodes[i] < 0 || nodes[i] >= num_nodes || topo_cpus(nodes[i]) == 0) {
+            fprintf(stderr, "Node %d out of range or without CPUs\n", nodes[i]);
+            return 1;
+        }
+    }
+    region_size = region_round(size);
+    have_membarrier = membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED) == 0;
+
+    print_banner("Microbenchmark 9: Cross-Node IPI Latency Matrix");
+    printf("NUMA nodes: %d\n", num_nodes);
+    print_topology();
+    printf("Matrix nodes:");
+    for (int i = 0; i < n_nodes; i++) {
+        printf(" %d", nodes[i]);
+    }
+    printf("\n");
+    printf("Region size: %zu KB\n", region_size / 1024);
+    print_page_layout(region_size);
+    print_run_budget("Calls per op and cell", NUM_OPS);
+    printf("membarrier baseline: %s\n",
+           have_membarrier ? "MEMBARRIER_CMD_PRIVATE_EXPEDITED" : "n/a (not supported)");
+    printf("\n");
+
+    data = aligned_calloc(1, sizeof(*data));
+    matrix = calloc(n_nodes * n_nodes, sizeof(*matrix));
+    if (!data || !matrix) {
+        perror("calloc");
+        return 1;
+    }
+
+    hydra_trial_begin();
+    for (int src = 0; src < n_nodes; src++) {
+        printf("Source node %d...\n", nodes[src]);
+        if (run_source(data, src) != 0)
+            return 1;
+    }
+    hydra_trial_end();
+
+    printf("\n");
+    print_rule();
+    printf("RESULTS (us per call, solo = no resident thread):\n");
+    print_rule();
+    print_matrix("mprotect RW->RO p50", OP_RW_TO_RO, 0);
+    print_matrix("mprotect RW->RO p99", OP_RW_TO_RO, 1);
+    print_matrix("mprotect RO->RW p50", OP_RO_TO_RW, 0);
+    if (have_membarrier) {
+        print_matrix("membarrier p50", OP_MEMBARRIER, 0);
+        print_matrix("membarrier p99", OP_MEMBARRIER, 1);
+    }
+
+    ratio = worst_link(&worst);
+    if (worst >= 0 && n_nodes > 1) {
+        int src = worst / n_nodes, dst = worst % n_nodes;
+
+        printf("Worst link: %d->%d, RW->RO p99 %.2f us, %.2fx the median of %s pairs\n",
+               nodes[src], nodes[dst], matrix[worst].op[OP_RW_TO_RO].p99, ratio,
+               dist_class_name(topo_class(nodes[src], nodes[dst])));
+    }
+    ab_report_metric("remote RW->RO p50 (us)", remote_mean(OP_RW_TO_RO), 0);
+    if (have_membarrier)
+        ab_report_metric("remote membarrier p50 (us)", remote_mean(OP_MEMBARRIER), 0);
+    hydra_print_delta();
+    print_rule();
+
+    if (heatmap && write_heatmap(heatmap) == 0)
+        printf("Heatmap written to %s\n", heatmap);
+
+    if (report_structured())
+        emit_record();
+
+    free(matrix);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# microbenchmark9_runner.sh - Cross-Node IPI Latency Matrix Runner
+#
+# Measures the mprotect flush and membarrier cost for every (source,
+# target) node pair WITHOUT Hydra and WITH Hydra, and keeps one CSV
+# heatmap per run next to the script
+#
+# Compile benchmark first:
+#   make   (from the repository root; debug and sanitize builds in the Makefile)
+#
+# Run as root: sudo ./microbenchmark9_runner.sh
+
+set -e
+
+BENCH="./microbenchmark9"
+HYDRA_HISTORY="/proc/hydra/history"
+
+# FORMAT=json or FORMAT=csv: stdout carries one record per run (with the
+# Hydra IPI delta), everything else goes to stderr
+FORMAT="${FORMAT:-text}"
+exec 3>&1
+if [ "$FORMAT" != "text" ]; then
+    exec 1>&2
+fi
+
+# Page sizes to test
+PAGESIZES=(4k thp)
+
+# Check prerequisites
+if [ ! -x "$BENCH" ]; then
+    echo "Error: $BENCH not found or not executable"
+    echo "Compile with: make (from the repository root)"
+    exit 1
+fi
+
+if [ ! -f "$HYDRA_HISTORY" ]; then
+    echo "Error: $HYDRA_HISTORY not found - Hydra kernel required"
+    exit 1
+fi
+
+echo "========================================================"
+echo "Microbenchmark 9: Cross-Node IPI Latency Matrix"
+echo "========================================================"
+echo "Page sizes: ${PAGESIZES[*]}"
+echo "Each test runs WITHOUT Hydra, then WITH Hydra"
+echo "========================================================"
+echo ""
+
+for pagesize in "${PAGESIZES[@]}"; do
+    echo ""
+    echo "########################################################"
+    echo "# Testing pages: $pagesize"
+    echo "########################################################"
+
+    # --- WITHOUT HYDRA ---
+    echo ""
+    echo ">>> WITHOUT HYDRA (baseline Linux):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    $BENCH --pagesize $pagesize --heatmap "matrix_${pagesize}_linux.csv" --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (without Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+
+    # --- WITH HYDRA ---
+    echo ""
+    echo ">>> WITH HYDRA (numactl -r all):"
+    echo ""
+
+    sync
+    echo 3 > /proc/sys/vm/drop_caches 2>/dev/null || true
+    echo -1 > "$HYDRA_HISTORY"
+    sleep 0.5
+
+    numactl -r all $BENCH --pagesize $pagesize --heatmap "matrix_${pagesize}_hydra.csv" --format=$FORMAT >&3
+
+    echo ""
+    echo "Hydra IPI Statistics (with Hydra):"
+    echo "----------------------------------------"
+    cat "$HYDRA_HISTORY"
+    echo "----------------------------------------"
+
+    sleep 1
+done
+
+echo ""
+echo "========================================================"
+echo "All tests completed"
+echo "========================================================"
@@ -0,0 +1,344 @@
+/*
+ * ab.c - Interleaved Hydra-off / Hydra-on comparison
+ *
+ * See ab.h for the protocol. Children find the result pipe through the
+ * HYDRA_AB_FD environment variable and write one "name\tvalue\thib" line
+ * per metric.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/wait.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "report.h"
+#include "stats.h"
+#include "store.h"
+
+#define AB_ENV "HYDRA_AB_FD"
+#define AB_MAX_ARGS 32
+#define AB_RESAMPLES 10000
+#define AB_ALPHA 0.05
+
+static int ab_trials;
+static const char *ab_cmd[2] = { "", "numactl -r all" };
+static const char *const arm_name[2] = { "hydra-off", "hydra-on" };
+
+typedef struct {
+    char name[96];
+    int higher_is_better;
+    double *val[2];
+    int n[2];
+} ab_metric_t;
+
+static ab_metric_t *metrics;
+static int num_metrics, metrics_cap;
+static int metrics_dropped;
+static char metric_tag[32];
+
+int ab_active(void) {
+    return ab_trials > 0 && getenv(AB_ENV) == NULL;
+}
+
+int ab_child(void) {
+    return getenv(AB_ENV) != NULL;
+}
+
+void ab_set_tag(const char *tag) {
+    snprintf(metric_tag, sizeof(metric_tag), "%s", tag ? tag : "");
+}
+
+void ab_report_metric(const char *name, double value, int higher_is_better) {
+    const char *env = getenv(AB_ENV);
+    char full[96];
+
+    if (metric_tag[0])
+        snprintf(full, sizeof(full), "%s [%s]", name, metric_tag);
+    else
+        snprintf(full, sizeof(full), "%s", name);
+    store_metric(full, value, higher_is_better);
+
+    if (env)
+        dprintf(atoi(env), "%s\t%.17g\t%d\n", full, value, higher_is_better);
+}
+
+int ab_parse_opt(int opt, const char *arg) {
+    switch (opt) {
+    case OPT_AB:
+        ab_trials = atoi(arg);
+        if (ab_trials < 2) {
+            fprintf(stderr, "--ab needs at least 2 trials per arm\n");
+            return -1;
+        }
+        return 0;
+    case OPT_AB_CMD:
+        ab_cmd[1] = arg;
+        return 0;
+    case OPT_AB_BASE_CMD:
+        ab_cmd[0] = arg;
+        return 0;
+    }
+    return -1;
+}
+
+void ab_print_usage(void) {
+    fprintf(stderr, "  --ab N              Interleave N Hydra-off and N Hydra-on runs and compare\n");
+    fprintf(stderr, "  --ab-cmd CMD        Prefix for Hydra-on runs (default: \"numactl -r all\")\n");
+    fprintf(stderr, "  --ab-base-cmd CMD   Prefix for Hydra-off runs (default: none)\n");
+}
+
+static ab_metric_t *find_metric(const char *name, int higher_is_better) {
+    for (int i = 0; i < num_metrics; i++) {
+        if (strcmp(metrics[i].name, name) == 0)
+            return &metrics[i];
+    }
+    if (num_metrics == metrics_cap) {
+        int cap = metrics_cap ? metrics_cap * 2 : 64;
+        ab_metric_t *p = realloc(metrics, cap * sizeof(*p));
+
+        if (!p)
+            return NULL;
+        metrics = p;
+        metrics_cap = cap;
+    }
+
+    ab_metric_t *m = &metrics[num_metrics];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->higher_is_better = higher_is_better;
+    m->val[0] = calloc(ab_trials, sizeof(double));
+    m->val[1] = calloc(ab_trials, sizeof(double));
+    m->n[0] = m->n[1] = 0;
+    if (!m->val[0] || !m->val[1]) {
+        free(m->val[0]);
+        free(m->val[1]);
+        return NULL;
+    }
+    num_metrics++;
+    return m;
+}
+
+/* Read fd to EOF into a NUL-terminated buffer, NULL when out of memory */
+static char *read_all(int fd) {
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap);
+    ssize_t r;
+
+    if (!buf)
+        return NULL;
+    while ((r = read(fd, buf + len, cap - 1 - len)) > 0) {
+        len += r;
+        if (len == cap - 1) {
+            char *p = realloc(buf, cap * 2);
+
+            if (!p) {
+                free(buf);
+                return NULL;
+            }
+            buf = p;
+            cap *= 2;
+        }
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+/* Split cmd on whitespace into args, returns the number of words */
+static int split_cmd(char *cmd, char **args, int max) {
+    int n = 0;
+
+    for (char *tok = strtok(cmd, " \t"); tok && n < max; tok = strtok(NULL, " \t")) {
+        args[n++] = tok;
+    }
+    return n;
+}
+
+static int run_trial(int arm, char **argv, const char *exe) {
+    char *buf, fdstr[16];
+    char *cmd = strdup(ab_cmd[arm]);
+    char *args[AB_MAX_ARGS + 1];
+    int fds[2], status, nargs;
+    pid_t pid;
+
+    nargs = split_cmd(cmd, args, AB_MAX_ARGS / 2);
+    args[nargs++] = (char *)exe;
+    for (int i = 1; argv[i] && nargs < AB_MAX_ARGS; i++) {
+        args[nargs++] = argv[i];
+    }
+    args[nargs] = NULL;
+
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        free(cmd);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        free(cmd);
+        return -1;
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+
+        close(fds[0]);
+        snprintf(fdstr, sizeof(fdstr), "%d", fds[1]);
+        setenv(AB_ENV, fdstr, 1);
+        if (devnull >= 0)
+            dup2(devnull, STDOUT_FILENO);
+        execvp(args[0], args);
+        perror(args[0]);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    buf = read_all(fds[0]);
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    free(cmd);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "A/B trial (%s) failed\n", arm_name[arm]);
+        free(buf);
+        return -1;
+    }
+    if (!buf) {
+        fprintf(stderr, "A/B trial (%s): out of memory reading its metrics\n", arm_name[arm]);
+        return -1;
+    }
+
+    for (char *line = strtok(buf, "\n"); line; line = strtok(NULL, "\n")) {
+        char *tab1 = strchr(line, '\t');
+        char *tab2 = tab1 ? strchr(tab1 + 1, '\t') : NULL;
+        ab_metric_t *m;
+
+        if (!tab2)
+            continue;
+        *tab1 = '\0';
+        m = find_metric(line, atoi(tab2 + 1));
+        if (m && m->n[arm] < ab_trials)
+            m->val[arm][m->n[arm]++] = atof(tab1 + 1);
+        else
+            metrics_dropped++;
+    }
+    free(buf);
+
+    if (num_metrics > 0 && metrics[0].n[arm] > 0)
+        printf("  %-9s  %s = %.4g\n", arm_name[arm], metrics[0].name,
+               metrics[0].val[arm][metrics[0].n[arm] - 1]);
+    return 0;
+}
+
+static void print_metric(const ab_metric_t *m) {
+    const double *off = m->val[0], *on = m->val[1];
+    int n_off = m->n[0], n_on = m->n[1];
+    double lo, hi, u, p, speedup;
+    int structured = report_structured();
+
+    printf("\n%s (%s is better):\n", m->name, m->higher_is_better ? "higher" : "lower");
+    for (int arm = 0; arm < 2; arm++) {
+        printf("  %-9s  n=%-3d mean %.4g  sd %.3g  median %.4g\n", arm_name[arm],
+               m->n[arm], stats_mean(m->val[arm], m->n[arm]),
+               stats_stddev(m->val[arm], m->n[arm]),
+               stats_median(m->val[arm], m->n[arm]));
+    }
+
+    /* Speedup > 1 always means Hydra-on is better */
+    if (m->higher_is_better) {
+        speedup = stats_mean(on, n_on) / stats_mean(off, n_off);
+        stats_bootstrap_ratio(off, n_off, on, n_on, 1 - AB_ALPHA, AB_RESAMPLES, &lo, &hi);
+    } else {
+        speedup = stats_mean(off, n_off) / stats_mean(on, n_on);
+        stats_bootstrap_ratio(on, n_on, off, n_off, 1 - AB_ALPHA, AB_RESAMPLES, &lo, &hi);
+    }
+    p = stats_mann_whitney(off, n_off, on, n_on, &u);
+
+    printf("  Speedup: %.3fx  (%.0f%% CI %.3fx - %.3fx, bootstrap)\n",
+           speedup, (1 - AB_ALPHA) * 100, lo, hi);
+    printf("  Mann-Whitney U = %.1f, p = %.4g -> %s\n", u, p,
+           p < AB_ALPHA ? "significant" : "not significant (noise)");
+
+    if (structured) {
+        rec_object(NULL);
+        rec_str("metric", m->name);
+        rec_int("higher_is_better", m->higher_is_better);
+        rec_double("off_mean", stats_mean(off, n_off));
+        rec_double("on_mean", stats_mean(on, n_on));
+        rec_double("off_median", stats_median(off, n_off));
+        rec_double("on_median", stats_median(on, n_on));
+        rec_double("speedup", speedup);
+        rec_double("ci_lo", lo);
+        rec_double("ci_hi", hi);
+        rec_double("mann_whitney_u", u);
+        rec_double("p_value", p);
+        rec_int("significant", p < AB_ALPHA);
+        rec_close();
+    }
+}
+
+int ab_run(char **argv) {
+    char exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+
+    if (len < 0) {
+        perror("readlink /proc/self/exe");
+        return 1;
+    }
+    exe[len] = '\0';
+
+    print_banner("A/B comparison: Hydra-off vs Hydra-on");
+    printf("Binary: %s\n", exe);
+    printf("Trials per arm: %d (ABBA interleaved)\n", ab_trials);
+    printf("Hydra-off prefix: %s\n", ab_cmd[0][0] ? ab_cmd[0] : "(none)");
+    printf("Hydra-on prefix: %s\n", ab_cmd[1][0] ? ab_cmd[1] : "(none)");
+    printf("\n");
+    fflush(stdout);
+
+    for (int i = 0; i < ab_trials; i++) {
+        int first = i & 1;
+
+        printf("Trial %d:\n", i + 1);
+        if (run_trial(first, argv, exe) != 0 || run_trial(!first, argv, exe) != 0)
+            return 1;
+        fflush(stdout);
+    }
+
+    if (num_metrics == 0) {
+        fprintf(stderr, "No metrics reported by the benchmark\n");
+        return 1;
+    }
+    if (metrics_dropped > 0)
+        fprintf(stderr, "Warning: %d metric value%s dropped (out of memory or repeated in a trial)\n",
+                metrics_dropped, metrics_dropped > 1 ? "s" : "");
+
+    if (report_structured()) {
+        const char *base = strrchr(exe, '/');
+
+        rec_begin(base ? base + 1 : exe);
+        rec_object("ab");
+        rec_int("trials_per_arm", ab_trials);
+        rec_str("off_cmd", ab_cmd[0]);
+        rec_str("on_cmd", ab_cmd[1]);
+        rec_close();
+        rec_array("metrics");
+    }
+
+    printf("\n");
+    print_rule();
+    printf("A/B RESULTS:\n");
+    print_rule();
+    for (int i = 0; i < num_metrics; i++) {
+        print_metric(&metrics[i]);
+    }
+    print_rule();
+
+    if (report_structured())
+        rec_end();
+    return 0;
+}
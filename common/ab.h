@@ -0,0 +1,40 @@
+/*
+ * ab.h - Interleaved Hydra-off / Hydra-on comparison
+ *
+ * With --ab N a benchmark re-executes itself 2N times, alternating between
+ * the plain binary and the binary under the replication command (default
+ * "numactl -r all") in ABBA order, so slow drift on the machine hits both
+ * arms equally. Children report their metrics with ab_report_metric(); the
+ * parent prints the speedup with a bootstrap confidence interval and a
+ * Mann-Whitney U test.
+ */
+
+#ifndef HYDRA_AB_H
+#define HYDRA_AB_H
+
+/* True in the parent of an A/B run; children run the benchmark normally */
+int ab_active(void);
+
+/* True in a child of an A/B run */
+int ab_child(void);
+
+/* Run the comparison by re-executing argv; returns the exit code for main */
+int ab_run(char **argv);
+
+/*
+ * Report one result of this run to the A/B parent; no-op outside A/B.
+ * The same metrics go to the results store with --store.
+ */
+void ab_report_metric(const char *name, double value, int higher_is_better);
+
+/*
+ * Suffix " [tag]" to every following metric name, so a sweep reports one
+ * metric per point; NULL or "" clears it.
+ */
+void ab_set_tag(const char *tag);
+
+/* Option handling, see harness_parse_opt() */
+int ab_parse_opt(int opt, const char *arg);
+void ab_print_usage(void);
+
+#endif /* HYDRA_AB_H */
@@ -0,0 +1,659 @@
+/*
+ * antagonist.c - Background load on the remote nodes
+ *
+ * See antagonist.h. The pool forks one process that runs every antagonist
+ * thread and is killed at the end. Each thread pins itself, sets up its
+ * buffer, file or held memory bound to its own node, reports ready and then
+ * loops in chunks small against the duty-cycle period, adding to its byte
+ * count in the shared data after every chunk.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <numa.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "ab.h"
+#include "antagonist.h"
+#include "harness.h"
+#include "report.h"
+#include "topology.h"
+
+#define ANT_MAX_NODES 64
+#define DUTY_PERIOD_NS 10000000ULL          /* 10ms */
+#define BW_DEFAULT_SIZE (128UL << 20)       /* per thread, three arrays */
+#define BW_CHUNK (1UL << 17)                /* doubles per paced chunk */
+#define PC_DEFAULT_SIZE (256UL << 20)       /* file per thread */
+#define PC_CHUNK (1UL << 20)
+#define PRESSURE_DEFAULT_EXTRA (256UL << 20) /* per node, beyond free memory */
+#define PRESSURE_CHUNK (2UL << 20)
+
+static const char *const kind_names[ANT_KINDS] = { "bandwidth", "pagecache", "pressure" };
+
+static unsigned int kind_mask;
+static int threads_per_node = 1;
+static int intensity = 100;
+static size_t opt_size;
+
+int antagonists_enabled(void) {
+    return kind_mask != 0;
+}
+
+int antagonist_cpus_per_node(void) {
+    return __builtin_popcount(kind_mask) * threads_per_node;
+}
+
+/* MPOL_BIND to the antagonist's node, so a full node never spills elsewhere */
+static void bind_to_node(antagonist_data_t *d, void *p, size_t len) {
+    numa_tonode_memory(p, len, d->node);
+}
+
+/* Sleep out the rest of the period once this one's busy share is used */
+static void duty_pace(uint64_t *period_start) {
+    uint64_t now;
+
+    if (intensity >= 100)
+        return;
+    now = now_ns();
+    if (now - *period_start < DUTY_PERIOD_NS * intensity / 100)
+        return;
+    if (*period_start + DUTY_PERIOD_NS > now) {
+        struct timespec ts = { 0, (long)(*period_start + DUTY_PERIOD_NS - now) };
+        nanosleep(&ts, NULL);
+    }
+    *period_start = now_ns();
+}
+
+static void set_ready(antagonist_data_t *d) {
+    __atomic_add_fetch(d->ready, 1, __ATOMIC_RELEASE);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Kinds                                                                    */
+/* ------------------------------------------------------------------------ */
+
+/* STREAM triad a = b + s * c; 24 bytes of traffic per element */
+static void run_bandwidth(antagonist_data_t *d) {
+    size_t n = d->size / (3 * sizeof(double));
+    size_t bytes = 3 * n * sizeof(double);
+    uint64_t period = now_ns();
+    double *a = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    double *b, *c;
+
+    if (a == MAP_FAILED) {
+        perror("mmap bandwidth antagonist");
+        d->failed = 1;
+        set_ready(d);
+        return;
+    }
+    bind_to_node(d, a, bytes);
+    b = a + n;
+    c = b + n;
+    for (size_t i = 0; i < n; i++) {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = 2.0;
+    }
+    set_ready(d);
+
+    while (!*d->stop) {
+        for (size_t i0 = 0; i0 < n && !*d->stop; i0 += BW_CHUNK) {
+            size_t end = i0 + BW_CHUNK < n ? i0 + BW_CHUNK : n;
+
+            for (size_t i = i0; i < end; i++) {
+                a[i] = b[i] + 3.0 * c[i];
+            }
+            d->bytes += (end - i0) * 3 * sizeof(double);
+            duty_pace(&period);
+        }
+    }
+    munmap(a, bytes);
+}
+
+/* Unlinked scratch file in $TMPDIR (default /var/tmp), written and synced */
+static int open_scratch(size_t size, char *buf) {
+    const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/var/tmp";
+    char path[PATH_MAX];
+    int fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+
+    if (fd < 0) {
+        snprintf(path, sizeof(path), "%s/hydra-antagonist-XXXXXX", dir);
+        fd = mkstemp(path);
+        if (fd >= 0)
+            unlink(path);
+    }
+    if (fd < 0) {
+        fprintf(stderr, "Cannot create a page-cache file in %s\n", dir);
+        return -1;
+    }
+
+    memset(buf, 0x5A, PC_CHUNK);
+    for (size_t off = 0; off < size; off += PC_CHUNK) {
+        if (pwrite(fd, buf, PC_CHUNK, off) != (ssize_t)PC_CHUNK) {
+            perror("pwrite page-cache file");
+            close(fd);
+            return -1;
+        }
+    }
+    /* Only clean pages can be dropped */
+    fdatasync(fd);
+    return fd;
+}
+
+static void run_pagecache(antagonist_data_t *d) {
+    uint64_t period = now_ns();
+    char *buf = malloc(PC_CHUNK);
+    int fd = buf ? open_scratch(d->size, buf) : -1;
+
+    if (fd < 0) {
+        d->failed = 1;
+        set_ready(d);
+        free(buf);
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    set_ready(d);
+
+    while (!*d->stop) {
+        for (size_t off = 0; off < d->size && !*d->stop; off += PC_CHUNK) {
+            ssize_t n = pread(fd, buf, PC_CHUNK, off);
+
+            if (n <= 0)
+                break;
+            d->bytes += n;
+            duty_pace(&period);
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+    free(buf);
+}
+
+static void touch_4k(char *p, size_t len) {
+    for (size_t off = 0; off < len; off += PAGE_SIZE_4K) {
+        ((volatile char *)p)[off] = 1;
+    }
+}
+
+/* Hold d->size, then zap and refault it chunk by chunk */
+static void run_pressure(antagonist_data_t *d) {
+    uint64_t period = now_ns();
+    char *region = mmap(NULL, d->size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (region == MAP_FAILED) {
+        perror("mmap pressure antagonist");
+        d->failed = 1;
+        set_ready(d);
+        return;
+    }
+    /* 4K faults, so every refault is an allocation below the watermark */
+    bind_to_node(d, region, d->size);
+    madvise(region, d->size, MADV_NOHUGEPAGE);
+    touch_4k(region, d->size);
+    set_ready(d);
+
+    while (!*d->stop) {
+        for (size_t off = 0; off < d->size && !*d->stop; off += PRESSURE_CHUNK) {
+            size_t len = off + PRESSURE_CHUNK < d->size ? PRESSURE_CHUNK : d->size - off;
+
+            madvise(region + off, len, MADV_DONTNEED);
+            touch_4k(region + off, len);
+            d->bytes += len;
+            duty_pace(&period);
+        }
+    }
+    munmap(region, d->size);
+}
+
+static void *antagonist(void *arg) {
+    antagonist_data_t *d = (antagonist_data_t *)arg;
+
+    pin_to_cpu(d->cpu);
+
+    switch (d->kind) {
+    case ANT_BANDWIDTH:
+        run_bandwidth(d);
+        break;
+    case ANT_PAGECACHE:
+        run_pagecache(d);
+        break;
+    default:
+        run_pressure(d);
+        break;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Pool                                                                     */
+/* ------------------------------------------------------------------------ */
+
+/* "Key: value kB" from a node's meminfo, bytes; -1 if missing */
+static long long node_meminfo(int node, const char *key) {
+    char path[128], line[256];
+    size_t len = strlen(key);
+    long long v = -1;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", node);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, key);
+
+        if (p && p[len] == ':') {
+            v = strtoll(p + len + 1, NULL, 10) * 1024;
+            break;
+        }
+    }
+    fclose(f);
+    return v;
+}
+
+/*
+ * Memory one pressure thread holds: the node's free memory, less what the
+ * node's bandwidth arrays will take (reserved), plus the extra, split
+ * across the threads. The extra is capped at the node's file pages
+ * outside shmem, so reclaim always has something to take short of the OOM
+ * killer.
+ */
+static size_t pressure_size(int node, size_t reserved) {
+    long long free_bytes = 0;
+    long long file = node_meminfo(node, "FilePages");
+    long long shmem = node_meminfo(node, "Shmem");
+    size_t extra = opt_size ? opt_size : PRESSURE_DEFAULT_EXTRA;
+
+    numa_node_size64(node, &free_bytes);
+    if (file >= 0 && shmem > 0)
+        file -= shmem;
+    if (file >= 0 && extra > (size_t)file) {
+        fprintf(stderr, "Warning: node %d pressure extra capped at its %lld MB of file pages\n",
+                node, file >> 20);
+        extra = file;
+    }
+    free_bytes -= (long long)reserved < free_bytes ? (long long)reserved : free_bytes;
+    return align_up((free_bytes + extra) / threads_per_node, PAGE_SIZE_4K);
+}
+
+static void read_reclaim(reclaim_stat_t *r) {
+    char name[64];
+    long long v;
+    FILE *f = fopen("/proc/vmstat", "r");
+
+    memset(r, 0, sizeof(*r));
+    if (!f)
+        return;
+    while (fscanf(f, "%63s %lld", name, &v) == 2) {
+        if (strcmp(name, "pgscan_kswapd") == 0)
+            r->scan_kswapd = v;
+        else if (strcmp(name, "pgsteal_kswapd") == 0)
+            r->steal_kswapd = v;
+        else if (strcmp(name, "pgscan_direct") == 0)
+            r->scan_direct = v;
+    }
+    fclose(f);
+}
+
+/* Visible to both processes whether or not --processes is given */
+static void *shared_map(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED) {
+        perror("mmap antagonist shared data");
+        return NULL;
+    }
+    return p;
+}
+
+/* Child: start every thread, then wait for antagonists_stop() to kill us */
+static void antagonist_process(antagonist_pool_t *pool, pid_t parent) {
+    pthread_t thread;
+
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent)
+        _exit(0);
+
+    for (int i = 0; i < pool->count; i++) {
+        antagonist_data_t *d = &pool->data[i];
+
+        if (pthread_create(&thread, NULL, antagonist, d) != 0) {
+            perror("pthread_create antagonist");
+            d->failed = 1;
+            set_ready(d);
+        }
+    }
+    for (;;) {
+        pause();
+    }
+}
+
+int antagonists_start(antagonist_pool_t *pool, int num_nodes, unsigned long exclude_nodes) {
+    int kinds = __builtin_popcount(kind_mask);
+    int max = kinds * threads_per_node * num_nodes;
+    pid_t parent = getpid();
+
+    memset(pool, 0, sizeof(*pool));
+    if (max <= 0)
+        return 0;
+
+    pool->data = shared_map(max * sizeof(antagonist_data_t));
+    pool->ctl = shared_map(sizeof(antagonist_ctl_t));
+    if (!pool->data || !pool->ctl)
+        return -1;
+
+    for (int node = 0; node < num_nodes; node++) {
+        int ncpus = node_cpu_count(node);
+        size_t bw_size = opt_size ? opt_size : BW_DEFAULT_SIZE;
+        size_t hold = 0;
+        int slot = 0;
+
+        if (exclude_nodes & (1UL << node)) continue;
+        if (topo_cpus(node) == 0 || ncpus <= 0) continue;
+
+        /* Sized once, before this node's threads start taking its memory */
+        if (kind_mask & (1u << ANT_PRESSURE))
+            hold = pressure_size(node, kind_mask & (1u << ANT_BANDWIDTH) ?
+                                       bw_size * threads_per_node : 0);
+
+        /* From the last CPU down; past the first they share CPUs */
+        for (int k = 0; k < ANT_KINDS; k++) {
+            if (!(kind_mask & (1u << k)))
+                continue;
+            for (int t = 0; t < threads_per_node; t++, slot++) {
+                antagonist_data_t *d = &pool->data[pool->count];
+
+                d->id = pool->count;
+                d->node = node;
+                d->cpu = get_cpu_for_node(node, ncpus - 1 - slot % ncpus);
+                d->kind = (antagonist_kind_t)k;
+                d->stop = &pool->ctl->stop;
+                d->ready = &pool->ctl->ready;
+                if (k == ANT_BANDWIDTH)
+                    d->size = bw_size;
+                else if (k == ANT_PAGECACHE)
+                    d->size = align_up(opt_size ? opt_size : PC_DEFAULT_SIZE, PC_CHUNK);
+                else
+                    d->size = hold;
+                if (d->cpu < 0) {
+                    fprintf(stderr, "Warning: no CPU for antagonist %d on node %d\n", slot, node);
+                    continue;
+                }
+                pool->count++;
+            }
+        }
+    }
+
+    if (pool->count == 0) {
+        fprintf(stderr, "Warning: no remote node with CPUs for the antagonists\n");
+        return 0;
+    }
+
+    /* Nothing buffered may be printed twice */
+    fflush(NULL);
+    pool->pid = fork();
+    if (pool->pid < 0) {
+        perror("fork antagonists");
+        pool->pid = 0;
+        return -1;
+    }
+    if (pool->pid == 0)
+        antagonist_process(pool, parent);
+
+    /* Setup (file writes, holding memory) stays out of the measured window */
+    while (__atomic_load_n(&pool->ctl->ready, __ATOMIC_ACQUIRE) < pool->count) {
+        if (waitpid(pool->pid, NULL, WNOHANG) == pool->pid) {
+            fprintf(stderr, "Antagonist process died during setup\n");
+            pool->pid = 0;
+            return -1;
+        }
+        usleep(1000);
+    }
+    return pool->count;
+}
+
+void antagonists_mark(antagonist_pool_t *pool) {
+    for (int i = 0; i < pool->count; i++) {
+        pool->data[i].mark_bytes = pool->data[i].bytes;
+    }
+    read_reclaim(&pool->mark_reclaim);
+    pool->mark_ns = now_ns();
+}
+
+void antagonists_stop(antagonist_pool_t *pool) {
+    reclaim_stat_t end;
+
+    if (pool->count == 0)
+        return;
+
+    pool->window_sec = (now_ns() - pool->mark_ns) / 1e9;
+    for (int i = 0; i < pool->count; i++) {
+        pool->data[i].window_bytes = pool->data[i].bytes - pool->data[i].mark_bytes;
+    }
+    read_reclaim(&end);
+    pool->reclaim.scan_kswapd = end.scan_kswapd - pool->mark_reclaim.scan_kswapd;
+    pool->reclaim.steal_kswapd = end.steal_kswapd - pool->mark_reclaim.steal_kswapd;
+    pool->reclaim.scan_direct = end.scan_direct - pool->mark_reclaim.scan_direct;
+
+    /* Killing also frees the held memory and the scratch files at once */
+    pool->ctl->stop = 1;
+    if (pool->pid > 0) {
+        kill(pool->pid, SIGKILL);
+        if (waitpid(pool->pid, NULL, 0) < 0)
+            perror("waitpid antagonists");
+        pool->pid = 0;
+    }
+    /* data stays for report_antagonists() */
+}
+
+/* ------------------------------------------------------------------------ */
+/* Reporting                                                                */
+/* ------------------------------------------------------------------------ */
+
+static void kinds_string(char *buf, size_t size) {
+    size_t pos = 0;
+
+    buf[0] = '\0';
+    for (int k = 0; k < ANT_KINDS; k++) {
+        if (kind_mask & (1u << k))
+            pos += snprintf(buf + pos, pos < size ? size - pos : 0, "%s%s",
+                            pos ? "," : "", kind_names[k]);
+    }
+}
+
+void print_antagonist_config(void) {
+    char kinds[64];
+
+    if (!kind_mask) {
+        printf("Antagonists: none\n");
+        return;
+    }
+    kinds_string(kinds, sizeof(kinds));
+    printf("Antagonists: %s, %d thread%s per kind per remote node, %d%% intensity\n",
+           kinds, threads_per_node, threads_per_node == 1 ? "" : "s", intensity);
+}
+
+/* Bytes/sec of one kind on node over the window; node -1 sums all nodes */
+static double kind_rate(const antagonist_pool_t *pool, int node, antagonist_kind_t kind,
+                        int *failed) {
+    uint64_t bytes = 0;
+
+    for (int i = 0; i < pool->count; i++) {
+        const antagonist_data_t *d = &pool->data[i];
+
+        if (d->kind != kind || (node >= 0 && d->node != node))
+            continue;
+        bytes += d->window_bytes;
+        if (failed)
+            *failed |= d->failed;
+    }
+    return pool->window_sec > 0 ? bytes / pool->window_sec : 0;
+}
+
+/* GB/s for bandwidth, MB/s for the others */
+static double kind_scale(antagonist_kind_t kind) {
+    return kind == ANT_BANDWIDTH ? 1e9 : 1e6;
+}
+
+static int pool_has_node(const antagonist_pool_t *pool, int node) {
+    for (int i = 0; i < pool->count; i++) {
+        if (pool->data[i].node == node)
+            return 1;
+    }
+    return 0;
+}
+
+void report_antagonists(const antagonist_pool_t *pool) {
+    static const char *const col[ANT_KINDS] = {
+        "bandwidth GB/s", "pagecache MB/s", "pressure MB/s"
+    };
+    char metric[64];
+
+    if (pool->count == 0)
+        return;
+
+    printf("\nAntagonists (achieved over %.3f sec, %d%% intensity):\n", pool->window_sec,
+           intensity);
+    printf("  %-6s", "node");
+    for (int k = 0; k < ANT_KINDS; k++) {
+        if (kind_mask & (1u << k))
+            printf(" %15s", col[k]);
+    }
+    printf("\n");
+    for (int node = 0; node < ANT_MAX_NODES; node++) {
+        if (!pool_has_node(pool, node))
+            continue;
+        printf("  %-6d", node);
+        for (int k = 0; k < ANT_KINDS; k++) {
+            int failed = 0;
+            double rate;
+
+            if (!(kind_mask & (1u << k)))
+                continue;
+            rate = kind_rate(pool, node, k, &failed);
+            if (failed)
+                printf(" %15s", "setup failed");
+            else
+                printf(" %15.2f", rate / kind_scale(k));
+        }
+        printf("\n");
+    }
+    printf("  %-6s", "total");
+    for (int k = 0; k < ANT_KINDS; k++) {
+        if (!(kind_mask & (1u << k)))
+            continue;
+        printf(" %15.2f", kind_rate(pool, -1, k, NULL) / kind_scale(k));
+
+        /* A/B arms should see the same load, or the comparison is not fair */
+        snprintf(metric, sizeof(metric), "antagonist %s", col[k]);
+        ab_report_metric(metric, kind_rate(pool, -1, k, NULL) / kind_scale(k), 1);
+    }
+    printf("\n");
+    printf("Reclaim: %lld pages scanned by kswapd (%lld reclaimed), %lld by direct reclaim\n",
+           pool->reclaim.scan_kswapd, pool->reclaim.steal_kswapd, pool->reclaim.scan_direct);
+}
+
+void rec_antagonists(const antagonist_pool_t *pool) {
+    char kinds[64];
+
+    kinds_string(kinds, sizeof(kinds));
+    rec_object("antagonists");
+    rec_str("kinds", kinds);
+    rec_int("threads_per_node", threads_per_node);
+    rec_int("intensity_pct", intensity);
+    rec_int("threads", pool->count);
+    rec_double("window_sec", pool->window_sec);
+    rec_array("nodes");
+    for (int node = 0; node < ANT_MAX_NODES; node++) {
+        if (!pool_has_node(pool, node))
+            continue;
+        rec_object(NULL);
+        rec_int("node", node);
+        if (kind_mask & (1u << ANT_BANDWIDTH))
+            rec_double("bandwidth_gbps", kind_rate(pool, node, ANT_BANDWIDTH, NULL) / 1e9);
+        if (kind_mask & (1u << ANT_PAGECACHE))
+            rec_double("pagecache_mbps", kind_rate(pool, node, ANT_PAGECACHE, NULL) / 1e6);
+        if (kind_mask & (1u << ANT_PRESSURE))
+            rec_double("pressure_mbps", kind_rate(pool, node, ANT_PRESSURE, NULL) / 1e6);
+        rec_close();
+    }
+    rec_close();
+    rec_object("reclaim");
+    rec_int("pgscan_kswapd", pool->reclaim.scan_kswapd);
+    rec_int("pgsteal_kswapd", pool->reclaim.steal_kswapd);
+    rec_int("pgscan_direct", pool->reclaim.scan_direct);
+    rec_close();
+    rec_close();
+}
+
+/* ------------------------------------------------------------------------ */
+/* Options                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static int set_kinds(const char *arg) {
+    char buf[64], *tok, *save;
+    unsigned int mask = 0;
+
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int k;
+
+        if (strcmp(tok, "none") == 0)
+            continue;
+        for (k = 0; k < ANT_KINDS && strcmp(tok, kind_names[k]) != 0; k++)
+            ;
+        if (k == ANT_KINDS)
+            return -1;
+        mask |= 1u << k;
+    }
+    kind_mask = mask;
+    return 0;
+}
+
+int antagonist_parse_opt(int opt, const char *arg) {
+    switch (opt) {
+    case OPT_ANTAGONIST:
+        if (set_kinds(arg) == 0)
+            return 0;
+        fprintf(stderr, "Unknown antagonist in: %s\n", arg);
+        return -1;
+    case OPT_ANTAGONIST_THREADS:
+        threads_per_node = atoi(arg);
+        if (threads_per_node >= 1)
+            return 0;
+        fprintf(stderr, "Invalid antagonist thread count: %s\n", arg);
+        return -1;
+    case OPT_ANTAGONIST_INTENSITY:
+        intensity = atoi(arg);
+        if (intensity >= 1 && intensity <= 100)
+            return 0;
+        fprintf(stderr, "Invalid antagonist intensity (1-100): %s\n", arg);
+        return -1;
+    case OPT_ANTAGONIST_SIZE:
+        opt_size = parse_size(arg);
+        if (opt_size > 0)
+            return 0;
+        fprintf(stderr, "Invalid antagonist size: %s\n", arg);
+        return -1;
+    }
+    return -1;
+}
+
+void antagonist_print_usage(void) {
+    fprintf(stderr, "  --antagonist LIST   Load on remote nodes: bandwidth, pagecache, pressure\n");
+    fprintf(stderr, "  --antagonist-threads N     Threads per kind per remote node (default: 1)\n");
+    fprintf(stderr, "  --antagonist-intensity PCT Duty cycle of every antagonist (default: 100)\n");
+    fprintf(stderr, "  --antagonist-size SIZE     Triad arrays or file per thread (default: 128m,\n");
+    fprintf(stderr, "                             256m), pressure beyond free memory (default: 256m)\n");
+}
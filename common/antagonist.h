@@ -0,0 +1,114 @@
+/*
+ * antagonist.h - Background load on the remote nodes
+ *
+ * Spinners only occupy CPUs. Antagonists make the remote nodes busy the way
+ * a loaded box is, which slows IPI handling and replica updates there:
+ *
+ *   bandwidth   STREAM triad over node-local arrays, saturating the node's
+ *               memory controller
+ *   pagecache   sequential reads of a node-local file whose pages are
+ *               dropped after every pass, so the page cache keeps filling
+ *               and being reclaimed
+ *   pressure    holds the node's free memory plus --antagonist-size more
+ *               and keeps re-faulting it, holding the node below its low
+ *               watermark so kswapd runs throughout
+ *
+ * Every kind runs --antagonist-threads threads per node on the last CPUs of
+ * the node (compact spinners take the first ones), at --antagonist-intensity
+ * percent duty cycle. Achieved rates are measured between
+ * antagonists_mark() and antagonists_stop(), with the kswapd and direct
+ * reclaim counters from /proc/vmstat over the same window.
+ *
+ * The antagonists run in a process of their own: their madvise() zaps
+ * never shoot down the benchmark's TLBs, their CPUs never join its memory
+ * map's flush set, and under pressure the OOM killer picks them, not the
+ * benchmark.
+ */
+
+#ifndef HYDRA_ANTAGONIST_H
+#define HYDRA_ANTAGONIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "harness.h"
+
+typedef enum {
+    ANT_BANDWIDTH,
+    ANT_PAGECACHE,
+    ANT_PRESSURE,
+    ANT_KINDS
+} antagonist_kind_t;
+
+typedef struct {
+    int id;
+    int node;
+    int cpu;
+    antagonist_kind_t kind;
+    size_t size;             /* buffer, file or held memory, bytes */
+    int failed;              /* setup failed, the thread only idles */
+    volatile uint64_t bytes; /* moved, read or faulted so far */
+    uint64_t mark_bytes;
+    uint64_t window_bytes;   /* between mark and stop */
+    volatile int *stop;
+    int *ready;
+} __attribute__((aligned(CACHE_LINE))) antagonist_data_t;
+
+/* Reclaim counters from /proc/vmstat, pages */
+typedef struct {
+    long long scan_kswapd;
+    long long steal_kswapd;
+    long long scan_direct;
+} reclaim_stat_t;
+
+/* Shared with the antagonist process */
+typedef struct {
+    volatile int stop;
+    int ready;
+} antagonist_ctl_t;
+
+typedef struct {
+    int count;
+    pid_t pid;                /* antagonist process, 0 when none runs */
+    antagonist_data_t *data;  /* shared, bytes are read from here */
+    antagonist_ctl_t *ctl;
+    uint64_t mark_ns;
+    double window_sec;
+    reclaim_stat_t mark_reclaim;
+    reclaim_stat_t reclaim;  /* delta over the window */
+} antagonist_pool_t;
+
+/* True when --antagonist selected at least one kind */
+int antagonists_enabled(void);
+
+/* CPUs taken from the top of each loaded node, for callers that avoid them */
+int antagonist_cpus_per_node(void);
+
+/*
+ * Fork the antagonist process, start the selected antagonists in it on
+ * every node with CPUs whose bit is clear in exclude_nodes, and wait until
+ * each has set up its memory or file. Call it before the benchmark touches
+ * its regions, so the fork leaves nothing copy-on-write behind.
+ * Returns the number of threads, -1 on error.
+ */
+int antagonists_start(antagonist_pool_t *pool, int num_nodes, unsigned long exclude_nodes);
+
+/* Start of the measured window, just before the trial */
+void antagonists_mark(antagonist_pool_t *pool);
+
+/* End the window, kill and reap the antagonist process */
+void antagonists_stop(antagonist_pool_t *pool);
+
+/* One-line description of the configuration for the run header */
+void print_antagonist_config(void);
+
+/* Achieved load per node over the window, and the "antagonists" record */
+void report_antagonists(const antagonist_pool_t *pool);
+void rec_antagonists(const antagonist_pool_t *pool);
+
+/* Option handling, see harness_parse_opt() */
+int antagonist_parse_opt(int opt, const char *arg);
+void antagonist_print_usage(void);
+
+#endif /* HYDRA_ANTAGONIST_H */
@@ -0,0 +1,1769 @@
+/*
+ * harness.c - Shared benchmark harness
+ *
+ * See harness.h for the interface.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <numa.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+
+#include "ab.h"
+#include "antagonist.h"
+#include "harness.h"
+#include "report.h"
+#include "store.h"
+
+static page_mode_t cur_page_mode = PAGE_4K;
+
+/* Run length, see run_budget() */
+static uint64_t opt_ops;
+static double opt_duration_sec;
+static double opt_target_rse;
+static volatile uint64_t calib_local;
+static volatile uint64_t *calibrated_iters = &calib_local;  /* shared with --processes */
+
+/* Nodes the start barrier releases, see barrier_release() */
+#define BARRIER_POLL_US 50
+
+static int barrier_nodes = 1;
+
+/* Time buckets, see report_fairness() */
+#define BUCKET_MS_DEFAULT 10
+
+static uint64_t bucket_ns = BUCKET_MS_DEFAULT * 1000000ULL;
+static int opt_timeseries;
+
+/* Worker processes, see worker_start() */
+static int opt_processes;
+static int opt_memfd;
+
+/* Spinner behaviour, see spinner_mode_t */
+#define SPINNER_WS_DEFAULT (1UL << 20)
+#define SPINNER_FUTEX_NS   50000        /* timed futex wait per wakeup */
+#define SPINNER_IDLE_US    10000
+
+static spinner_mode_t spin_mode = SPIN_PAUSE;
+static size_t spin_ws = SPINNER_WS_DEFAULT;
+static cpu_placement_t spin_place = PLACE_COMPACT;
+
+/* ------------------------------------------------------------------------ */
+/* Common command line options                                              */
+/* ------------------------------------------------------------------------ */
+
+static const char *const spin_mode_names[] = {
+    [SPIN_PAUSE] = "pause",
+    [SPIN_TOUCH] = "touch",
+    [SPIN_FUTEX] = "futex",
+    [SPIN_IDLE]  = "idle",
+    [SPIN_MIXED] = "mixed",
+};
+
+static const char *const placement_names[] = {
+    [PLACE_COMPACT] = "compact",
+    [PLACE_SCATTER] = "scatter",
+    [PLACE_SMT]     = "smt",
+};
+
+static int set_spinner_placement(const char *arg) {
+    for (int p = PLACE_COMPACT; p <= PLACE_SMT; p++) {
+        if (strcmp(arg, placement_names[p]) == 0) {
+            spin_place = p;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int set_spinner_mode(const char *arg) {
+    for (int m = SPIN_PAUSE; m <= SPIN_MIXED; m++) {
+        if (strcmp(arg, spin_mode_names[m]) == 0) {
+            spin_mode = m;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int set_page_mode(const char *arg) {
+    if (strcmp(arg, "4k") == 0)
+        cur_page_mode = PAGE_4K;
+    else if (strcmp(arg, "thp") == 0 || strcmp(arg, "2m-thp") == 0)
+        cur_page_mode = PAGE_THP;
+    else if (strcmp(arg, "2m") == 0)
+        cur_page_mode = PAGE_2M;
+    else if (strcmp(arg, "1g") == 0)
+        cur_page_mode = PAGE_1G;
+    else
+        return -1;
+    return 0;
+}
+
+int harness_parse_opt(int opt, const char *arg) {
+    switch (opt) {
+    case OPT_AB:
+    case OPT_AB_CMD:
+    case OPT_AB_BASE_CMD:
+        return ab_parse_opt(opt, arg);
+    case OPT_STORE:
+    case OPT_LABEL:
+    case OPT_COMPARE:
+    case OPT_VARIANT:
+    case OPT_REGRESS_PCT:
+        return store_parse_opt(opt, arg);
+    case OPT_ANTAGONIST:
+    case OPT_ANTAGONIST_THREADS:
+    case OPT_ANTAGONIST_INTENSITY:
+    case OPT_ANTAGONIST_SIZE:
+        return antagonist_parse_opt(opt, arg);
+    case OPT_FORMAT:
+        if (report_set_format(arg) == 0)
+            return 0;
+        fprintf(stderr, "Unknown format: %s\n", arg);
+        return -1;
+    case OPT_PAGESIZE:
+        if (set_page_mode(arg) == 0)
+            return 0;
+        fprintf(stderr, "Unknown page size: %s\n", arg);
+        return -1;
+    case OPT_OPS:
+        opt_ops = strtoull(arg, NULL, 10);
+        if (opt_ops > 0)
+            return 0;
+        fprintf(stderr, "Invalid op count: %s\n", arg);
+        return -1;
+    case OPT_DURATION:
+        opt_duration_sec = atof(arg);
+        if (opt_duration_sec > 0)
+            return 0;
+        fprintf(stderr, "Invalid duration: %s\n", arg);
+        return -1;
+    case OPT_TARGET_RSE:
+        opt_target_rse = atof(arg) / 100.0;
+        if (opt_target_rse > 0)
+            return 0;
+        fprintf(stderr, "Invalid target RSE: %s\n", arg);
+        return -1;
+    case OPT_SPINNER_MODE:
+        if (set_spinner_mode(arg) == 0)
+            return 0;
+        fprintf(stderr, "Unknown spinner mode: %s\n", arg);
+        return -1;
+    case OPT_SPINNER_WS:
+        spin_ws = parse_size(arg);
+        if (spin_ws > 0)
+            return 0;
+        fprintf(stderr, "Invalid spinner working set: %s\n", arg);
+        return -1;
+    case OPT_SPINNER_PLACEMENT:
+        if (set_spinner_placement(arg) == 0)
+            return 0;
+        fprintf(stderr, "Unknown spinner placement: %s\n", arg);
+        return -1;
+    case OPT_PERF:
+        perf_set_enabled(1);
+        return 0;
+    case OPT_PROCESSES:
+        opt_processes = 1;
+        return 0;
+    case OPT_MEMFD:
+        opt_memfd = 1;
+        return 0;
+    case OPT_BUCKET_MS:
+        bucket_ns = (uint64_t)(atof(arg) * 1e6);
+        if (bucket_ns > 0)
+            return 0;
+        fprintf(stderr, "Invalid bucket width: %s\n", arg);
+        return -1;
+    case OPT_TIMESERIES:
+        opt_timeseries = 1;
+        return 0;
+    }
+    return -1;
+}
+
+void harness_print_usage(void) {
+    fprintf(stderr, "\nCommon options:\n");
+    fprintf(stderr, "  --format FMT        Output format: text, json, csv (default: text)\n");
+    fprintf(stderr, "  --pagesize P        4k, thp (2MB via MADV_HUGEPAGE), 2m or 1g (hugetlbfs)\n");
+    fprintf(stderr, "  --ops N             Iterations of the timed loop (default: per benchmark)\n");
+    fprintf(stderr, "  --duration SEC      Run the timed loop for SEC seconds instead\n");
+    fprintf(stderr, "  --target-rse PCT    Calibrate iterations for PCT%% relative std. error\n");
+    fprintf(stderr, "  --perf              Count cycles, dTLB misses, walk cycles and IPIs (perf_event_open)\n");
+    fprintf(stderr, "  --bucket-ms MS      Time bucket for per-node fairness (default: %d)\n",
+            BUCKET_MS_DEFAULT);
+    fprintf(stderr, "  --timeseries        Print per-node ops/sec of every time bucket\n");
+    ab_print_usage();
+    store_print_usage();
+}
+
+void spinner_print_usage(void) {
+    fprintf(stderr, "  --spinner-mode M    pause (default), touch, futex, idle or mixed\n");
+    fprintf(stderr, "  --spinner-ws SIZE   Working set walked by touch spinners (default: 1m)\n");
+    fprintf(stderr, "  --spinner-placement P  compact (default), scatter (one per core) or smt\n");
+}
+
+void process_print_usage(void) {
+    fprintf(stderr, "  --processes         Fork one process per worker (own mm) instead of threads\n");
+    fprintf(stderr, "  --memfd             Share worker memory through one MAP_SHARED memfd\n");
+}
+
+/* ------------------------------------------------------------------------ */
+/* Topology and pinning                                                     */
+/* ------------------------------------------------------------------------ */
+
+int harness_init(void) {
+    if (numa_available() < 0) {
+        fprintf(stderr, "NUMA not available\n");
+        return -1;
+    }
+    barrier_nodes = topology_init();
+    if (barrier_nodes < 0) {
+        fprintf(stderr, "No NUMA node with CPUs\n");
+        return -1;
+    }
+    if (barrier_nodes > BARRIER_NODES)
+        barrier_nodes = BARRIER_NODES;
+    if (store_check() != 0)
+        return -1;
+
+    /* Calibration pilots of forked workers must reach the parent */
+    if (opt_processes) {
+        calibrated_iters = shared_calloc(1, sizeof(uint64_t));
+        if (!calibrated_iters)
+            return -1;
+    }
+    return topo_span();
+}
+
+int get_cpu_for_node(int node, int index) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int cpu = -1;
+    int count = 0;
+
+    if (numa_node_to_cpus(node, cpus) < 0) {
+        numa_free_cpumask(cpus);
+        return -1;
+    }
+
+    for (int i = 0; i < numa_num_configured_cpus(); i++) {
+        if (numa_bitmask_isbitset(cpus, i)) {
+            if (count == index) {
+                cpu = i;
+                break;
+            }
+            count++;
+        }
+    }
+    numa_free_cpumask(cpus);
+    return cpu;
+}
+
+int node_cpu_count(int node) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+    int count = 0;
+
+    if (numa_node_to_cpus(node, cpus) == 0) {
+        for (int i = 0; i < numa_num_configured_cpus(); i++) {
+            if (numa_bitmask_isbitset(cpus, i))
+                count++;
+        }
+    }
+    numa_free_cpumask(cpus);
+    return count;
+}
+
+const char *placement_name(cpu_placement_t p) {
+    return placement_names[p];
+}
+
+/*
+ * First CPU of cpu's core (from thread_siblings_list) and cpu's position
+ * among its siblings. Without sysfs every CPU is its own core.
+ */
+static int core_of(int cpu, int *rank) {
+    char path[96], buf[256], *p = buf;
+    int leader = cpu, pos = 0;
+    FILE *f;
+
+    *rank = 0;
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    f = fopen(path, "r");
+    if (!f)
+        return cpu;
+    if (!fgets(buf, sizeof(buf), f))
+        buf[0] = '\0';
+    fclose(f);
+
+    /* "0,36" or "0-1" */
+    for (int first = 1; *p >= '0' && *p <= '9'; first = 0) {
+        int lo = (int)strtol(p, &p, 10), hi = lo;
+
+        if (*p == '-')
+            hi = (int)strtol(p + 1, &p, 10);
+        if (first)
+            leader = lo;
+        for (int c = lo; c <= hi; c++, pos++) {
+            if (c == cpu)
+                *rank = pos;
+        }
+        if (*p == ',')
+            p++;
+    }
+    return leader;
+}
+
+int node_cpus_ordered(int node, cpu_placement_t p, int *cpus, int max) {
+    int n = 0, count = node_cpu_count(node);
+    long *key;
+
+    key = calloc(count > 0 ? count : 1, sizeof(*key));
+    if (!key)
+        return 0;
+
+    for (int i = 0; i < count && n < max; i++) {
+        int cpu = get_cpu_for_node(node, i), rank, core;
+
+        if (cpu < 0)
+            break;
+        core = core_of(cpu, &rank);
+        key[n] = p == PLACE_SCATTER ? (long)rank << 32 | cpu :
+                 p == PLACE_SMT     ? (long)core << 32 | cpu : cpu;
+        cpus[n++] = cpu;
+    }
+
+    /* Insertion sort by key, n is at most a few hundred */
+    for (int i = 1; i < n; i++) {
+        long k = key[i];
+        int c = cpus[i], j = i - 1;
+
+        for (; j >= 0 && key[j] > k; j--) {
+            key[j + 1] = key[j];
+            cpus[j + 1] = cpus[j];
+        }
+        key[j + 1] = k;
+        cpus[j + 1] = c;
+    }
+    free(key);
+    return n;
+}
+
+int parse_int_list(const char *s, int *out, int max) {
+    int n = 0;
+    char *end;
+
+    while (*s) {
+        if (n == max)
+            return -1;
+        out[n++] = (int)strtol(s, &end, 10);
+        if (end == s || (*end && *end != ','))
+            return -1;
+        s = *end ? end + 1 : end;
+    }
+    return n;
+}
+
+int workers_place(worker_data_t *data, const int *nodes, int n) {
+    for (int i = 0; i < n; i++) {
+        int index = 0;
+
+        for (int j = 0; j < i; j++) {
+            if (nodes[j] == nodes[i])
+                index++;
+        }
+        data[i].id = i;
+        data[i].node = nodes[i];
+        data[i].cpu = get_cpu_for_node(nodes[i], index);
+        if (data[i].cpu < 0) {
+            fprintf(stderr, "Node %d has no CPU %d for worker %d\n", nodes[i], index, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pin_to_cpu(int cpu) {
+    cpu_set_t cpuset;
+
+    if (cpu < 0)
+        return -1;
+
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    return cpu;
+}
+
+int pin_to_node(int node) {
+    /* Just first CPU on node */
+    return pin_to_cpu(get_cpu_for_node(node, 0));
+}
+
+/* ------------------------------------------------------------------------ */
+/* Start barrier                                                            */
+/* ------------------------------------------------------------------------ */
+
+/* Replica of the calling thread's node; callers are pinned by now */
+static barrier_node_t *barrier_slot(start_barrier_t *b) {
+    int cpu = sched_getcpu();
+    int node = cpu >= 0 ? numa_node_of_cpu(cpu) : 0;
+
+    return &b->node[node >= 0 && node < barrier_nodes ? node : 0];
+}
+
+void barrier_arrive_and_wait(start_barrier_t *b) {
+    barrier_node_t *n = barrier_slot(b);
+    int gen = n->go;
+    uint64_t t, cur;
+
+    __sync_fetch_and_add(&b->ready_count, 1);
+    while (n->go == gen) {
+        cpu_relax();
+    }
+    t = now_ns();
+
+    do {
+        cur = n->first_ns;
+    } while ((cur == 0 || t < cur) && !__sync_bool_compare_and_swap(&n->first_ns, cur, t));
+    do {
+        cur = n->last_ns;
+    } while (t > cur && !__sync_bool_compare_and_swap(&n->last_ns, cur, t));
+}
+
+void barrier_wait_ready(start_barrier_t *b, int expected) {
+    while (b->ready_count < expected) {
+        usleep(BARRIER_POLL_US);
+    }
+    /* Nobody can arrive again before the release below */
+    b->ready_count = 0;
+}
+
+void barrier_release(start_barrier_t *b) {
+    for (int i = 0; i < barrier_nodes; i++) {
+        b->node[i].first_ns = 0;
+        b->node[i].last_ns = 0;
+    }
+    b->release_ns = now_ns();
+    __sync_synchronize();
+    for (int i = 0; i < barrier_nodes; i++) {
+        __atomic_store_n(&b->node[i].go, b->node[i].go + 1, __ATOMIC_RELEASE);
+    }
+    __sync_synchronize();
+}
+
+/* Earliest and latest departure over all nodes; returns 0 if nobody waited */
+static int start_skew(const start_barrier_t *b, uint64_t *first, uint64_t *last, int *last_node) {
+    *first = 0;
+    *last = 0;
+    *last_node = -1;
+    for (int i = 0; i < barrier_nodes; i++) {
+        const barrier_node_t *n = &b->node[i];
+
+        if (!n->last_ns)
+            continue;
+        if (!*first || n->first_ns < *first)
+            *first = n->first_ns;
+        if (n->last_ns > *last) {
+            *last = n->last_ns;
+            *last_node = i;
+        }
+    }
+    return *last != 0;
+}
+
+void print_start_skew(const start_barrier_t *b) {
+    uint64_t first, last;
+    int last_node;
+
+    if (!start_skew(b, &first, &last, &last_node))
+        return;
+
+    printf("Start skew: last waiter left %.2f us after release, %.2f us after the first",
+           (last - b->release_ns) / 1e3, (last - first) / 1e3);
+    if (barrier_nodes > 1) {
+        printf(" (node %d last)\n", last_node);
+        printf("  last per node (us after release):");
+        for (int i = 0; i < barrier_nodes; i++) {
+            if (b->node[i].last_ns)
+                printf(" %d:%.2f", i, (b->node[i].last_ns - b->release_ns) / 1e3);
+        }
+    }
+    printf("\n");
+}
+
+void rec_start_skew(const start_barrier_t *b) {
+    uint64_t first, last;
+    int last_node;
+
+    if (!start_skew(b, &first, &last, &last_node))
+        return;
+
+    rec_object("start_skew");
+    rec_double("release_to_last_us", (last - b->release_ns) / 1e3);
+    rec_double("first_to_last_us", (last - first) / 1e3);
+    rec_int("last_node", last_node);
+    rec_array("node_last_us");
+    for (int i = 0; i < barrier_nodes; i++) {
+        if (b->node[i].last_ns)
+            rec_double(NULL, (b->node[i].last_ns - b->release_ns) / 1e3);
+        else
+            rec_double(NULL, NAN);
+    }
+    rec_close();
+    rec_close();
+}
+
+/* ------------------------------------------------------------------------ */
+/* Worker processes                                                         */
+/* ------------------------------------------------------------------------ */
+
+int worker_processes(void) {
+    return opt_processes;
+}
+
+int region_memfd(void) {
+    return opt_memfd;
+}
+
+const char *worker_mode_name(void) {
+    return opt_processes ? "processes" : "threads";
+}
+
+int worker_start(worker_handle_t *h, void *(*fn)(void *), void *arg) {
+    if (!opt_processes) {
+        h->pid = 0;
+        if (pthread_create(&h->thread, NULL, fn, arg) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+        return 0;
+    }
+
+    /* Nothing buffered may be printed twice */
+    fflush(NULL);
+    h->pid = fork();
+    if (h->pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (h->pid == 0) {
+        fn(arg);
+        fflush(NULL);
+        _exit(0);
+    }
+    return 0;
+}
+
+void worker_join(worker_handle_t *h) {
+    int status;
+
+    if (!h->pid) {
+        pthread_join(h->thread, NULL);
+        return;
+    }
+    if (waitpid(h->pid, &status, 0) < 0)
+        perror("waitpid");
+    else if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "Warning: worker process %d did not exit cleanly\n", (int)h->pid);
+}
+
+void *aligned_calloc(size_t n, size_t size) {
+    void *p;
+
+    if (posix_memalign(&p, CACHE_LINE, n * size) != 0)
+        return NULL;
+    memset(p, 0, n * size);
+    return p;
+}
+
+void *shared_calloc(size_t n, size_t size) {
+    void *p;
+
+    if (!opt_processes)
+        return aligned_calloc(n, size);
+    p = mmap(NULL, n * size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap shared");
+        return NULL;
+    }
+    return p;
+}
+
+void shared_free(void *p, size_t n, size_t size) {
+    if (!opt_processes)
+        free(p);
+    else if (p)
+        munmap(p, n * size);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Timing                                                                   */
+/* ------------------------------------------------------------------------ */
+
+uint64_t timer_overhead_ns(void) {
+    uint64_t best = UINT64_MAX;
+
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t0 = now_ns();
+        uint64_t t1 = now_ns();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Run length                                                               */
+/* ------------------------------------------------------------------------ */
+
+run_budget_t run_budget(int default_ops) {
+    run_budget_t b = { 0, 0 };
+
+    if (opt_duration_sec > 0)
+        b.deadline_ns = now_ns() + (uint64_t)(opt_duration_sec * 1e9);
+    else
+        b.iters = run_ops(default_ops);
+    return b;
+}
+
+run_budget_t run_budget_fixed(uint64_t iters) {
+    run_budget_t b = { iters, 0 };
+    return b;
+}
+
+void run_default_duration(double sec) {
+    if (opt_ops == 0 && opt_duration_sec == 0 && opt_target_rse == 0)
+        opt_duration_sec = sec;
+}
+
+int run_calibrating(void) {
+    return opt_target_rse > 0 && opt_ops == 0 && opt_duration_sec == 0;
+}
+
+void run_calibrate_reset(void) {
+    *calibrated_iters = 0;
+}
+
+void run_calibrate_need(const worker_data_t *data, int slot, double samples_per_iter) {
+    const hist_t *h = &data->lat[slot];
+    double cv, samples, iters;
+    uint64_t need, cur;
+
+    /* RSE of the mean is cv / sqrt(n), so n = (cv / target)^2 */
+    cv = hist_mean(h) > 0 ? hist_stddev(h) / hist_mean(h) : 0;
+    samples = (cv / opt_target_rse) * (cv / opt_target_rse);
+    iters = samples / (samples_per_iter > 0 ? samples_per_iter : 1);
+    need = iters < RUN_MAX_ITERS ? (uint64_t)iters + 1 : RUN_MAX_ITERS;
+
+    do {
+        cur = *calibrated_iters;
+    } while (need > cur && !__sync_bool_compare_and_swap(calibrated_iters, cur, need));
+}
+
+void run_calibrate_report(worker_data_t *data, int slot, uint64_t samples_per_iter) {
+    run_calibrate_need(data, slot, samples_per_iter);
+    worker_reset_stats(data);
+}
+
+uint64_t run_ops(int default_ops) {
+    if (opt_duration_sec > 0)
+        return 0;
+    if (opt_ops > 0)
+        return opt_ops;
+    if (run_calibrating() && *calibrated_iters > 0)
+        return *calibrated_iters;
+    return (uint64_t)default_ops;
+}
+
+void print_run_budget(const char *label, int default_ops) {
+    if (opt_duration_sec > 0)
+        printf("%s: %.1f sec (clock checked every %d)\n", label, opt_duration_sec, RUN_CHECK_BATCH);
+    else if (run_calibrating())
+        printf("%s: calibrated for %.2f%% RSE\n", label, opt_target_rse * 100);
+    else
+        printf("%s: %lu\n", label, (unsigned long)run_ops(default_ops));
+}
+
+void print_run_calibration(int default_ops) {
+    if (run_calibrating())
+        printf("Calibrated: %lu iterations per thread\n", (unsigned long)run_ops(default_ops));
+}
+
+void rec_run_budget(int default_ops) {
+    rec_str("run_mode", opt_duration_sec > 0 ? "duration" :
+                        run_calibrating() ? "calibrated" : "ops");
+    rec_int("run_ops", (long long)run_ops(default_ops));
+    rec_double("run_duration_sec", opt_duration_sec);
+    rec_double("target_rse", opt_target_rse);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Workloads                                                                */
+/* ------------------------------------------------------------------------ */
+
+size_t parse_size(const char *s) {
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+
+    if (end == s)
+        return 0;
+    switch (*end) {
+    case 'k': case 'K': v <<= 10; end++; break;
+    case 'm': case 'M': v <<= 20; end++; break;
+    case 'g': case 'G': v <<= 30; end++; break;
+    }
+    if (*end == 'b' || *end == 'B')
+        end++;
+    return *end ? 0 : (size_t)v;
+}
+
+page_mode_t page_mode(void) {
+    return cur_page_mode;
+}
+
+const char *page_mode_name(void) {
+    switch (cur_page_mode) {
+    case PAGE_4K:  return "4k";
+    case PAGE_THP: return "thp";
+    case PAGE_2M:  return "2m";
+    case PAGE_1G:  return "1g";
+    }
+    return "unknown";
+}
+
+size_t region_page_size(void) {
+    switch (cur_page_mode) {
+    case PAGE_THP:
+    case PAGE_2M:  return PMD_SIZE;
+    case PAGE_1G:  return PUD_SIZE;
+    default:       return PAGE_SIZE_4K;
+    }
+}
+
+int region_mmap_flags(void) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (cur_page_mode == PAGE_2M)
+        flags |= MAP_HUGETLB | MAP_HUGE_2MB;
+    else if (cur_page_mode == PAGE_1G)
+        flags |= MAP_HUGETLB | MAP_HUGE_1GB;
+    return flags;
+}
+
+void *region_map_at(void *hint, size_t size, int extra_flags) {
+    void *region = mmap(hint, size, PROT_READ | PROT_WRITE,
+                        region_mmap_flags() | extra_flags, -1, 0);
+    if (region == MAP_FAILED)
+        return MAP_FAILED;
+
+    if (cur_page_mode == PAGE_THP)
+        madvise(region, size, MADV_HUGEPAGE);
+    return region;
+}
+
+/* Reserve a range aligned to align by over-allocating and trimming */
+static void *map_aligned(size_t size, size_t align) {
+    char *raw, *base;
+
+    if (cur_page_mode == PAGE_2M || cur_page_mode == PAGE_1G) {
+        /* hugetlbfs mappings are naturally aligned to their page size */
+        return region_map_at(NULL, size, 0);
+    }
+
+    raw = mmap(NULL, size + align, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return MAP_FAILED;
+    base = (char *)align_up((size_t)raw, align);
+    if (base > raw)
+        munmap(raw, base - raw);
+    munmap(base + size, (raw + size + align) - (base + size));
+
+    if (cur_page_mode == PAGE_THP)
+        madvise(base, size, MADV_HUGEPAGE);
+    return base;
+}
+
+/*
+ * Aligned MAP_SHARED mapping of a fresh memfd of size bytes. The fd is
+ * closed again; the mapping, and with it the memory, lives until munmap
+ * in every process that inherited it.
+ */
+static void *map_memfd(size_t size, size_t align) {
+    unsigned int mfd_flags = MFD_CLOEXEC;
+    char *raw, *base;
+    int fd;
+
+    /* MFD_HUGE_* use the MAP_HUGE_* encoding */
+    if (cur_page_mode == PAGE_2M)
+        mfd_flags |= MFD_HUGETLB | MAP_HUGE_2MB;
+    else if (cur_page_mode == PAGE_1G)
+        mfd_flags |= MFD_HUGETLB | MAP_HUGE_1GB;
+    if (align < region_page_size())
+        align = region_page_size();
+
+    fd = memfd_create("hydra-region", mfd_flags);
+    if (fd < 0)
+        return MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        return MAP_FAILED;
+    }
+
+    /* Reserve an aligned range first, then map the file over it */
+    raw = mmap(NULL, size + align, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        close(fd);
+        return MAP_FAILED;
+    }
+    base = (char *)align_up((size_t)raw, align);
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(raw, size + align);
+        close(fd);
+        return MAP_FAILED;
+    }
+    close(fd);
+    if (base > raw)
+        munmap(raw, base - raw);
+    munmap(base + size, (raw + size + align) - (base + size));
+
+    if (cur_page_mode == PAGE_THP)
+        madvise(base, size, MADV_HUGEPAGE);
+    return base;
+}
+
+static void hugetlb_hint(void) {
+    if (cur_page_mode == PAGE_2M || cur_page_mode == PAGE_1G)
+        fprintf(stderr, "Hint: reserve %s pages via /sys/kernel/mm/hugepages/*/nr_hugepages\n",
+                page_mode_name());
+}
+
+/* Bytes of a THP region actually backed by huge pages, from smaps */
+static size_t thp_backed_bytes(void *addr) {
+    char line[256];
+    unsigned long start, end;
+    size_t kb = 0;
+    int in_vma = 0;
+    FILE *f = fopen("/proc/self/smaps", "r");
+
+    if (!f)
+        return 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+            in_vma = (unsigned long)addr >= start && (unsigned long)addr < end;
+        } else if (in_vma && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb * 1024;
+}
+
+void *region_map(size_t size) {
+    void *region = map_aligned(size, PMD_SIZE);
+
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        hugetlb_hint();
+        return NULL;
+    }
+    return region;
+}
+
+void *region_alloc(size_t size) {
+    static int thp_warned;
+    void *region = region_map(size);
+
+    if (!region)
+        return NULL;
+
+    /* Touch pages to fault them in on THIS node */
+    memset(region, 0xAB, size);
+
+    if (cur_page_mode == PAGE_THP && !thp_warned) {
+        size_t thp = thp_backed_bytes(region);
+        if (thp < size / PMD_SIZE * PMD_SIZE) {
+            fprintf(stderr, "Warning: only %zu of %zu KB backed by THP\n",
+                    thp / 1024, size / 1024);
+            thp_warned = 1;
+        }
+    }
+    return region;
+}
+
+void region_free(void *region, size_t size) {
+    if (region)
+        munmap(region, size);
+}
+
+size_t slice_stride_for(size_t slice, size_t stride, int align_pmd) {
+    if (stride < slice)
+        stride = slice;
+    stride = region_round(stride);
+    if (align_pmd)
+        stride = align_up(stride, PMD_SIZE);
+    return stride;
+}
+
+int slice_region_map(slice_region_t *sr, int nslices, size_t slice, size_t stride) {
+    size_t len = (size_t)(nslices - 1) * stride + slice;
+    char *base = opt_memfd ? map_memfd(len, PMD_SIZE) : map_aligned(len, PMD_SIZE);
+
+    if (base == MAP_FAILED) {
+        perror("mmap shared slices");
+        hugetlb_hint();
+        return -1;
+    }
+
+    sr->base = base;
+    sr->len = len;
+    sr->slice = slice;
+    sr->stride = stride;
+    return 0;
+}
+
+void slice_region_unmap(slice_region_t *sr) {
+    if (sr->base)
+        munmap(sr->base, sr->len);
+    sr->base = NULL;
+}
+
+void worker_reset_stats(worker_data_t *data) {
+    data->elapsed_sec = 0;
+    data->ops = 0;
+    for (int slot = 0; slot < LAT_SLOTS; slot++) {
+        hist_reset(&data->lat[slot]);
+    }
+    perf_reset(&data->perf);
+    memset(&data->series, 0, sizeof(data->series));
+}
+
+uint64_t series_bucket_ns(void) {
+    return bucket_ns;
+}
+
+/* Region and count live in locals: nothing is reloaded across the syscalls */
+HOT_INLINE void mprotect_toggle_loop(worker_data_t *data, size_t size, run_budget_t budget,
+                                     int deadline) {
+    char *region = data->region;
+    uint64_t ops = 0;
+    uint64_t start = now_ns();
+
+    series_start(&data->series, start, bucket_ns);
+
+    /* Main loop: mprotect triggers TLB shootdowns */
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0 = now_ns();
+        mprotect(region, size, PROT_READ);
+        uint64_t t1 = now_ns();
+        mprotect(region, size, PROT_READ | PROT_WRITE);
+        uint64_t t2 = now_ns();
+
+        hist_record(&data->lat[LAT_RW_TO_RO], t1 - t0);
+        hist_record(&data->lat[LAT_RO_TO_RW], t2 - t1);
+        series_add(&data->series, t2, 2);
+        ops += 2;
+    }
+
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+}
+
+void run_mprotect_toggle(worker_data_t *data, size_t size, run_budget_t budget) {
+    if (budget.deadline_ns)
+        mprotect_toggle_loop(data, size, budget, 1);
+    else
+        mprotect_toggle_loop(data, size, budget, 0);
+}
+
+/* xorshift64* uniform in (0, 1], per-caller state */
+static double rand_unit(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return ((*s * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) +
+           (1.0 / 9007199254740992.0);
+}
+
+HOT_INLINE void mprotect_open_loop(worker_data_t *data, size_t size, run_budget_t budget,
+                                   double rate, int poisson, int deadline) {
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (data->id + 1);
+    double gap_ns = 1e9 / rate;
+    char *region = data->region;
+    uint64_t ops = 0;
+    uint64_t start = now_ns();
+    double due = start;
+
+    series_start(&data->series, start, bucket_ns);
+
+    for (uint64_t i = 0; run_budget_more_as(&budget, i, deadline); i++) {
+        uint64_t t0;
+
+        while ((t0 = now_ns()) < (uint64_t)due) {
+            cpu_relax();
+        }
+        mprotect(region, size, (i & 1) ? PROT_READ | PROT_WRITE : PROT_READ);
+        uint64_t t1 = now_ns();
+
+        hist_record(&data->lat[LAT_RESPONSE], t1 - (uint64_t)due);
+        hist_record(&data->lat[LAT_SERVICE], t1 - t0);
+        series_add(&data->series, t1, 1);
+        ops += 1;
+        due += poisson ? -log(rand_unit(&seed)) * gap_ns : gap_ns;
+    }
+
+    /* Leave the region writable for the next phase */
+    mprotect(region, size, PROT_READ | PROT_WRITE);
+    data->ops += ops;
+    data->elapsed_sec = (now_ns() - start) / 1e9;
+}
+
+void run_mprotect_open_loop(worker_data_t *data, size_t size, run_budget_t budget,
+                            double rate, int poisson) {
+    int deadline = budget.deadline_ns != 0;
+
+    if (poisson && deadline)
+        mprotect_open_loop(data, size, budget, rate, 1, 1);
+    else if (poisson)
+        mprotect_open_loop(data, size, budget, rate, 1, 0);
+    else if (deadline)
+        mprotect_open_loop(data, size, budget, rate, 0, 1);
+    else
+        mprotect_open_loop(data, size, budget, rate, 0, 0);
+}
+
+const char *spinner_mode_name(spinner_mode_t mode) {
+    return spin_mode_names[mode];
+}
+
+spinner_mode_t spinner_mode(void) {
+    return spin_mode;
+}
+
+size_t spinner_working_set(void) {
+    return spin_ws;
+}
+
+cpu_placement_t spinner_placement(void) {
+    return spin_place;
+}
+
+/*
+ * The working set is always 4K pages, whatever --pagesize says: it is there
+ * to hold TLB entries, and a 1G page would make it one entry and 1 GB
+ */
+static char *spin_ws_alloc(size_t size) {
+    char *ws = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ws == MAP_FAILED) {
+        perror("mmap spinner working set");
+        return NULL;
+    }
+    madvise(ws, size, MADV_NOHUGEPAGE);
+    memset(ws, 0xAB, size);
+    return ws;
+}
+
+/* Read one byte per page so every page of the set keeps a TLB entry */
+static void spin_touch(spinner_data_t *data, const volatile char *ws) {
+    uint64_t sum = 0;
+
+    while (!*data->stop) {
+        for (size_t off = 0; off < spin_ws && !*data->stop; off += PAGE_SIZE_4K) {
+            sum += ws[off];
+            data->spin_count++;
+        }
+    }
+    (void)sum;
+}
+
+static void spin_futex(spinner_data_t *data) {
+    struct timespec ts = { 0, SPINNER_FUTEX_NS };
+
+    /* EAGAIN once stop is set, ETIMEDOUT otherwise */
+    while (!*data->stop) {
+        syscall(SYS_futex, data->stop, FUTEX_WAIT_PRIVATE, 0, &ts, NULL, 0);
+        data->spin_count++;
+    }
+}
+
+static void *spinner(void *arg) {
+    spinner_data_t *data = (spinner_data_t *)arg;
+    char *ws = NULL;
+
+    pin_to_cpu(data->cpu);
+
+    /* Fault the working set in on this spinner's node */
+    if (data->mode == SPIN_TOUCH) {
+        ws = spin_ws_alloc(align_up(spin_ws, PAGE_SIZE_4K));
+        if (!ws)
+            data->mode = SPIN_PAUSE;
+    }
+
+    barrier_arrive_and_wait(data->barrier);
+
+    /* Run until told to stop */
+    switch (data->mode) {
+    case SPIN_TOUCH:
+        spin_touch(data, ws);
+        break;
+    case SPIN_FUTEX:
+        spin_futex(data);
+        break;
+    case SPIN_IDLE:
+        while (!*data->stop) {
+            usleep(SPINNER_IDLE_US);
+            data->spin_count++;
+        }
+        break;
+    default:
+        while (!*data->stop) {
+            data->spin_count++;
+            cpu_relax();
+        }
+        break;
+    }
+
+    if (ws)
+        munmap(ws, align_up(spin_ws, PAGE_SIZE_4K));
+    return NULL;
+}
+
+int spinners_start(spinner_pool_t *pool, start_barrier_t *b,
+                   int num_nodes, unsigned long exclude_nodes, int per_node) {
+    int max = per_node * num_nodes;
+    int *cpus;
+
+    memset(pool, 0, sizeof(*pool));
+    if (max <= 0)
+        return 0;
+
+    pool->threads = calloc(max, sizeof(pthread_t));
+    pool->data = aligned_calloc(max, sizeof(spinner_data_t));
+    cpus = calloc(per_node, sizeof(int));
+    if (!pool->threads || !pool->data || !cpus) {
+        perror("calloc");
+        return -1;
+    }
+
+    for (int node = 0; node < num_nodes; node++) {
+        if (exclude_nodes & (1UL << node)) continue;
+        if (topo_cpus(node) == 0) continue;
+
+        int ncpus = node_cpus_ordered(node, spin_place, cpus, per_node);
+        for (int s = 0; s < per_node; s++) {
+            int cpu = s < ncpus ? cpus[s] : -1;
+            if (cpu < 0) {
+                fprintf(stderr, "Warning: cannot get CPU %d on node %d\n", s, node);
+                continue;
+            }
+
+            spinner_data_t *sd = &pool->data[pool->count];
+            sd->id = pool->count;
+            sd->node = node;
+            sd->cpu = cpu;
+            sd->mode = spin_mode == SPIN_MIXED ? (spinner_mode_t)(sd->id % SPIN_MIXED) : spin_mode;
+            sd->barrier = b;
+            sd->stop = &pool->stop;
+
+            if (pthread_create(&pool->threads[pool->count], NULL, spinner, sd) != 0) {
+                perror("pthread_create spinner");
+                return -1;
+            }
+            pool->count++;
+        }
+    }
+    free(cpus);
+
+    return pool->count;
+}
+
+void spinners_stop(spinner_pool_t *pool) {
+    pool->stop = 1;
+    __sync_synchronize();
+    syscall(SYS_futex, &pool->stop, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+
+    for (int i = 0; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    free(pool->data);
+    pool->threads = NULL;
+    pool->data = NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Reporting                                                                */
+/* ------------------------------------------------------------------------ */
+
+void print_rule(void) {
+    printf("========================================\n");
+}
+
+void print_banner(const char *title) {
+    print_rule();
+    printf("%s\n", title);
+    print_rule();
+}
+
+void print_page_layout(size_t size) {
+    size_t page = region_page_size();
+    const char *table = page == PAGE_SIZE_4K ? "PTE" : page == PMD_SIZE ? "PMD" : "PUD";
+
+    printf("Page size: %zu KB (%s)\n", page / 1024, page_mode_name());
+    printf("Pages in region: %zu\n", size / page);
+    printf("Page-tables covered: %zu (%s level)\n",
+           (size + (PT_ENTRIES * page - 1)) / (PT_ENTRIES * page), table);
+}
+
+void print_slice_layout(const slice_region_t *sr, int nslices) {
+    printf("Shared region: %d slices of %zu KB in one %zu KB mapping\n",
+           nslices, sr->slice / 1024, sr->len / 1024);
+    printf("Slice stride: %zu KB", sr->stride / 1024);
+    if (sr->stride < PMD_SIZE)
+        printf(" (%zu slices per PMD / page-table page)\n", PMD_SIZE / sr->stride);
+    else
+        printf(" (each slice under its own PMD)\n");
+}
+
+void report_workers(const worker_data_t *data, int n,
+                    uint64_t *total_ops, double *max_time) {
+    *total_ops = 0;
+    *max_time = 0;
+
+    for (int i = 0; i < n; i++) {
+        printf("Node %d CPU %d: %.3f sec, %lu ops\n", data[i].node, data[i].cpu,
+               data[i].elapsed_sec, (unsigned long)data[i].ops);
+        *total_ops += data[i].ops;
+        if (data[i].elapsed_sec > *max_time)
+            *max_time = data[i].elapsed_sec;
+    }
+}
+
+typedef struct {
+    int threads;
+    uint64_t ops;
+    double max_time;
+    double sum_rate;
+} node_total_t;
+
+static node_total_t *sum_by_node(const worker_data_t *data, int n, int num_nodes) {
+    node_total_t *t = calloc(num_nodes, sizeof(*t));
+
+    if (!t)
+        return NULL;
+    for (int i = 0; i < n; i++) {
+        node_total_t *nt = &t[data[i].node];
+
+        nt->threads++;
+        nt->ops += data[i].ops;
+        if (data[i].elapsed_sec > nt->max_time)
+            nt->max_time = data[i].elapsed_sec;
+        if (data[i].elapsed_sec > 0)
+            nt->sum_rate += data[i].ops / data[i].elapsed_sec;
+    }
+    return t;
+}
+
+void report_nodes(const worker_data_t *data, int n, int num_nodes) {
+    node_total_t *t = sum_by_node(data, n, num_nodes);
+
+    if (!t)
+        return;
+
+    printf("Per-node totals:\n");
+    printf("  %-6s %8s %12s %14s %10s\n", "node", "threads", "ops", "ops/sec", "us/op");
+    for (int node = 0; node < num_nodes; node++) {
+        if (t[node].threads == 0)
+            continue;
+        printf("  %-6d %8d %12lu %14.0f %10.2f\n", node, t[node].threads,
+               (unsigned long)t[node].ops, t[node].sum_rate,
+               t[node].sum_rate > 0 ? t[node].threads * 1e6 / t[node].sum_rate : 0);
+    }
+    free(t);
+}
+
+void latency_merge(const worker_data_t *data, int n, int slot, hist_t *out) {
+    hist_reset(out);
+    for (int i = 0; i < n; i++) {
+        hist_merge(out, &data[i].lat[slot]);
+    }
+}
+
+void report_latency(const worker_data_t *data, int n,
+                    const char *const names[LAT_SLOTS]) {
+    hist_t *merged = malloc(sizeof(*merged));
+
+    if (!merged) {
+        perror("malloc");
+        return;
+    }
+
+    printf("Latency per call (us, timer overhead %lu ns):\n",
+           (unsigned long)timer_overhead_ns());
+    printf("  %-12s %10s %9s %9s %9s %9s %9s\n",
+           "op", "calls", "mean", "p50", "p99", "p99.9", "max");
+
+    for (int slot = 0; slot < LAT_SLOTS; slot++) {
+        if (!names[slot])
+            continue;
+
+        latency_merge(data, n, slot, merged);
+        if (merged->count == 0)
+            continue;
+
+        printf("  %-12s %10lu %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+               names[slot], (unsigned long)merged->count,
+               hist_mean(merged) / 1e3,
+               hist_percentile(merged, 50.0) / 1e3,
+               hist_percentile(merged, 99.0) / 1e3,
+               hist_percentile(merged, 99.9) / 1e3,
+               merged->max / 1e3);
+    }
+
+    free(merged);
+}
+
+void rec_workers(const worker_data_t *data, int n) {
+    rec_array("workers");
+    for (int i = 0; i < n; i++) {
+        rec_object(NULL);
+        rec_int("id", data[i].id);
+        rec_int("node", data[i].node);
+        rec_int("cpu", data[i].cpu);
+        rec_int("ops", (long long)data[i].ops);
+        rec_double("elapsed_sec", data[i].elapsed_sec);
+        rec_double("ops_per_sec", data[i].elapsed_sec > 0 ?
+                   data[i].ops / data[i].elapsed_sec : 0);
+        rec_close();
+    }
+    rec_close();
+}
+
+void rec_nodes(const worker_data_t *data, int n, int num_nodes) {
+    node_total_t *t = sum_by_node(data, n, num_nodes);
+
+    if (!t)
+        return;
+
+    rec_array("nodes");
+    for (int node = 0; node < num_nodes; node++) {
+        if (t[node].threads == 0)
+            continue;
+        rec_object(NULL);
+        rec_int("node", node);
+        rec_int("threads", t[node].threads);
+        rec_int("ops", (long long)t[node].ops);
+        rec_double("max_elapsed_sec", t[node].max_time);
+        rec_double("ops_per_sec", t[node].sum_rate);
+        rec_close();
+    }
+    rec_close();
+    free(t);
+}
+
+void rec_latency(const worker_data_t *data, int n,
+                 const char *const names[LAT_SLOTS]) {
+    hist_t *merged = malloc(sizeof(*merged));
+
+    if (!merged)
+        return;
+
+    rec_object("latency_us");
+    for (int slot = 0; slot < LAT_SLOTS; slot++) {
+        if (!names[slot])
+            continue;
+        latency_merge(data, n, slot, merged);
+        if (merged->count == 0)
+            continue;
+
+        rec_object(names[slot]);
+        rec_int("calls", (long long)merged->count);
+        rec_double("mean", hist_mean(merged) / 1e3);
+        rec_double("p50", hist_percentile(merged, 50.0) / 1e3);
+        rec_double("p99", hist_percentile(merged, 99.0) / 1e3);
+        rec_double("p999", hist_percentile(merged, 99.9) / 1e3);
+        rec_double("max", merged->max / 1e3);
+        rec_close();
+    }
+    rec_close();
+    free(merged);
+}
+
+/* Counter totals over n workers; returns the events valid in all of them */
+static unsigned perf_sum(const worker_data_t *data, int n, uint64_t *sum, uint64_t *ops) {
+    unsigned valid = n > 0 ? ~0u : 0;
+
+    memset(sum, 0, PERF_EVENTS * sizeof(*sum));
+    *ops = 0;
+    for (int i = 0; i < n; i++) {
+        for (int ev = 0; ev < PERF_EVENTS; ev++) {
+            sum[ev] += data[i].perf.count[ev];
+        }
+        valid &= data[i].perf.valid;
+        *ops += data[i].ops;
+    }
+    return valid;
+}
+
+/* IPIs per node from the per-CPU trial counts; NULL if none were counted */
+static uint64_t *ipis_by_node(int num_nodes) {
+    uint64_t *per_node;
+
+    if (perf_trial_ncpus() == 0)
+        return NULL;
+    per_node = calloc(num_nodes, sizeof(*per_node));
+    if (!per_node)
+        return NULL;
+    for (int cpu = 0; cpu < perf_trial_ncpus(); cpu++) {
+        int node = numa_node_of_cpu(cpu);
+
+        if (node >= 0 && node < num_nodes)
+            per_node[node] += perf_trial_ipis(cpu);
+    }
+    return per_node;
+}
+
+void report_perf(const worker_data_t *data, int n, int num_nodes) {
+    uint64_t sum[PERF_EVENTS], ops, *ipis;
+    unsigned valid;
+
+    if (!perf_enabled())
+        return;
+
+    valid = perf_sum(data, n, sum, &ops);
+    printf("Perf counters (workers, timed loop%s):\n",
+           perf_user_only() ? ", user mode only" : "");
+    printf("  %-18s %16s %12s\n", "event", "total", "per op");
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (!(valid & (1u << ev))) {
+            printf("  %-18s %16s %12s\n", perf_event_name(ev), "n/a", "");
+            continue;
+        }
+        printf("  %-18s %16lu %12.2f\n", perf_event_name(ev), (unsigned long)sum[ev],
+               ops ? (double)sum[ev] / ops : 0);
+    }
+    if ((valid & (1u << PERF_CYCLES)) && (valid & (1u << PERF_INSTRUCTIONS)) && sum[PERF_CYCLES])
+        printf("  IPC: %.2f\n", (double)sum[PERF_INSTRUCTIONS] / sum[PERF_CYCLES]);
+
+    ipis = ipis_by_node(num_nodes);
+    if (!ipis) {
+        printf("Call-function IPIs: n/a (irq_vectors tracepoints not available)\n");
+        return;
+    }
+    printf("Call-function IPIs received during the trial:\n");
+    for (int node = 0; node < num_nodes; node++) {
+        if (topo_cpus(node) == 0)
+            continue;
+        printf("  node %-3d %12lu %12.2f per op\n", node, (unsigned long)ipis[node],
+               ops ? (double)ipis[node] / ops : 0);
+    }
+    free(ipis);
+}
+
+void rec_perf(const worker_data_t *data, int n, int num_nodes) {
+    uint64_t sum[PERF_EVENTS], ops, *ipis;
+    unsigned valid;
+
+    if (!perf_enabled())
+        return;
+
+    valid = perf_sum(data, n, sum, &ops);
+    rec_object("perf");
+    rec_int("user_only", perf_user_only());
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (!(valid & (1u << ev)))
+            continue;
+        rec_object(perf_event_name(ev));
+        rec_int("total", (long long)sum[ev]);
+        rec_double("per_op", ops ? (double)sum[ev] / ops : 0);
+        rec_close();
+    }
+    ipis = ipis_by_node(num_nodes);
+    if (ipis) {
+        rec_array("ipis_per_node");
+        for (int node = 0; node < num_nodes; node++) {
+            rec_int(NULL, (long long)ipis[node]);
+        }
+        rec_close();
+        free(ipis);
+    }
+    rec_close();
+}
+
+/* Per-node view of the worker series, folded to one width */
+typedef struct {
+    int buckets;        /* full buckets every worker covered */
+    uint64_t width_ns;
+    int *threads;       /* per node */
+    double *total;      /* per node, ops/sec per thread over the whole run */
+    double *rate;       /* [node * SERIES_BUCKETS + b], ops/sec per thread */
+} fairness_t;
+
+static void fairness_free(fairness_t *f) {
+    free(f->threads);
+    free(f->total);
+    free(f->rate);
+}
+
+static int fairness_collect(fairness_t *f, const worker_data_t *data, int n, int num_nodes) {
+    node_total_t *t;
+    series_t s;
+
+    memset(f, 0, sizeof(*f));
+    for (int i = 0; i < n; i++) {
+        if (data[i].series.width_ns > f->width_ns)
+            f->width_ns = data[i].series.width_ns;
+    }
+    t = sum_by_node(data, n, num_nodes);
+    f->threads = calloc(num_nodes, sizeof(int));
+    f->total = calloc(num_nodes, sizeof(double));
+    f->rate = calloc((size_t)num_nodes * SERIES_BUCKETS, sizeof(double));
+    if (!t || !f->threads || !f->total || !f->rate || !f->width_ns) {
+        free(t);
+        fairness_free(f);
+        return -1;
+    }
+
+    f->buckets = SERIES_BUCKETS;
+    for (int i = 0; i < n; i++) {
+        int full;
+
+        s = data[i].series;
+        series_fold(&s, f->width_ns);
+        full = (int)(data[i].elapsed_sec * 1e9 / f->width_ns);
+        if (full < f->buckets)
+            f->buckets = full;
+        for (int b = 0; b < SERIES_BUCKETS; b++) {
+            f->rate[data[i].node * SERIES_BUCKETS + b] += s.ops[b];
+        }
+    }
+
+    for (int node = 0; node < num_nodes; node++) {
+        f->threads[node] = t[node].threads;
+        if (!t[node].threads)
+            continue;
+        f->total[node] = t[node].sum_rate / t[node].threads;
+        for (int b = 0; b < SERIES_BUCKETS; b++) {
+            f->rate[node * SERIES_BUCKETS + b] *= 1e9 / f->width_ns / t[node].threads;
+        }
+    }
+    free(t);
+    return 0;
+}
+
+/* Jain's index of x over the nodes with threads: 1 when all are equal, 1/k at worst */
+static double jain_index(const double *x, size_t step, const int *threads, int num_nodes) {
+    double sum = 0, sumsq = 0;
+    int k = 0;
+
+    for (int node = 0; node < num_nodes; node++) {
+        double v = x[node * step];
+
+        if (!threads[node])
+            continue;
+        sum += v;
+        sumsq += v * v;
+        k++;
+    }
+    return sumsq > 0 ? sum * sum / (k * sumsq) : 1.0;
+}
+
+/* Coefficient of variation of one node's rate across the full buckets */
+static double bucket_cv(const fairness_t *f, int node) {
+    const double *r = &f->rate[node * SERIES_BUCKETS];
+    double mean = 0, var = 0;
+
+    if (f->buckets < 2)
+        return 0;
+    for (int b = 0; b < f->buckets; b++) {
+        mean += r[b];
+    }
+    mean /= f->buckets;
+    for (int b = 0; b < f->buckets; b++) {
+        var += (r[b] - mean) * (r[b] - mean);
+    }
+    var /= f->buckets - 1;
+    return mean > 0 ? sqrt(var) / mean : 0;
+}
+
+static double worst_bucket_jain(const fairness_t *f, int num_nodes) {
+    double worst = 1.0;
+
+    for (int b = 0; b < f->buckets; b++) {
+        double j = jain_index(&f->rate[b], SERIES_BUCKETS, f->threads, num_nodes);
+        if (j < worst)
+            worst = j;
+    }
+    return worst;
+}
+
+static int slowest_node(const fairness_t *f, int num_nodes) {
+    int slow = -1;
+
+    for (int node = 0; node < num_nodes; node++) {
+        if (f->threads[node] && (slow < 0 || f->total[node] < f->total[slow]))
+            slow = node;
+    }
+    return slow;
+}
+
+static double mean_total(const fairness_t *f, int num_nodes) {
+    double sum = 0;
+    int k = 0;
+
+    for (int node = 0; node < num_nodes; node++) {
+        if (f->threads[node]) {
+            sum += f->total[node];
+            k++;
+        }
+    }
+    return k ? sum / k : 0;
+}
+
+void report_fairness(const worker_data_t *data, int n, int num_nodes) {
+    fairness_t f;
+    int slow;
+
+    if (fairness_collect(&f, data, n, num_nodes) != 0)
+        return;
+
+    printf("Fairness across nodes (ops/sec per thread, %.0f ms buckets, %d full):\n",
+           f.width_ns / 1e6, f.buckets);
+    printf("  Jain's index: %.4f over the run", jain_index(f.total, 1, f.threads, num_nodes));
+    if (f.buckets > 0)
+        printf(", %.4f in the worst bucket", worst_bucket_jain(&f, num_nodes));
+    printf(" (1 = all nodes equal)\n");
+    ab_report_metric("fairness (Jain's index)", jain_index(f.total, 1, f.threads, num_nodes), 1);
+    printf("  %-6s %14s %8s %14s %14s\n", "node", "ops/sec", "CV", "min bucket", "max bucket");
+    for (int node = 0; node < num_nodes; node++) {
+        const double *r = &f.rate[node * SERIES_BUCKETS];
+        double lo = 0, hi = 0;
+
+        if (!f.threads[node])
+            continue;
+        for (int b = 0; b < f.buckets; b++) {
+            if (b == 0 || r[b] < lo)
+                lo = r[b];
+            if (b == 0 || r[b] > hi)
+                hi = r[b];
+        }
+        printf("  %-6d %14.0f %7.1f%% %14.0f %14.0f\n", node, f.total[node],
+               100.0 * bucket_cv(&f, node), lo, hi);
+    }
+    slow = slowest_node(&f, num_nodes);
+    if (slow >= 0 && mean_total(&f, num_nodes) > 0)
+        printf("  Slowest node: %d (%.2fx the node mean)\n", slow,
+               f.total[slow] / mean_total(&f, num_nodes));
+    if (f.buckets < 2)
+        printf("  Run shorter than two buckets; lower --bucket-ms for the CV\n");
+
+    if (opt_timeseries && f.buckets > 0) {
+        char name[32];
+
+        printf("\nPer-node ops/sec per thread over time:\n");
+        printf("  %8s", "t (ms)");
+        for (int node = 0; node < num_nodes; node++) {
+            if (!f.threads[node])
+                continue;
+            snprintf(name, sizeof(name), "node %d", node);
+            printf(" %12s", name);
+        }
+        printf("\n");
+        for (int b = 0; b < f.buckets; b++) {
+            printf("  %8.0f", b * f.width_ns / 1e6);
+            for (int node = 0; node < num_nodes; node++) {
+                if (f.threads[node])
+                    printf(" %12.0f", f.rate[node * SERIES_BUCKETS + b]);
+            }
+            printf("\n");
+        }
+    }
+    fairness_free(&f);
+}
+
+void rec_fairness(const worker_data_t *data, int n, int num_nodes) {
+    fairness_t f;
+
+    if (fairness_collect(&f, data, n, num_nodes) != 0)
+        return;
+
+    rec_object("fairness");
+    rec_double("bucket_ms", f.width_ns / 1e6);
+    rec_int("buckets", f.buckets);
+    rec_double("jain", jain_index(f.total, 1, f.threads, num_nodes));
+    rec_double("jain_worst_bucket", f.buckets > 0 ? worst_bucket_jain(&f, num_nodes) : NAN);
+    rec_int("slowest_node", slowest_node(&f, num_nodes));
+    rec_array("nodes");
+    for (int node = 0; node < num_nodes; node++) {
+        if (!f.threads[node])
+            continue;
+        rec_object(NULL);
+        rec_int("node", node);
+        rec_double("ops_per_sec_per_thread", f.total[node]);
+        rec_double("cv", f.buckets >= 2 ? bucket_cv(&f, node) : NAN);
+        if (opt_timeseries) {
+            rec_array("series");
+            for (int b = 0; b < f.buckets; b++) {
+                rec_double(NULL, f.rate[node * SERIES_BUCKETS + b]);
+            }
+            rec_close();
+        }
+        rec_close();
+    }
+    rec_close();
+    rec_close();
+    fairness_free(&f);
+}
+
+void report_ab_metrics(const worker_data_t *data, int n,
+                       const char *const names[LAT_SLOTS],
+                       double ops_per_sec, double us_per_op) {
+    hist_t *merged;
+    char name[64];
+
+    ab_report_metric("throughput (ops/sec)", ops_per_sec, 1);
+    ab_report_metric("latency per op (us)", us_per_op, 0);
+
+    merged = malloc(sizeof(*merged));
+    if (!merged)
+        return;
+    for (int slot = 0; slot < LAT_SLOTS; slot++) {
+        if (!names[slot])
+            continue;
+        latency_merge(data, n, slot, merged);
+        if (merged->count == 0)
+            continue;
+        snprintf(name, sizeof(name), "p99 %s (us)", names[slot]);
+        ab_report_metric(name, hist_percentile(merged, 99.0) / 1e3, 0);
+    }
+    free(merged);
+}
@@ -0,0 +1,570 @@
+/*
+ * harness.h - Shared benchmark harness
+ *
+ * Topology discovery, thread pinning, start barrier, timing and result
+ * reporting used by every Hydra microbenchmark, so that all of them measure
+ * through the same code path.
+ *
+ * Build: ./compileall.sh compiles every common/ source into each benchmark.
+ */
+
+#ifndef HYDRA_HARNESS_H
+#define HYDRA_HARNESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "hist.h"
+#include "perf.h"
+#include "series.h"
+#include "topology.h"
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+#define CACHE_LINE 64
+
+/* ------------------------------------------------------------------------ */
+/* Thread state                                                             */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Reusable start barrier. Threads arrive and spin until main bumps the
+ * generation, so the same barrier can gate several phases of a run. The
+ * generation is replicated, one cache line per node, so waiters only spin
+ * on a line shared with their own node and main releases every node with
+ * one store each instead of all of them pulling one line across sockets.
+ * Each waiter also notes when it left, which gives the start skew.
+ */
+#define BARRIER_NODES 64
+
+typedef struct {
+    volatile int go;
+    char pad[CACHE_LINE - sizeof(int)];
+    volatile uint64_t first_ns;  /* earliest waiter of the node to leave, 0 if none */
+    volatile uint64_t last_ns;
+} __attribute__((aligned(CACHE_LINE))) barrier_node_t;
+
+typedef struct {
+    volatile int ready_count;
+    uint64_t release_ns;
+    barrier_node_t node[BARRIER_NODES];
+} __attribute__((aligned(CACHE_LINE))) start_barrier_t;
+
+/*
+ * Per-operation latency slots in worker_data_t.lat. The mprotect loops use
+ * the first two; other workloads name the slots themselves.
+ */
+enum {
+    LAT_RW_TO_RO = 0,
+    LAT_RO_TO_RW = 1,
+    LAT_SLOTS = 8
+};
+
+/* Cache-line aligned so the hot counters of neighbours in an array never share a line */
+typedef struct {
+    int id;
+    int node;
+    int cpu;
+    void *region;
+    double elapsed_sec;
+    uint64_t ops;
+    start_barrier_t *barrier;
+    hist_t lat[LAT_SLOTS];  /* ns per call, owned by this worker */
+    perf_counters_t perf;   /* --perf, around the timed loop */
+    series_t series;        /* ops per --bucket-ms of the timed loop */
+} __attribute__((aligned(CACHE_LINE))) worker_data_t;
+
+/*
+ * What a spinner does on its remote CPU (--spinner-mode). pause keeps the
+ * CPU awake without touching memory; touch walks a private working set so
+ * the CPU holds live TLB entries for the mm; futex blocks in short timed
+ * waits; idle sleeps long enough for deep C-states (lazy TLB mode). mixed
+ * cycles through the four by spinner id.
+ */
+typedef enum {
+    SPIN_PAUSE,
+    SPIN_TOUCH,
+    SPIN_FUTEX,
+    SPIN_IDLE,
+    SPIN_MIXED
+} spinner_mode_t;
+
+typedef struct {
+    int id;
+    int node;
+    int cpu;
+    spinner_mode_t mode;    /* never SPIN_MIXED, resolved per spinner */
+    uint64_t spin_count;    /* loop iterations, pages touched or wakeups */
+    start_barrier_t *barrier;
+    volatile int *stop;
+} __attribute__((aligned(CACHE_LINE))) spinner_data_t;
+
+/* Spinner threads parked on remote nodes for the interference benchmarks */
+typedef struct {
+    int count;
+    pthread_t *threads;
+    spinner_data_t *data;
+    volatile int stop;
+} spinner_pool_t;
+
+/* ------------------------------------------------------------------------ */
+/* Common command line options                                              */
+/* ------------------------------------------------------------------------ */
+
+/* Long-only option ids, above any short option character */
+enum {
+    OPT_AB = 256,
+    OPT_AB_CMD,
+    OPT_AB_BASE_CMD,
+    OPT_FORMAT,
+    OPT_PAGESIZE,
+    OPT_OPS,
+    OPT_DURATION,
+    OPT_TARGET_RSE,
+    OPT_SPINNER_MODE,
+    OPT_SPINNER_WS,
+    OPT_SPINNER_PLACEMENT,
+    OPT_PERF,
+    OPT_PROCESSES,
+    OPT_MEMFD,
+    OPT_BUCKET_MS,
+    OPT_TIMESERIES,
+    OPT_STORE,
+    OPT_LABEL,
+    OPT_COMPARE,
+    OPT_VARIANT,
+    OPT_REGRESS_PCT,
+    OPT_ANTAGONIST,
+    OPT_ANTAGONIST_THREADS,
+    OPT_ANTAGONIST_INTENSITY,
+    OPT_ANTAGONIST_SIZE,
+};
+
+/* Splice into every benchmark's struct option array */
+#define HARNESS_LONG_OPTS \
+    {"ab", required_argument, 0, OPT_AB}, \
+    {"ab-cmd", required_argument, 0, OPT_AB_CMD}, \
+    {"ab-base-cmd", required_argument, 0, OPT_AB_BASE_CMD}, \
+    {"format", required_argument, 0, OPT_FORMAT}, \
+    {"pagesize", required_argument, 0, OPT_PAGESIZE}, \
+    {"ops", required_argument, 0, OPT_OPS}, \
+    {"duration", required_argument, 0, OPT_DURATION}, \
+    {"target-rse", required_argument, 0, OPT_TARGET_RSE}, \
+    {"perf", no_argument, 0, OPT_PERF}, \
+    {"bucket-ms", required_argument, 0, OPT_BUCKET_MS}, \
+    {"timeseries", no_argument, 0, OPT_TIMESERIES}, \
+    {"store", required_argument, 0, OPT_STORE}, \
+    {"label", required_argument, 0, OPT_LABEL}, \
+    {"compare", required_argument, 0, OPT_COMPARE}, \
+    {"variant", required_argument, 0, OPT_VARIANT}, \
+    {"regress-pct", required_argument, 0, OPT_REGRESS_PCT}
+
+/* Spinner options, only for the benchmarks that start spinners */
+#define SPINNER_LONG_OPTS \
+    {"spinner-mode", required_argument, 0, OPT_SPINNER_MODE}, \
+    {"spinner-ws", required_argument, 0, OPT_SPINNER_WS}, \
+    {"spinner-placement", required_argument, 0, OPT_SPINNER_PLACEMENT}
+
+/* Worker process options, only for the benchmarks that can fork their workers */
+#define PROCESS_LONG_OPTS \
+    {"processes", no_argument, 0, OPT_PROCESSES}, \
+    {"memfd", no_argument, 0, OPT_MEMFD}
+
+/* Background load options, only for the benchmarks that start antagonists */
+#define ANTAGONIST_LONG_OPTS \
+    {"antagonist", required_argument, 0, OPT_ANTAGONIST}, \
+    {"antagonist-threads", required_argument, 0, OPT_ANTAGONIST_THREADS}, \
+    {"antagonist-intensity", required_argument, 0, OPT_ANTAGONIST_INTENSITY}, \
+    {"antagonist-size", required_argument, 0, OPT_ANTAGONIST_SIZE}
+
+/* Returns 0 if opt was a harness option, -1 if unknown or invalid */
+int harness_parse_opt(int opt, const char *arg);
+
+/* Usage lines for the harness options, appended to each print_usage() */
+void harness_print_usage(void);
+void spinner_print_usage(void);
+void process_print_usage(void);
+
+/* ------------------------------------------------------------------------ */
+/* Topology and pinning                                                     */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Check libnuma, read the topology and return the number of nodes the
+ * benchmarks iterate over, or -1 if NUMA is missing. Memory-only nodes
+ * past the last node with CPUs are left out (see topology.h).
+ */
+int harness_init(void);
+
+/* index-th CPU of a node, or -1 if the node has fewer CPUs */
+int get_cpu_for_node(int node, int index);
+
+/* Number of CPUs on a node */
+int node_cpu_count(int node);
+
+/*
+ * Order in which a node's CPUs are handed out. compact is CPU number
+ * order; scatter takes one hardware thread of every physical core before
+ * any sibling; smt fills all siblings of a core before the next core.
+ */
+typedef enum {
+    PLACE_COMPACT,
+    PLACE_SCATTER,
+    PLACE_SMT
+} cpu_placement_t;
+
+const char *placement_name(cpu_placement_t p);
+
+/* CPUs of a node in placement order; returns how many were stored */
+int node_cpus_ordered(int node, cpu_placement_t p, int *cpus, int max);
+
+/* Parse "0,2,5" into at most max ints; returns the count or -1 */
+int parse_int_list(const char *s, int *out, int max);
+
+/*
+ * Give worker i a CPU on nodes[i], taking successive CPUs of a node that
+ * is listed more than once. Returns 0, or -1 if a node runs out of CPUs.
+ */
+int workers_place(worker_data_t *data, const int *nodes, int n);
+
+/* Pin the calling thread; both return the CPU used, or -1 on failure */
+int pin_to_cpu(int cpu);
+int pin_to_node(int node);
+
+/* ------------------------------------------------------------------------ */
+/* Start barrier                                                            */
+/* ------------------------------------------------------------------------ */
+
+/* Thread side: signal ready and wait for the next release */
+void barrier_arrive_and_wait(start_barrier_t *b);
+
+/* Main side: wait until expected threads arrived, then let them go */
+void barrier_wait_ready(start_barrier_t *b, int expected);
+void barrier_release(start_barrier_t *b);
+
+/*
+ * Start skew of the last release: how long after it the last waiter left,
+ * and the spread between the first and last one, overall and per node.
+ */
+void print_start_skew(const start_barrier_t *b);
+void rec_start_skew(const start_barrier_t *b);
+
+/* ------------------------------------------------------------------------ */
+/* Worker processes                                                         */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With --processes every worker is a forked child instead of a thread, so
+ * each has its own mm and its flushes only target the CPUs that process
+ * ran on; with threads they target every CPU in the one shared mm's
+ * cpumask. Comparing the two separates the gain of a narrower cpumask
+ * from the gain of replication. Anything a child writes for the parent
+ * (worker data, the start barrier) must come from shared_calloc().
+ *
+ * --memfd backs slice_region_map() with one MAP_SHARED memfd instead of
+ * private anonymous memory, so forked workers still share their data
+ * pages (the multi-process deployment shape) while each keeps its own
+ * page tables.
+ */
+typedef struct {
+    pthread_t thread;
+    pid_t pid;  /* --processes */
+} worker_handle_t;
+
+int worker_processes(void);
+int region_memfd(void);
+
+/* "threads" or "processes" */
+const char *worker_mode_name(void);
+
+/* Run fn(arg) in a new thread or child process; returns 0 or -1 */
+int worker_start(worker_handle_t *h, void *(*fn)(void *), void *arg);
+void worker_join(worker_handle_t *h);
+
+/* Zeroed, cache-line aligned array; release with free() */
+void *aligned_calloc(size_t n, size_t size);
+
+/*
+ * Zeroed memory visible to --processes children: MAP_SHARED anonymous,
+ * else aligned_calloc()
+ */
+void *shared_calloc(size_t n, size_t size);
+void shared_free(void *p, size_t n, size_t size);
+
+/* ------------------------------------------------------------------------ */
+/* Timing                                                                   */
+/* ------------------------------------------------------------------------ */
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Minimum cost of a back-to-back now_ns() pair, included in every sample */
+uint64_t timer_overhead_ns(void);
+
+/*
+ * Timed loop bodies are written once as HOT_INLINE functions taking the
+ * operation, page size or timing mode as arguments, and instantiated with
+ * constants by a small dispatcher. Each copy then carries no mode branches
+ * or reloads between its timestamps, only the syscall itself.
+ */
+#define HOT_INLINE static inline __attribute__((always_inline))
+
+/* ------------------------------------------------------------------------ */
+/* Run length                                                               */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * How long a timed loop runs: a fixed iteration count (--ops, or the
+ * benchmark's default), a wall-clock budget (--duration), or a count picked
+ * by a calibration pilot to reach a relative standard error (--target-rse).
+ * Duration runs read the clock once per RUN_CHECK_BATCH iterations only.
+ */
+#define RUN_CHECK_BATCH 64
+#define RUN_PILOT_ITERS 1000
+#define RUN_MAX_ITERS   100000000ULL
+
+typedef struct {
+    uint64_t iters;        /* 0 with a deadline */
+    uint64_t deadline_ns;
+} run_budget_t;
+
+/* Budget starting now; default_ops applies without --ops/--duration */
+run_budget_t run_budget(int default_ops);
+run_budget_t run_budget_fixed(uint64_t iters);
+
+/* Time-bound by default: acts as --duration sec unless a run length was given */
+void run_default_duration(double sec);
+
+static inline int run_budget_more(const run_budget_t *b, uint64_t i) {
+    if (!b->deadline_ns)
+        return i < b->iters;
+    return (i & (RUN_CHECK_BATCH - 1)) != 0 || now_ns() < b->deadline_ns;
+}
+
+/* run_budget_more() for a HOT_INLINE body specialized on the budget kind */
+HOT_INLINE int run_budget_more_as(const run_budget_t *b, uint64_t i, int deadline) {
+    if (!deadline)
+        return i < b->iters;
+    return (i & (RUN_CHECK_BATCH - 1)) != 0 || now_ns() < b->deadline_ns;
+}
+
+/*
+ * Calibration: with --target-rse each worker runs a pilot before arriving
+ * at the barrier and passes its samples to run_calibrate_report(), which
+ * resets the worker's stats. Every worker then runs the largest count any
+ * worker asked for. samples_per_iter is the number of slot samples one
+ * loop iteration records.
+ */
+int run_calibrating(void);
+void run_calibrate_reset(void);
+void run_calibrate_report(worker_data_t *data, int slot, uint64_t samples_per_iter);
+
+/*
+ * The request half of run_calibrate_report(), without the reset, for
+ * workers that size the run from several slots. samples_per_iter may be a
+ * fraction, e.g. for a slot only some iterations record into.
+ */
+void run_calibrate_need(const worker_data_t *data, int slot, double samples_per_iter);
+
+/* Iterations per worker, or 0 for duration runs (valid after calibration) */
+uint64_t run_ops(int default_ops);
+
+/* Config line and record fields describing the run length */
+void print_run_budget(const char *label, int default_ops);
+void print_run_calibration(int default_ops);  /* no-op without --target-rse */
+void rec_run_budget(int default_ops);
+
+/* ------------------------------------------------------------------------ */
+/* Workloads                                                                */
+/* ------------------------------------------------------------------------ */
+
+#define PAGE_SIZE_4K 4096UL
+#define PMD_SIZE     (2UL << 20)
+#define PUD_SIZE     (1UL << 30)
+#define PT_ENTRIES   512
+
+/*
+ * Backing page size for every region the harness maps (--pagesize). THP
+ * maps 4K pages with MADV_HUGEPAGE on a 2MB aligned range; 2m and 1g use
+ * hugetlbfs (MAP_HUGETLB) and need pages reserved in nr_hugepages.
+ */
+typedef enum {
+    PAGE_4K,
+    PAGE_THP,
+    PAGE_2M,
+    PAGE_1G
+} page_mode_t;
+
+page_mode_t page_mode(void);
+const char *page_mode_name(void);
+
+/* Switch mode by --pagesize name; returns -1 if unknown. Maps made earlier keep theirs */
+int set_page_mode(const char *arg);
+
+/* Size of one leaf mapping: 4K, or 2M for THP and hugetlb 2m, or 1G */
+size_t region_page_size(void);
+
+/* Round a region or stride up to whole pages of the current mode */
+static inline size_t region_round(size_t size) {
+    return (size + region_page_size() - 1) / region_page_size() * region_page_size();
+}
+
+/* mmap flags and post-mmap advice for the current mode */
+int region_mmap_flags(void);
+void *region_map_at(void *hint, size_t size, int extra_flags);
+
+static inline size_t align_up(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+/* Parse "64", "64k", "2m", "1g" into bytes; returns 0 if malformed */
+size_t parse_size(const char *s);
+
+/*
+ * mmap an anonymous RW region in the current page mode and fault it in on
+ * the calling thread's node; size must already be region_round()ed.
+ */
+void *region_alloc(size_t size);
+void region_free(void *region, size_t size);
+
+/* region_alloc() without the fault-in, for callers that set a policy first */
+void *region_map(size_t size);
+
+/*
+ * One anonymous mapping carved into per-thread slices, so all workers
+ * mprotect parts of the same VMA (VMA splits/merges, mmap_lock contention,
+ * shared page-table pages). Slice i starts at base + i * stride and the
+ * base is PMD aligned, so a stride below PMD_SIZE packs several slices
+ * under one page-table page while a PMD-multiple stride gives each slice
+ * its own. Slices are not touched here; each worker faults in its own.
+ * With --memfd the mapping is MAP_SHARED over a memfd instead.
+ */
+typedef struct {
+    char *base;
+    size_t len;
+    size_t slice;
+    size_t stride;
+} slice_region_t;
+
+/*
+ * Effective stride: at least one slice, rounded to whole pages of the
+ * current mode, and to a PMD multiple when align_pmd is set. A stride of 0
+ * means adjacent slices.
+ */
+size_t slice_stride_for(size_t slice, size_t stride, int align_pmd);
+
+int slice_region_map(slice_region_t *sr, int nslices, size_t slice, size_t stride);
+void slice_region_unmap(slice_region_t *sr);
+
+static inline void *slice_region_get(const slice_region_t *sr, int i) {
+    return sr->base + (size_t)i * sr->stride;
+}
+
+/* Clear ops, elapsed time and latency slots, e.g. after a warmup phase */
+void worker_reset_stats(worker_data_t *data);
+
+/* Bucket width of worker_data_t.series (--bucket-ms, default 10 ms) */
+uint64_t series_bucket_ns(void);
+
+/*
+ * Timed RW->RO->RW mprotect loop over data->region. Each iteration is two
+ * mprotect calls, each of which triggers a TLB shootdown; every call is
+ * recorded in data->lat[LAT_RW_TO_RO] or data->lat[LAT_RO_TO_RW].
+ */
+void run_mprotect_toggle(worker_data_t *data, size_t size, run_budget_t budget);
+
+/*
+ * Open-loop variant: one mprotect (alternating RO and RW) is due every
+ * 1/rate seconds, on a fixed grid or with Poisson (exponential) gaps. A
+ * call that falls behind schedule is issued at once, never skipped, and
+ * its LAT_RESPONSE sample counts from the due time, so queueing delay is
+ * not hidden (no coordinated omission). LAT_SERVICE is the call alone.
+ */
+enum {
+    LAT_RESPONSE = 0,
+    LAT_SERVICE = 1
+};
+
+void run_mprotect_open_loop(worker_data_t *data, size_t size, run_budget_t budget,
+                            double rate, int poisson);
+
+const char *spinner_mode_name(spinner_mode_t mode);
+spinner_mode_t spinner_mode(void);
+size_t spinner_working_set(void);
+
+cpu_placement_t spinner_placement(void);
+
+/*
+ * Start per_node spinners, in --spinner-placement order, on every node
+ * whose bit is clear in exclude_nodes (bit n = node n).
+ */
+int spinners_start(spinner_pool_t *pool, start_barrier_t *b,
+                   int num_nodes, unsigned long exclude_nodes, int per_node);
+void spinners_stop(spinner_pool_t *pool);
+
+/* ------------------------------------------------------------------------ */
+/* Reporting                                                                */
+/* ------------------------------------------------------------------------ */
+
+void print_rule(void);
+void print_banner(const char *title);
+
+/* Config lines for page size, page count and leaf page tables of a region */
+void print_page_layout(size_t size);
+
+/* Config lines describing a slice_region_t layout */
+void print_slice_layout(const slice_region_t *sr, int nslices);
+
+/* Print one line per worker and return total ops and the slowest worker */
+void report_workers(const worker_data_t *data, int n,
+                    uint64_t *total_ops, double *max_time);
+
+/* Aggregate workers by node: thread count, ops, ops/sec and us/op per node */
+void report_nodes(const worker_data_t *data, int n, int num_nodes);
+
+/*
+ * Merge the latency slots of n workers and print p50/p99/p99.9 per slot.
+ * names[i] labels slot i; slots with a NULL name or no samples are skipped.
+ */
+void report_latency(const worker_data_t *data, int n,
+                    const char *const names[LAT_SLOTS]);
+
+/* Merge latency slot of n workers into out */
+void latency_merge(const worker_data_t *data, int n, int slot, hist_t *out);
+
+/* Record helpers: "workers"/"nodes" arrays and a "latency" object (see report.h) */
+void rec_workers(const worker_data_t *data, int n);
+void rec_nodes(const worker_data_t *data, int n, int num_nodes);
+void rec_latency(const worker_data_t *data, int n,
+                 const char *const names[LAT_SLOTS]);
+
+/*
+ * --perf counters summed over n workers, as totals and per op, followed by
+ * the call-function IPIs each node received during the trial. Silent
+ * without --perf.
+ */
+void report_perf(const worker_data_t *data, int n, int num_nodes);
+void rec_perf(const worker_data_t *data, int n, int num_nodes);
+
+/*
+ * Throughput fairness across nodes from the per-worker series: Jain's
+ * index of the per-thread ops/sec of each node over the whole run and in
+ * the worst bucket, each node's coefficient of variation across buckets,
+ * and the slowest node. Only buckets every worker completed are used.
+ * --timeseries adds the per-node ops/sec of every bucket.
+ */
+void report_fairness(const worker_data_t *data, int n, int num_nodes);
+void rec_fairness(const worker_data_t *data, int n, int num_nodes);
+
+/* Report throughput, mean latency and per-slot p99 to an A/B parent */
+void report_ab_metrics(const worker_data_t *data, int n,
+                       const char *const names[LAT_SLOTS],
+                       double ops_per_sec, double us_per_op);
+
+#endif /* HYDRA_HARNESS_H */
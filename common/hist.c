@@ -0,0 +1,98 @@
+/*
+ * hist.c - Log-linear latency histogram
+ *
+ * See hist.h for the bucket layout.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "hist.h"
+
+/* Smallest value that maps to bucket idx, and the bucket width */
+static void bucket_bounds(int idx, uint64_t *low, uint64_t *width) {
+    int shift, sub;
+
+    if (idx < HIST_SUB) {
+        *low = (uint64_t)idx;
+        *width = 1;
+        return;
+    }
+
+    shift = (idx - HIST_SUB) / HIST_SUB;
+    sub = (idx - HIST_SUB) % HIST_SUB;
+    *low = (uint64_t)(HIST_SUB + sub) << shift;
+    *width = 1ull << shift;
+}
+
+void hist_reset(hist_t *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_merge(hist_t *dst, const hist_t *src) {
+    if (src->count == 0)
+        return;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+}
+
+uint64_t hist_percentile(const hist_t *h, double pct) {
+    uint64_t rank, seen = 0;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > h->count)
+        rank = h->count;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t low, width, v;
+
+            bucket_bounds(i, &low, &width);
+            v = low + width / 2;
+            /* The exact extremes are known, never report past them */
+            if (v < h->min)
+                v = h->min;
+            if (v > h->max)
+                v = h->max;
+            return v;
+        }
+    }
+    return h->max;
+}
+
+double hist_mean(const hist_t *h) {
+    return h->count ? (double)h->sum / h->count : 0.0;
+}
+
+double hist_stddev(const hist_t *h) {
+    double mean = hist_mean(h), ss = 0;
+
+    if (h->count < 2)
+        return 0.0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t low, width;
+        double d;
+
+        if (!h->buckets[i])
+            continue;
+        bucket_bounds(i, &low, &width);
+        d = low + width / 2.0 - mean;
+        ss += d * d * h->buckets[i];
+    }
+    return sqrt(ss / (h->count - 1));
+}
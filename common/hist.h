@@ -0,0 +1,60 @@
+/*
+ * hist.h - Log-linear latency histogram
+ *
+ * Each power of two is split into HIST_SUB linear sub-buckets, which bounds
+ * the relative error of a recorded value to 1/HIST_SUB (~3%). Histograms are
+ * owned by a single thread while recording, so no atomics are needed; they
+ * are merged after the threads are joined.
+ */
+
+#ifndef HYDRA_HIST_H
+#define HYDRA_HIST_H
+
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40  /* values above 2^40 ns (~18 min) are clamped */
+#define HIST_BUCKETS (HIST_SUB * (HIST_MAX_BITS - HIST_SUB_BITS + 1))
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} hist_t;
+
+static inline int hist_index(uint64_t v) {
+    int msb, shift, idx;
+
+    if (v < HIST_SUB)
+        return (int)v;
+
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - HIST_SUB_BITS;
+    idx = HIST_SUB + shift * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+    return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+static inline void hist_record(hist_t *h, uint64_t v) {
+    h->buckets[hist_index(v)]++;
+    h->count++;
+    h->sum += v;
+    if (v < h->min || h->count == 1)
+        h->min = v;
+    if (v > h->max)
+        h->max = v;
+}
+
+void hist_reset(hist_t *h);
+void hist_merge(hist_t *dst, const hist_t *src);
+
+/* Value at percentile pct (0-100), or 0 for an empty histogram */
+uint64_t hist_percentile(const hist_t *h, double pct);
+double hist_mean(const hist_t *h);
+
+/* Standard deviation from the bucket midpoints (within ~3% per sample) */
+double hist_stddev(const hist_t *h);
+
+#endif /* HYDRA_HIST_H */
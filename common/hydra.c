@@ -0,0 +1,152 @@
+/*
+ * hydra.c - Snapshots of the Hydra /proc interface
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hydra.h"
+
+static hydra_snapshot_t trial_before, trial_after, trial_delta;
+
+static int is_number(const char *tok) {
+    char *end;
+
+    if (!*tok)
+        return 0;
+    strtoll(tok, &end, 10);
+    return *end == '\0';
+}
+
+static void trim(char *s) {
+    size_t lead = strspn(s, " \t");
+    size_t n;
+
+    memmove(s, s + lead, strlen(s + lead) + 1);
+    n = strlen(s);
+    while (n > 0 && isspace((unsigned char)s[n - 1]))
+        s[--n] = '\0';
+}
+
+int hydra_snapshot(const char *path, hydra_snapshot_t *s) {
+    char line[1024], hdr[1024];
+    FILE *f;
+
+    memset(s, 0, sizeof(*s));
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+
+    while (fgets(line, sizeof(line), f) && s->nrows < HYDRA_MAX_ROWS) {
+        char *colon = strchr(line, ':');
+        char *vals = line, *tok, *save;
+        hydra_row_t row;
+
+        memset(&row, 0, sizeof(row));
+        /* Untouched copy; a header can be longer than any label */
+        snprintf(hdr, sizeof(hdr), "%s", colon ? colon + 1 : line);
+        if (colon) {
+            *colon = '\0';
+            snprintf(row.label, sizeof(row.label), "%.47s", line);
+            vals = colon + 1;
+        }
+
+        /* Without a colon the label is every leading non-numeric word */
+        for (tok = strtok_r(vals, " \t\n,", &save); tok; tok = strtok_r(NULL, " \t\n,", &save)) {
+            if (is_number(tok)) {
+                if (row.ncols < HYDRA_MAX_COLS)
+                    row.val[row.ncols++] = strtoll(tok, NULL, 10);
+            } else if (!colon && row.ncols == 0) {
+                size_t len = strlen(row.label);
+                snprintf(row.label + len, sizeof(row.label) - len, "%s%s",
+                         len ? " " : "", tok);
+            }
+        }
+        trim(row.label);
+
+        if (row.ncols == 0) {
+            /* All-text line: remember it as a column header */
+            int n = 0;
+            char *hsave;
+
+            for (tok = strtok_r(hdr, " \t\n,", &hsave); tok && n < HYDRA_MAX_COLS;
+                 tok = strtok_r(NULL, " \t\n,", &hsave)) {
+                snprintf(s->col_name[n++], sizeof(s->col_name[0]), "%s", tok);
+            }
+            s->ncols_hdr = n;
+            continue;
+        }
+        if (!row.label[0])
+            snprintf(row.label, sizeof(row.label), "row%d", s->nrows);
+        s->rows[s->nrows++] = row;
+    }
+    fclose(f);
+
+    s->available = 1;
+    return 0;
+}
+
+void hydra_delta(const hydra_snapshot_t *before, const hydra_snapshot_t *after,
+                 hydra_snapshot_t *delta) {
+    *delta = *after;
+
+    for (int r = 0; r < delta->nrows; r++) {
+        hydra_row_t *row = &delta->rows[r];
+
+        for (int b = 0; b < before->nrows; b++) {
+            if (strcmp(before->rows[b].label, row->label) != 0)
+                continue;
+            for (int c = 0; c < row->ncols && c < before->rows[b].ncols; c++) {
+                row->val[c] -= before->rows[b].val[c];
+            }
+            break;
+        }
+    }
+}
+
+/* $HYDRA_HISTORY overrides the path, e.g. for kernels exporting elsewhere */
+static const char *history_path(void) {
+    const char *env = getenv("HYDRA_HISTORY");
+    return env ? env : HYDRA_HISTORY;
+}
+
+void hydra_trial_begin(void) {
+    hydra_snapshot(history_path(), &trial_before);
+}
+
+void hydra_trial_end(void) {
+    if (hydra_snapshot(history_path(), &trial_after) != 0 || !trial_before.available) {
+        memset(&trial_delta, 0, sizeof(trial_delta));
+        return;
+    }
+    hydra_delta(&trial_before, &trial_after, &trial_delta);
+}
+
+const hydra_snapshot_t *hydra_trial_delta(void) {
+    return &trial_delta;
+}
+
+void hydra_print_delta(void) {
+    const hydra_snapshot_t *d = &trial_delta;
+
+    if (!d->available)
+        return;
+
+    printf("\nHydra IPI delta (%s):\n", history_path());
+    if (d->ncols_hdr > 0) {
+        printf("  %-20s", "");
+        for (int c = 0; c < d->ncols_hdr; c++) {
+            printf(" %10s", d->col_name[c]);
+        }
+        printf("\n");
+    }
+    for (int r = 0; r < d->nrows; r++) {
+        printf("  %-20s", d->rows[r].label);
+        for (int c = 0; c < d->rows[r].ncols; c++) {
+            printf(" %10lld", d->rows[r].val[c]);
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * hydra.h - Snapshots of the Hydra /proc interface
+ *
+ * /proc/hydra/history is read before and after a trial and the per-node
+ * counters are differenced, so each result record carries the IPIs the
+ * trial caused without resetting the global history.
+ */
+
+#ifndef HYDRA_PROC_H
+#define HYDRA_PROC_H
+
+#define HYDRA_HISTORY "/proc/hydra/history"
+#define HYDRA_MAX_ROWS 32
+#define HYDRA_MAX_COLS 64
+
+/*
+ * One counter row: "label: v0 v1 ..." (or "label v0 v1 ..."). Column names
+ * come from a preceding all-text header line when it has the same width.
+ */
+typedef struct {
+    char label[48];
+    int ncols;
+    long long val[HYDRA_MAX_COLS];
+} hydra_row_t;
+
+typedef struct {
+    int available;
+    int nrows;
+    int ncols_hdr;
+    char col_name[HYDRA_MAX_COLS][16];
+    hydra_row_t rows[HYDRA_MAX_ROWS];
+} hydra_snapshot_t;
+
+/* Parse a counter file; returns 0, or -1 (available = 0) if unreadable */
+int hydra_snapshot(const char *path, hydra_snapshot_t *s);
+
+/* after - before, row by row; rows missing from before count from zero */
+void hydra_delta(const hydra_snapshot_t *before, const hydra_snapshot_t *after,
+                 hydra_snapshot_t *delta);
+
+/*
+ * Trial bracketing used by the benchmarks, results go into the record.
+ * The HYDRA_HISTORY environment variable overrides the default path.
+ */
+void hydra_trial_begin(void);
+void hydra_trial_end(void);
+const hydra_snapshot_t *hydra_trial_delta(void);
+
+/* Text report of the last trial's delta; silent if Hydra is missing */
+void hydra_print_delta(void);
+
+#endif /* HYDRA_PROC_H */
@@ -0,0 +1,246 @@
+/*
+ * perf.c - Hardware and software counters around the timed loop
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf.h"
+
+#define WALK_RAW_INTEL 0x1008  /* event 0x08 umask 0x10 */
+
+static int enabled;
+static int user_only;
+
+/* Tracepoints the call-function IPIs are counted through */
+static const char *const ipi_events[] = {
+    "irq_vectors/call_function_entry",
+    "irq_vectors/call_function_single_entry",
+};
+#define IPI_EVENTS (int)(sizeof(ipi_events) / sizeof(ipi_events[0]))
+
+static const char *const tracefs_roots[] = {
+    "/sys/kernel/tracing/events",
+    "/sys/kernel/debug/tracing/events",
+};
+
+static int trial_ncpus;
+static int *trial_fd;         /* trial_ncpus * IPI_EVENTS, -1 if closed */
+static uint64_t *trial_ipis;  /* per CPU, from the last trial */
+
+static const char *const event_names[PERF_EVENTS] = {
+    [PERF_CYCLES]       = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_DTLB_MISSES]  = "dtlb_load_misses",
+    [PERF_WALK_CYCLES]  = "walk_cycles",
+    [PERF_CTX_SWITCHES] = "ctx_switches",
+};
+
+void perf_set_enabled(int on) {
+    enabled = on;
+}
+
+int perf_enabled(void) {
+    return enabled;
+}
+
+const char *perf_event_name(int ev) {
+    return ev >= 0 && ev < PERF_EVENTS ? event_names[ev] : "unknown";
+}
+
+int perf_user_only(void) {
+    return user_only;
+}
+
+static int perf_open(struct perf_event_attr *attr, int pid, int cpu) {
+    return (int)syscall(SYS_perf_event_open, attr, pid, cpu, -1, 0);
+}
+
+/* Fill attr for ev; returns -1 if the event does not exist on this CPU */
+static int event_attr(int ev, struct perf_event_attr *attr) {
+    const char *env;
+
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->disabled = 1;
+    attr->exclude_hv = 1;
+    attr->exclude_kernel = user_only;
+
+    switch (ev) {
+    case PERF_CYCLES:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        return 0;
+    case PERF_INSTRUCTIONS:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        return 0;
+    case PERF_DTLB_MISSES:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_DTLB |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        return 0;
+    case PERF_WALK_CYCLES:
+        attr->type = PERF_TYPE_RAW;
+        env = getenv("HYDRA_PERF_WALK");
+        if (env) {
+            attr->config = strtoull(env, NULL, 16);
+            return 0;
+        }
+        if (!__builtin_cpu_is("intel"))
+            return -1;
+        attr->config = WALK_RAW_INTEL;
+        return 0;
+    case PERF_CTX_SWITCHES:
+        attr->type = PERF_TYPE_SOFTWARE;
+        attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+        return 0;
+    }
+    return -1;
+}
+
+void perf_thread_start(perf_counters_t *pc) {
+    struct perf_event_attr attr;
+
+    if (!enabled)
+        return;
+
+    pc->open = 0;
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (event_attr(ev, &attr) != 0)
+            continue;
+        pc->fd[ev] = perf_open(&attr, 0, -1);
+        /* perf_event_paranoid >= 2 refuses kernel counting for non-root */
+        if (pc->fd[ev] < 0 && (errno == EACCES || errno == EPERM) && !user_only) {
+            user_only = 1;
+            attr.exclude_kernel = 1;
+            pc->fd[ev] = perf_open(&attr, 0, -1);
+        }
+        if (pc->fd[ev] >= 0)
+            pc->open |= 1u << ev;
+    }
+
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (pc->open & (1u << ev))
+            ioctl(pc->fd[ev], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_thread_stop(perf_counters_t *pc) {
+    uint64_t v;
+
+    if (!enabled)
+        return;
+
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (pc->open & (1u << ev))
+            ioctl(pc->fd[ev], PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (int ev = 0; ev < PERF_EVENTS; ev++) {
+        if (!(pc->open & (1u << ev)))
+            continue;
+        if (read(pc->fd[ev], &v, sizeof(v)) == sizeof(v)) {
+            pc->count[ev] += v;
+            pc->valid |= 1u << ev;
+        }
+        close(pc->fd[ev]);
+    }
+    pc->open = 0;
+}
+
+void perf_reset(perf_counters_t *pc) {
+    memset(pc->count, 0, sizeof(pc->count));
+    pc->valid = 0;
+}
+
+/* Tracepoint id from tracefs, -1 if the event is not available */
+static long tracepoint_id(const char *event) {
+    char path[256];
+    long id = -1;
+    FILE *f;
+
+    for (size_t r = 0; r < sizeof(tracefs_roots) / sizeof(tracefs_roots[0]); r++) {
+        snprintf(path, sizeof(path), "%s/%s/id", tracefs_roots[r], event);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        if (fscanf(f, "%ld", &id) != 1)
+            id = -1;
+        fclose(f);
+        if (id >= 0)
+            break;
+    }
+    return id;
+}
+
+void perf_trial_begin(void) {
+    struct perf_event_attr attr;
+    int ncpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+    int opened = 0;
+
+    trial_ncpus = 0;
+    if (!enabled || ncpus <= 0)
+        return;
+
+    free(trial_fd);
+    free(trial_ipis);
+    trial_fd = malloc(ncpus * IPI_EVENTS * sizeof(int));
+    trial_ipis = calloc(ncpus, sizeof(uint64_t));
+    if (!trial_fd || !trial_ipis)
+        return;
+
+    for (int e = 0; e < IPI_EVENTS; e++) {
+        long id = tracepoint_id(ipi_events[e]);
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.disabled = 1;
+        for (int cpu = 0; cpu < ncpus; cpu++) {
+            int *fd = &trial_fd[cpu * IPI_EVENTS + e];
+
+            *fd = id >= 0 ? perf_open(&attr, -1, cpu) : -1;
+            if (*fd >= 0)
+                opened++;
+        }
+    }
+    if (opened == 0)
+        return;
+
+    trial_ncpus = ncpus;
+    for (int i = 0; i < ncpus * IPI_EVENTS; i++) {
+        if (trial_fd[i] >= 0)
+            ioctl(trial_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_trial_end(void) {
+    uint64_t v;
+
+    for (int i = 0; i < trial_ncpus * IPI_EVENTS; i++) {
+        if (trial_fd[i] < 0)
+            continue;
+        ioctl(trial_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(trial_fd[i], &v, sizeof(v)) == sizeof(v))
+            trial_ipis[i / IPI_EVENTS] += v;
+        close(trial_fd[i]);
+        trial_fd[i] = -1;
+    }
+}
+
+int perf_trial_ncpus(void) {
+    return trial_ncpus;
+}
+
+uint64_t perf_trial_ipis(int cpu) {
+    return cpu >= 0 && cpu < trial_ncpus ? trial_ipis[cpu] : 0;
+}
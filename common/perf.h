@@ -0,0 +1,61 @@
+/*
+ * perf.h - Hardware and software counters around the timed loop
+ *
+ * With --perf each worker opens its own perf events just before the timed
+ * loop and reads them right after, so the counts cover the same section as
+ * elapsed_sec. The trial bracket additionally counts call-function IPIs
+ * (the vectors TLB shootdowns arrive on) on every CPU, which shows where
+ * the interrupts of a run landed. Events the CPU or kernel refuses are
+ * left out of the report rather than failing the run.
+ */
+
+#ifndef HYDRA_PERF_H
+#define HYDRA_PERF_H
+
+#include <stdint.h>
+
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_DTLB_MISSES,    /* dTLB-load-misses */
+    PERF_WALK_CYCLES,    /* dtlb_load_misses.walk_duration, Intel raw event */
+    PERF_CTX_SWITCHES,
+    PERF_EVENTS
+};
+
+typedef struct {
+    uint64_t count[PERF_EVENTS];
+    unsigned valid;      /* bit per event that was counted */
+    unsigned open;       /* bit per event with a live fd */
+    int fd[PERF_EVENTS];
+} perf_counters_t;
+
+void perf_set_enabled(int on);
+int perf_enabled(void);
+
+/* Short event name used in the report and record */
+const char *perf_event_name(int ev);
+
+/* 1 if the kernel refused kernel-mode counting and events are user only */
+int perf_user_only(void);
+
+/*
+ * Calling thread only. start opens and enables the events, stop disables,
+ * adds the counts to pc->count and closes them; both are no-ops without
+ * --perf. $HYDRA_PERF_WALK overrides the raw walk-cycles config (hex).
+ */
+void perf_thread_start(perf_counters_t *pc);
+void perf_thread_stop(perf_counters_t *pc);
+void perf_reset(perf_counters_t *pc);
+
+/* System-wide IPI counting, called next to hydra_trial_begin/end */
+void perf_trial_begin(void);
+void perf_trial_end(void);
+
+/* Number of CPUs counted in the last trial, 0 if the tracepoints were missing */
+int perf_trial_ncpus(void);
+
+/* Call-function IPIs received by cpu during the last trial */
+uint64_t perf_trial_ipis(int cpu);
+
+#endif /* HYDRA_PERF_H */
@@ -0,0 +1,281 @@
+/*
+ * report.c - Machine-readable result records
+ *
+ * The record is built once into a JSON buffer and, in parallel, a CSV
+ * header/value pair, so both formats always carry the same fields.
+ */
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hydra.h"
+#include "report.h"
+#include "store.h"
+
+#define REC_DEPTH 8
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+typedef struct {
+    int is_array;
+    int count;
+    char name[48];
+} rec_frame_t;
+
+static out_format_t format = FMT_TEXT;
+static FILE *rec_out;
+
+static strbuf_t json, csv_hdr, csv_val;
+static strbuf_t csv_last_hdr;
+static rec_frame_t stack[REC_DEPTH];
+static int depth;
+
+static void sb_printf(strbuf_t *sb, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    for (;;) {
+        size_t room = sb->cap - sb->len;
+
+        va_start(ap, fmt);
+        n = vsnprintf(sb->buf ? sb->buf + sb->len : NULL, room, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < room) {
+            sb->len += n;
+            return;
+        }
+
+        size_t cap = sb->cap ? sb->cap * 2 : 4096;
+        while (cap - sb->len <= (size_t)n)
+            cap *= 2;
+        char *p = realloc(sb->buf, cap);
+        if (!p)
+            return;
+        sb->buf = p;
+        sb->cap = cap;
+    }
+}
+
+static void sb_reset(strbuf_t *sb) {
+    sb->len = 0;
+    if (sb->buf)
+        sb->buf[0] = '\0';
+}
+
+static void json_string(strbuf_t *sb, const char *s) {
+    sb_printf(sb, "\"");
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            sb_printf(sb, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            sb_printf(sb, "\\u%04x", *s);
+        else
+            sb_printf(sb, "%c", *s);
+    }
+    sb_printf(sb, "\"");
+}
+
+static void csv_field(strbuf_t *sb, const char *s) {
+    if (strpbrk(s, ",\"\n")) {
+        sb_printf(sb, "\"");
+        for (; *s; s++) {
+            sb_printf(sb, *s == '"' ? "\"\"" : "%c", *s);
+        }
+        sb_printf(sb, "\"");
+    } else {
+        sb_printf(sb, "%s", s);
+    }
+}
+
+int report_set_format(const char *name) {
+    int fd;
+
+    if (strcmp(name, "text") == 0) {
+        format = FMT_TEXT;
+        return 0;
+    }
+    if (strcmp(name, "json") == 0)
+        format = FMT_JSON;
+    else if (strcmp(name, "csv") == 0)
+        format = FMT_CSV;
+    else
+        return -1;
+
+    /* Keep the real stdout for the record, send the text report to stderr */
+    if (!rec_out) {
+        fflush(stdout);
+        fd = dup(STDOUT_FILENO);
+        if (fd < 0 || !(rec_out = fdopen(fd, "w"))) {
+            perror("dup stdout");
+            rec_out = stdout;
+            return 0;
+        }
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    return 0;
+}
+
+out_format_t report_format(void) {
+    return format;
+}
+
+int report_structured(void) {
+    return format != FMT_TEXT || store_active();
+}
+
+/* Emit the key for a new value and record its dotted CSV column name */
+static void begin_value(const char *key) {
+    rec_frame_t *f = &stack[depth - 1];
+    char index[16];
+
+    if (f->count++ > 0)
+        sb_printf(&json, ",");
+    if (f->is_array) {
+        snprintf(index, sizeof(index), "%d", f->count - 1);
+        key = index;
+    } else {
+        json_string(&json, key);
+        sb_printf(&json, ":");
+    }
+
+    if (csv_hdr.len > 0)
+        sb_printf(&csv_hdr, ",");
+    for (int i = 1; i < depth; i++) {
+        sb_printf(&csv_hdr, "%s.", stack[i].name);
+    }
+    sb_printf(&csv_hdr, "%s", key);
+}
+
+static void begin_csv_value(void) {
+    if (csv_val.len > 0)
+        sb_printf(&csv_val, ",");
+}
+
+void rec_begin(const char *benchmark) {
+    sb_reset(&json);
+    sb_reset(&csv_hdr);
+    sb_reset(&csv_val);
+    memset(stack, 0, sizeof(stack));
+    depth = 1;
+
+    sb_printf(&json, "{");
+    rec_str("benchmark", benchmark);
+}
+
+static void open_frame(const char *name, int is_array) {
+    rec_frame_t *parent = &stack[depth - 1];
+    rec_frame_t *f;
+
+    if (depth == REC_DEPTH)
+        return;
+
+    if (parent->count++ > 0)
+        sb_printf(&json, ",");
+    f = &stack[depth++];
+    memset(f, 0, sizeof(*f));
+    f->is_array = is_array;
+    if (parent->is_array) {
+        snprintf(f->name, sizeof(f->name), "%d", parent->count - 1);
+    } else {
+        snprintf(f->name, sizeof(f->name), "%s", name);
+        json_string(&json, name);
+        sb_printf(&json, ":");
+    }
+    sb_printf(&json, is_array ? "[" : "{");
+}
+
+void rec_object(const char *name) {
+    open_frame(name, 0);
+}
+
+void rec_array(const char *name) {
+    open_frame(name, 1);
+}
+
+void rec_close(void) {
+    if (depth <= 1)
+        return;
+    depth--;
+    sb_printf(&json, stack[depth].is_array ? "]" : "}");
+}
+
+void rec_int(const char *key, long long v) {
+    begin_value(key);
+    sb_printf(&json, "%lld", v);
+    begin_csv_value();
+    sb_printf(&csv_val, "%lld", v);
+}
+
+void rec_double(const char *key, double v) {
+    begin_value(key);
+    begin_csv_value();
+    if (isfinite(v)) {
+        sb_printf(&json, "%.9g", v);
+        sb_printf(&csv_val, "%.9g", v);
+    } else {
+        sb_printf(&json, "null");
+    }
+}
+
+void rec_str(const char *key, const char *v) {
+    begin_value(key);
+    json_string(&json, v);
+    begin_csv_value();
+    csv_field(&csv_val, v);
+}
+
+void rec_hydra(void) {
+    const hydra_snapshot_t *d = hydra_trial_delta();
+
+    rec_object("hydra");
+    rec_int("available", d->available);
+    for (int r = 0; r < d->nrows; r++) {
+        const hydra_row_t *row = &d->rows[r];
+
+        if (d->ncols_hdr == row->ncols) {
+            rec_object(row->label);
+            for (int c = 0; c < row->ncols; c++) {
+                rec_int(d->col_name[c], row->val[c]);
+            }
+        } else {
+            rec_array(row->label);
+            for (int c = 0; c < row->ncols; c++) {
+                rec_int(NULL, row->val[c]);
+            }
+        }
+        rec_close();
+    }
+    rec_close();
+}
+
+void rec_end(void) {
+    FILE *out = rec_out ? rec_out : stdout;
+
+    while (depth > 1)
+        rec_close();
+    sb_printf(&json, "}");
+    store_record(json.buf);
+
+    if (format == FMT_JSON) {
+        fprintf(out, "%s\n", json.buf);
+    } else if (format == FMT_CSV) {
+        /* Later records of a sweep with the same columns share the header */
+        if (!csv_last_hdr.buf || strcmp(csv_last_hdr.buf, csv_hdr.buf) != 0) {
+            fprintf(out, "%s\n", csv_hdr.buf);
+            sb_reset(&csv_last_hdr);
+            sb_printf(&csv_last_hdr, "%s", csv_hdr.buf);
+        }
+        fprintf(out, "%s\n", csv_val.buf);
+    }
+    fflush(out);
+}
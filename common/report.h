@@ -0,0 +1,51 @@
+/*
+ * report.h - Machine-readable result records
+ *
+ * With --format=json or --format=csv a benchmark emits one record per run
+ * on stdout: a single-line JSON object, or a CSV header plus one value row
+ * with dotted column names (nodes.0.ops). The human-readable text report is
+ * moved to stderr in those modes so it never mixes with the record. A run
+ * that sweeps several points emits one record per point: one JSON line
+ * each, or one CSV row each under a shared header.
+ *
+ * Records are built with nested rec_object()/rec_array() calls:
+ *
+ *     rec_begin("microbenchmark2");
+ *     rec_object("config");
+ *     rec_int("region_kb", 64);
+ *     rec_close();
+ *     rec_end();
+ */
+
+#ifndef HYDRA_REPORT_H
+#define HYDRA_REPORT_H
+
+typedef enum {
+    FMT_TEXT,
+    FMT_JSON,
+    FMT_CSV
+} out_format_t;
+
+/* Select the output format; returns -1 for an unknown name */
+int report_set_format(const char *name);
+out_format_t report_format(void);
+
+/* True when a record should be built and emitted */
+int report_structured(void);
+
+void rec_begin(const char *benchmark);
+void rec_end(void);
+
+/* Open a nested object or array; name is ignored inside arrays */
+void rec_object(const char *name);
+void rec_array(const char *name);
+void rec_close(void);
+
+void rec_int(const char *key, long long v);
+void rec_double(const char *key, double v);
+void rec_str(const char *key, const char *v);
+
+/* Add the Hydra counter delta of the last trial as a "hydra" object */
+void rec_hydra(void);
+
+#endif /* HYDRA_REPORT_H */
@@ -0,0 +1,34 @@
+/*
+ * series.c - Operations per fixed time bucket
+ *
+ * See series.h for the folding scheme.
+ */
+
+#include <string.h>
+
+#include "series.h"
+
+void series_start(series_t *s, uint64_t now, uint64_t width_ns) {
+    memset(s, 0, sizeof(*s));
+    s->start_ns = now;
+    s->width_ns = width_ns;
+}
+
+void series_fold(series_t *s, uint64_t width_ns) {
+    uint64_t factor;
+
+    if (!s->width_ns || width_ns <= s->width_ns)
+        return;
+    factor = width_ns / s->width_ns;
+
+    for (uint32_t i = 0; i < SERIES_BUCKETS; i++) {
+        uint64_t sum = 0;
+
+        for (uint64_t j = i * factor; j < (i + 1) * factor && j < SERIES_BUCKETS; j++) {
+            sum += s->ops[j];
+        }
+        s->ops[i] = (uint32_t)sum;
+    }
+    s->used = (uint32_t)((s->used + factor - 1) / factor);
+    s->width_ns = width_ns;
+}
@@ -0,0 +1,43 @@
+/*
+ * series.h - Operations per fixed time bucket
+ *
+ * A worker counts its completed operations into buckets of width_ns from
+ * the start of its timed loop. When the run outgrows SERIES_BUCKETS the
+ * width doubles and neighbouring buckets are folded together, so any run
+ * length fits and the widths of two series are always a power of two
+ * apart. Like hist_t, a series is owned by one worker while recording.
+ */
+
+#ifndef HYDRA_SERIES_H
+#define HYDRA_SERIES_H
+
+#include <stdint.h>
+
+#define SERIES_BUCKETS 256
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t width_ns;  /* 0 until series_start() */
+    uint32_t used;      /* buckets up to the last recorded one */
+    uint32_t ops[SERIES_BUCKETS];
+} series_t;
+
+void series_start(series_t *s, uint64_t now, uint64_t width_ns);
+
+/* Coarsen to width_ns, a power-of-two multiple of the current width */
+void series_fold(series_t *s, uint64_t width_ns);
+
+static inline void series_add(series_t *s, uint64_t now, uint32_t ops) {
+    uint64_t idx;
+
+    if (!s->width_ns)
+        return;
+    while ((idx = (now - s->start_ns) / s->width_ns) >= SERIES_BUCKETS) {
+        series_fold(s, s->width_ns * 2);
+    }
+    s->ops[idx] += ops;
+    if (idx >= s->used)
+        s->used = (uint32_t)idx + 1;
+}
+
+#endif /* HYDRA_SERIES_H */
@@ -0,0 +1,177 @@
+/*
+ * stats.c - Small-sample statistics for comparing benchmark runs
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+static int cmp_double(const void *pa, const void *pb) {
+    double a = *(const double *)pa;
+    double b = *(const double *)pb;
+    return (a > b) - (a < b);
+}
+
+/* xorshift64*, deterministic so repeated reports agree */
+static uint64_t rng_next(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1Dull;
+}
+
+double stats_mean(const double *x, size_t n) {
+    double sum = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        sum += x[i];
+    }
+    return n ? sum / n : 0.0;
+}
+
+double stats_stddev(const double *x, size_t n) {
+    double mean = stats_mean(x, n);
+    double ss = 0;
+
+    if (n < 2)
+        return 0.0;
+
+    for (size_t i = 0; i < n; i++) {
+        ss += (x[i] - mean) * (x[i] - mean);
+    }
+    return sqrt(ss / (n - 1));
+}
+
+double stats_median(const double *x, size_t n) {
+    double *tmp, m;
+
+    if (n == 0)
+        return 0.0;
+
+    tmp = malloc(n * sizeof(*tmp));
+    if (!tmp)
+        return 0.0;
+    memcpy(tmp, x, n * sizeof(*tmp));
+    qsort(tmp, n, sizeof(*tmp), cmp_double);
+    m = (n & 1) ? tmp[n / 2] : (tmp[n / 2 - 1] + tmp[n / 2]) / 2;
+    free(tmp);
+    return m;
+}
+
+void stats_bootstrap_ratio(const double *a, size_t na,
+                           const double *b, size_t nb,
+                           double conf, int resamples,
+                           double *lo, double *hi) {
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    double *ratios;
+    int k = 0;
+
+    *lo = *hi = 0.0;
+    if (na == 0 || nb == 0 || resamples <= 0)
+        return;
+
+    ratios = malloc(resamples * sizeof(*ratios));
+    if (!ratios)
+        return;
+
+    for (int r = 0; r < resamples; r++) {
+        double sa = 0, sb = 0;
+
+        for (size_t i = 0; i < na; i++) {
+            sa += a[rng_next(&seed) % na];
+        }
+        for (size_t i = 0; i < nb; i++) {
+            sb += b[rng_next(&seed) % nb];
+        }
+        if (sa != 0)
+            ratios[k++] = (sb / nb) / (sa / na);
+    }
+
+    if (k > 0) {
+        qsort(ratios, k, sizeof(*ratios), cmp_double);
+        *lo = ratios[(int)((1.0 - conf) / 2 * (k - 1))];
+        *hi = ratios[(int)((1.0 + conf) / 2 * (k - 1))];
+    }
+    free(ratios);
+}
+
+typedef struct {
+    double v;
+    int group;
+} ranked_t;
+
+static int cmp_ranked(const void *pa, const void *pb) {
+    return cmp_double(&((const ranked_t *)pa)->v, &((const ranked_t *)pb)->v);
+}
+
+double stats_mann_whitney(const double *a, size_t na,
+                          const double *b, size_t nb, double *u) {
+    size_t n = na + nb;
+    ranked_t *all;
+    double rank_sum_a = 0, tie_term = 0;
+    double u_a, mu, sigma, z;
+
+    if (u)
+        *u = 0;
+    if (na == 0 || nb == 0)
+        return 1.0;
+
+    all = malloc(n * sizeof(*all));
+    if (!all)
+        return 1.0;
+    for (size_t i = 0; i < na; i++) {
+        all[i].v = a[i];
+        all[i].group = 0;
+    }
+    for (size_t i = 0; i < nb; i++) {
+        all[na + i].v = b[i];
+        all[na + i].group = 1;
+    }
+    qsort(all, n, sizeof(*all), cmp_ranked);
+
+    /* Average ranks over runs of ties */
+    for (size_t i = 0; i < n; ) {
+        size_t j = i;
+        double rank;
+
+        while (j + 1 < n && all[j + 1].v == all[i].v)
+            j++;
+        rank = (i + j) / 2.0 + 1;
+        for (size_t k = i; k <= j; k++) {
+            if (all[k].group == 0)
+                rank_sum_a += rank;
+        }
+        tie_term += pow((double)(j - i + 1), 3) - (j - i + 1);
+        i = j + 1;
+    }
+    free(all);
+
+    u_a = rank_sum_a - na * (na + 1) / 2.0;
+    if (u)
+        *u = u_a;
+
+    mu = na * nb / 2.0;
+    sigma = sqrt(na * nb / 12.0 * ((n + 1) - tie_term / ((double)n * (n - 1))));
+    if (sigma == 0)
+        return 1.0;
+
+    /* Continuity correction towards the mean */
+    z = (fabs(u_a - mu) - 0.5) / sigma;
+    if (z < 0)
+        z = 0;
+    return erfc(z / sqrt(2.0));
+}
+
+double stats_prediction_p(const double *x, size_t n, const double *y, size_t m) {
+    double sd = stats_stddev(x, n);
+    double d = fabs(stats_mean(y, m) - stats_mean(x, n));
+
+    if (n < 2 || m == 0)
+        return 1.0;
+    if (sd == 0)
+        return d == 0 ? 1.0 : 0.0;
+    return erfc(d / (sd * sqrt(1.0 / m + 1.0 / n)) / sqrt(2.0));
+}
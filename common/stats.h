@@ -0,0 +1,37 @@
+/*
+ * stats.h - Small-sample statistics for comparing benchmark runs
+ */
+
+#ifndef HYDRA_STATS_H
+#define HYDRA_STATS_H
+
+#include <stddef.h>
+
+double stats_mean(const double *x, size_t n);
+double stats_stddev(const double *x, size_t n);
+double stats_median(const double *x, size_t n);
+
+/*
+ * Bootstrap confidence interval for mean(b) / mean(a). Both samples are
+ * resampled independently; conf is the two-sided level, e.g. 0.95.
+ */
+void stats_bootstrap_ratio(const double *a, size_t na,
+                           const double *b, size_t nb,
+                           double conf, int resamples,
+                           double *lo, double *hi);
+
+/*
+ * Two-sided Mann-Whitney U test (normal approximation with tie correction).
+ * Returns the p-value; U for sample a is stored in *u if non-NULL.
+ */
+double stats_mann_whitney(const double *a, size_t na,
+                          const double *b, size_t nb, double *u);
+
+/*
+ * Two-sided p-value of the mean of m new runs y against reference sample x,
+ * from the normal prediction interval mean(x) +- z * sd(x) * sqrt(1/m + 1/n).
+ * For new sides too small for a rank test to ever reach significance.
+ */
+double stats_prediction_p(const double *x, size_t n, const double *y, size_t m);
+
+#endif /* HYDRA_STATS_H */
@@ -0,0 +1,534 @@
+/*
+ * store.c - Append-only results store and baseline comparison
+ *
+ * See store.h. Each run is one line, header fields first so a reader can
+ * match runs without parsing the records:
+ *
+ *     {"time":...,"label":...,"variant":...,"benchmark":...,"config":...,
+ *      "kernel":...,"host":...,"git":...,"topology":{...},
+ *      "metrics":[{"name":...,"value":...,"higher_is_better":...}],
+ *      "records":[...]}
+ *
+ * The line is written with a single O_APPEND write under flock(), so
+ * concurrent runs sharing a store do not interleave.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/utsname.h>
+
+#include "ab.h"
+#include "harness.h"
+#include "stats.h"
+#include "store.h"
+#include "topology.h"
+
+#ifndef HYDRA_GIT_HASH
+#define HYDRA_GIT_HASH "unknown"
+#endif
+
+#define STORE_MAX_METRICS 256
+#define STORE_ALPHA 0.05
+#define STORE_RANK_MIN 4  /* runs per side before Mann-Whitney can reach STORE_ALPHA */
+#define DEFAULT_REGRESS_PCT 5.0
+
+typedef struct {
+    char name[96];
+    double value;
+    int higher_is_better;
+} store_metric_t;
+
+/* Stored runs of one label that match this run */
+typedef struct {
+    char **lines;
+    int n;
+} run_set_t;
+
+static const char *store_path;
+static const char *compare_label;
+static const char *opt_label;
+static const char *variant = "default";
+static double regress_pct = DEFAULT_REGRESS_PCT;
+static pid_t owner_pid;
+
+static store_metric_t metrics[STORE_MAX_METRICS];
+static int num_metrics;
+static char *records;
+static size_t records_len;
+static char config[1024];
+static char label[65];
+
+/* Store options and --format are left out of the configuration key */
+static const char *const skip_opts[] = {
+    "--store", "--label", "--compare", "--variant", "--regress-pct", "--format", NULL
+};
+
+int store_active(void) {
+    return store_path && !ab_child() && !ab_active();
+}
+
+void store_metric(const char *name, double value, int higher_is_better) {
+    store_metric_t *m;
+
+    if (!store_active() || num_metrics == STORE_MAX_METRICS)
+        return;
+    m = &metrics[num_metrics++];
+    snprintf(m->name, sizeof(m->name), "%s", name);
+    m->value = value;
+    m->higher_is_better = higher_is_better;
+}
+
+void store_record(const char *json) {
+    size_t len = strlen(json);
+    char *p;
+
+    if (!store_active())
+        return;
+    p = realloc(records, records_len + len + 2);
+    if (!p)
+        return;
+    records = p;
+    if (records_len > 0)
+        records[records_len++] = ',';
+    memcpy(records + records_len, json, len + 1);
+    records_len += len;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Writing                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static void put_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(f, "\\u%04x", *s);
+        else
+            fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static int skipped_opt(const char *arg, int *takes_value) {
+    for (int i = 0; skip_opts[i]; i++) {
+        size_t len = strlen(skip_opts[i]);
+
+        if (strncmp(arg, skip_opts[i], len) != 0)
+            continue;
+        if (arg[len] == '\0') {
+            *takes_value = 1;
+            return 1;
+        }
+        if (arg[len] == '=') {
+            *takes_value = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The command line after argv[0], without the options in skip_opts */
+static void read_config(void) {
+    char buf[4096];
+    size_t len = 0, pos = 0;
+    int skip_next = 0, first = 1;
+    FILE *f = fopen("/proc/self/cmdline", "r");
+
+    if (f) {
+        len = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+    }
+    buf[len] = '\0';
+
+    for (char *arg = buf + strlen(buf) + 1; arg < buf + len; arg += strlen(arg) + 1) {
+        int takes_value;
+
+        if (skip_next) {
+            skip_next = 0;
+            continue;
+        }
+        if (skipped_opt(arg, &takes_value)) {
+            skip_next = takes_value;
+            continue;
+        }
+        pos += snprintf(config + pos, pos < sizeof(config) ? sizeof(config) - pos : 0,
+                        "%s%s", first ? "" : " ", arg);
+        first = 0;
+    }
+}
+
+static int append_run(void) {
+    struct utsname uts;
+    char date[32];
+    char *line = NULL;
+    size_t line_len = 0;
+    time_t now = time(NULL);
+    FILE *m = open_memstream(&line, &line_len);
+    int fd, rc = 0;
+
+    if (!m) {
+        perror("open_memstream");
+        return -1;
+    }
+    uname(&uts);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(m, "{\"time\":");
+    put_string(m, date);
+    fprintf(m, ",\"label\":");
+    put_string(m, label);
+    fprintf(m, ",\"variant\":");
+    put_string(m, variant);
+    fprintf(m, ",\"benchmark\":");
+    put_string(m, program_invocation_short_name);
+    fprintf(m, ",\"config\":");
+    put_string(m, config);
+    fprintf(m, ",\"kernel\":");
+    put_string(m, uts.release);
+    fprintf(m, ",\"kernel_version\":");
+    put_string(m, uts.version);
+    fprintf(m, ",\"host\":");
+    put_string(m, uts.nodename);
+    fprintf(m, ",\"git\":");
+    put_string(m, HYDRA_GIT_HASH);
+    fprintf(m, ",\"topology\":{\"nodes\":%d,\"cpu_nodes\":%d,\"sockets\":%d,\"cpus\":%ld}",
+            topo_nodes(), topo_cpu_nodes(), topo_sockets(), sysconf(_SC_NPROCESSORS_ONLN));
+
+    fprintf(m, ",\"metrics\":[");
+    for (int i = 0; i < num_metrics; i++) {
+        fprintf(m, "%s{\"name\":", i ? "," : "");
+        put_string(m, metrics[i].name);
+        if (isfinite(metrics[i].value))
+            fprintf(m, ",\"value\":%.17g", metrics[i].value);
+        else
+            fprintf(m, ",\"value\":null");
+        fprintf(m, ",\"higher_is_better\":%d}", metrics[i].higher_is_better);
+    }
+    fprintf(m, "],\"records\":[%s]}\n", records ? records : "");
+    fclose(m);
+
+    fd = open(store_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open results store %s: %s\n", store_path, strerror(errno));
+        free(line);
+        return -1;
+    }
+    flock(fd, LOCK_EX);
+    if (write(fd, line, line_len) != (ssize_t)line_len) {
+        fprintf(stderr, "Short write to results store %s\n", store_path);
+        rc = -1;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    free(line);
+    return rc;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Reading                                                                  */
+/* ------------------------------------------------------------------------ */
+
+/* Value of the first "key": in line; header fields come before any record */
+static const char *find_key(const char *line, const char *key) {
+    char pat[64];
+    const char *p;
+
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    p = strstr(line, pat);
+    return p ? p + strlen(pat) : NULL;
+}
+
+/* Decode the JSON string at p into out; returns the end of it, NULL if malformed */
+static const char *read_string(const char *p, char *out, size_t size) {
+    size_t n = 0;
+
+    if (!p || *p++ != '"')
+        return NULL;
+    for (; *p && *p != '"'; p++) {
+        char c = *p;
+
+        /* put_string() only writes \" \\ and \u00XX */
+        if (c == '\\') {
+            c = *++p;
+            if (c == 'u') {
+                char hex[5] = { 0 };
+
+                if (strnlen(p + 1, 4) < 4)
+                    return NULL;
+                memcpy(hex, p + 1, 4);
+                c = (char)strtol(hex, NULL, 16);
+                p += 4;
+            } else if (!c) {
+                return NULL;
+            }
+        }
+        if (n + 1 < size)
+            out[n++] = c;
+    }
+    if (*p != '"')
+        return NULL;
+    out[n] = '\0';
+    return p + 1;
+}
+
+static int field_is(const char *line, const char *key, const char *want) {
+    char val[sizeof(config)];
+
+    return read_string(find_key(line, key), val, sizeof(val)) && strcmp(val, want) == 0;
+}
+
+/* Value of metric name in a stored line; 0 if found */
+static int line_metric(const char *line, const char *name, double *v) {
+    char cur[sizeof(metrics[0].name)];
+    const char *p = find_key(line, "metrics");
+
+    if (!p || *p++ != '[')
+        return -1;
+    while (*p == '{') {
+        p = read_string(find_key(p, "name"), cur, sizeof(cur));
+        if (!p)
+            return -1;
+        p = find_key(p, "value");
+        if (!p)
+            return -1;
+        if (strcmp(cur, name) == 0 && strncmp(p, "null", 4) != 0) {
+            *v = strtod(p, NULL);
+            return 0;
+        }
+        p = strchr(p, '}');
+        if (!p)
+            return -1;
+        p++;
+        if (*p == ',')
+            p++;
+    }
+    return -1;
+}
+
+/* Stored runs of want_label with this run's benchmark, configuration and variant */
+static int load_runs(const char *want_label, run_set_t *set) {
+    char *line = NULL;
+    size_t cap = 0;
+    FILE *f = fopen(store_path, "r");
+
+    memset(set, 0, sizeof(*set));
+    if (!f) {
+        fprintf(stderr, "Cannot read results store %s: %s\n", store_path, strerror(errno));
+        return -1;
+    }
+    while (getline(&line, &cap, f) > 0) {
+        char **p;
+
+        if (!field_is(line, "label", want_label) ||
+            !field_is(line, "benchmark", program_invocation_short_name) ||
+            !field_is(line, "config", config) || !field_is(line, "variant", variant))
+            continue;
+        p = realloc(set->lines, (set->n + 1) * sizeof(*p));
+        if (!p)
+            break;
+        set->lines = p;
+        set->lines[set->n++] = strdup(line);
+    }
+    free(line);
+    fclose(f);
+    return 0;
+}
+
+static void free_runs(run_set_t *set) {
+    for (int i = 0; i < set->n; i++) {
+        free(set->lines[i]);
+    }
+    free(set->lines);
+}
+
+static int run_values(const run_set_t *set, const char *name, double *out) {
+    int n = 0;
+
+    for (int i = 0; i < set->n; i++) {
+        if (line_metric(set->lines[i], name, &out[n]) == 0)
+            n++;
+    }
+    return n;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Comparison                                                               */
+/* ------------------------------------------------------------------------ */
+
+/* Prints one metric against the baseline; returns 1 for a regression */
+static int compare_metric(const store_metric_t *m, const run_set_t *base, const run_set_t *cur) {
+    double *b = calloc(base->n + 1, sizeof(double));
+    double *c = calloc(cur->n + 1, sizeof(double));
+    int nb = b ? run_values(base, m->name, b) : 0;
+    int nc = c ? run_values(cur, m->name, c) : 0;
+    double change, p, u;
+    const char *test, *verdict;
+    int worse, regression = 0;
+
+    printf("\n%s (%s is better):\n", m->name, m->higher_is_better ? "higher" : "lower");
+    printf("  %-9s  n=%-3d mean %.4g  sd %.3g  median %.4g\n", "baseline", nb,
+           stats_mean(b, nb), stats_stddev(b, nb), stats_median(b, nb));
+    printf("  %-9s  n=%-3d mean %.4g  sd %.3g  median %.4g\n", "this", nc,
+           stats_mean(c, nc), stats_stddev(c, nc), stats_median(c, nc));
+
+    if (nb < 2 || nc < 1 || stats_mean(b, nb) == 0) {
+        printf("  Not enough baseline runs to test (need 2)\n");
+        free(b);
+        free(c);
+        return 0;
+    }
+
+    /* Few new runs, e.g. one per build, are tested against the baseline spread */
+    if (nb >= STORE_RANK_MIN && nc >= STORE_RANK_MIN) {
+        p = stats_mann_whitney(b, nb, c, nc, &u);
+        test = "Mann-Whitney";
+    } else {
+        p = stats_prediction_p(b, nb, c, nc);
+        test = "prediction interval";
+    }
+    change = (stats_mean(c, nc) / stats_mean(b, nb) - 1) * 100;
+    worse = m->higher_is_better ? change < 0 : change > 0;
+
+    if (p >= STORE_ALPHA)
+        verdict = "not significant (noise)";
+    else if (fabs(change) < regress_pct)
+        verdict = "significant, below threshold";
+    else if (worse)
+        verdict = "REGRESSION";
+    else
+        verdict = "improvement";
+    regression = p < STORE_ALPHA && fabs(change) >= regress_pct && worse;
+
+    printf("  Change: %+.1f%%  p = %.4g (%s) -> %s\n", change, p, test, verdict);
+    free(b);
+    free(c);
+    return regression;
+}
+
+/* Returns the number of regressed metrics, -1 if the store could not be read */
+static int compare_runs(void) {
+    run_set_t base, cur;
+    int regressions = 0;
+
+    if (load_runs(compare_label, &base) != 0)
+        return -1;
+    if (load_runs(label, &cur) != 0) {
+        free_runs(&base);
+        return -1;
+    }
+
+    printf("\n");
+    print_rule();
+    printf("BASELINE COMPARISON (%s vs %s, variant %s):\n", label, compare_label, variant);
+    print_rule();
+    printf("Configuration: %s\n", config[0] ? config : "(defaults)");
+    printf("Stored runs: %d baseline, %d this label; regression threshold %.1f%%\n",
+           base.n, cur.n, regress_pct);
+    for (int i = 0; i < num_metrics; i++) {
+        regressions += compare_metric(&metrics[i], &base, &cur);
+    }
+    printf("\n");
+    if (regressions > 0)
+        printf("%d metric%s regressed against %s\n", regressions, regressions == 1 ? "" : "s",
+               compare_label);
+    else
+        printf("No regression against %s\n", compare_label);
+    print_rule();
+
+    free_runs(&base);
+    free_runs(&cur);
+    return regressions;
+}
+
+/* Runs from atexit(): save the run, then compare and fail the exit status */
+static void store_finish(void) {
+    int regressions;
+
+    if (getpid() != owner_pid || !store_active() || (num_metrics == 0 && !records))
+        return;
+    fflush(stdout);
+
+    if (append_run() != 0)
+        return;
+    printf("\nStored as %s (%s) in %s\n", label, variant, store_path);
+
+    if (!compare_label)
+        return;
+    regressions = compare_runs();
+    fflush(NULL);
+    if (regressions > 0)
+        _exit(STORE_EXIT_REGRESSION);
+}
+
+int store_check(void) {
+    struct utsname uts;
+
+    if (!store_path) {
+        if (!compare_label)
+            return 0;
+        fprintf(stderr, "--compare needs the store to read: --store FILE\n");
+        return -1;
+    }
+
+    if (opt_label) {
+        snprintf(label, sizeof(label), "%s", opt_label);
+    } else {
+        uname(&uts);
+        snprintf(label, sizeof(label), "%s", uts.release);
+    }
+    if (compare_label && strcmp(compare_label, label) == 0) {
+        fprintf(stderr, "--compare %s is this run's own label; set --label\n", compare_label);
+        return -1;
+    }
+    read_config();
+
+    if (!owner_pid) {
+        owner_pid = getpid();
+        atexit(store_finish);
+    }
+    return 0;
+}
+
+int store_parse_opt(int opt, const char *arg) {
+    switch (opt) {
+    case OPT_STORE:
+        store_path = arg;
+        return 0;
+    case OPT_LABEL:
+        opt_label = arg;
+        return 0;
+    case OPT_COMPARE:
+        compare_label = arg;
+        return 0;
+    case OPT_VARIANT:
+        variant = arg;
+        return 0;
+    case OPT_REGRESS_PCT:
+        regress_pct = atof(arg);
+        if (regress_pct >= 0)
+            return 0;
+        fprintf(stderr, "Invalid regression threshold: %s\n", arg);
+        return -1;
+    }
+    return -1;
+}
+
+void store_print_usage(void) {
+    fprintf(stderr, "  --store FILE        Append this run's results to a JSONL store (not with --ab)\n");
+    fprintf(stderr, "  --label NAME        Build under test in the store (default: kernel release)\n");
+    fprintf(stderr, "  --variant NAME      Arm in the store, e.g. linux or hydra (default: default)\n");
+    fprintf(stderr, "  --compare LABEL     Test against the stored runs of LABEL, exit %d on a regression\n",
+            STORE_EXIT_REGRESSION);
+    fprintf(stderr, "  --regress-pct PCT   Smallest significant change that fails (default: %.0f)\n",
+            DEFAULT_REGRESS_PCT);
+}
@@ -0,0 +1,38 @@
+/*
+ * store.h - Append-only results store and baseline comparison
+ *
+ * With --store FILE every run appends one JSON line to FILE: when and where
+ * it ran (kernel, host, NUMA topology, git hash of the benchmark build), its
+ * configuration (the command line without the store options), the headline
+ * metrics it reported through ab_report_metric() and all of its result
+ * records. --label names the build under test (default: the kernel
+ * release) and --variant the arm, e.g. linux or hydra, so both arms of a
+ * runner can share one store.
+ *
+ * --compare LABEL then takes the stored runs of LABEL with the same
+ * benchmark, configuration and variant as the baseline and tests every
+ * metric of this label's runs against it. A metric that is significantly
+ * worse by more than --regress-pct makes the run exit with
+ * STORE_EXIT_REGRESSION, so a pipeline fails on it.
+ */
+
+#ifndef HYDRA_STORE_H
+#define HYDRA_STORE_H
+
+#define STORE_EXIT_REGRESSION 3
+
+/* True when this process saves its results; records are built then */
+int store_active(void);
+
+/* Collect one headline metric or one finished JSON record of this run */
+void store_metric(const char *name, double value, int higher_is_better);
+void store_record(const char *json);
+
+/* Cross-option checks, called from harness_init(); -1 after an error */
+int store_check(void);
+
+/* Option handling, see harness_parse_opt() */
+int store_parse_opt(int opt, const char *arg);
+void store_print_usage(void);
+
+#endif /* HYDRA_STORE_H */
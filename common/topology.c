@@ -0,0 +1,215 @@
+/*
+ * topology.c - NUMA topology as the benchmarks see it
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <numa.h>
+
+#include "report.h"
+#include "topology.h"
+
+static int n_nodes;
+static int span;
+static int one_hop;  /* smallest distance between two sockets */
+static int node_cpus[TOPO_MAX_NODES];
+static int node_socket[TOPO_MAX_NODES];
+
+static const char *const class_names[DIST_CLASSES] = {
+    [DIST_LOCAL]   = "local",
+    [DIST_SOCKET]  = "same socket",
+    [DIST_ONE_HOP] = "one hop",
+    [DIST_TWO_HOP] = "two hops",
+};
+
+/* physical_package_id of cpu, or 0 where sysfs does not say */
+static int cpu_socket(int cpu) {
+    char path[96];
+    FILE *f;
+    int id = 0;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    f = fopen(path, "r");
+    if (!f)
+        return 0;
+    if (fscanf(f, "%d", &id) != 1 || id < 0)
+        id = 0;
+    fclose(f);
+    return id;
+}
+
+int topology_init(void) {
+    struct bitmask *cpus = numa_allocate_cpumask();
+
+    n_nodes = numa_max_node() + 1;
+    if (n_nodes > TOPO_MAX_NODES)
+        n_nodes = TOPO_MAX_NODES;
+    span = 0;
+    for (int node = 0; node < n_nodes; node++) {
+        node_cpus[node] = 0;
+        node_socket[node] = -1;
+        if (numa_node_to_cpus(node, cpus) < 0)
+            continue;
+        for (int cpu = 0; cpu < numa_num_configured_cpus(); cpu++) {
+            if (!numa_bitmask_isbitset(cpus, cpu))
+                continue;
+            if (node_cpus[node]++ == 0)
+                node_socket[node] = cpu_socket(cpu);
+        }
+        if (node_cpus[node] > 0)
+            span = node + 1;
+    }
+    numa_free_cpumask(cpus);
+
+    one_hop = 0;
+    for (int a = 0; a < n_nodes; a++) {
+        for (int b = 0; b < n_nodes; b++) {
+            int d = topo_distance(a, b);
+
+            if (node_cpus[a] && node_cpus[b] && node_socket[a] != node_socket[b] &&
+                d > 0 && (one_hop == 0 || d < one_hop))
+                one_hop = d;
+        }
+    }
+    return span > 0 ? span : -1;
+}
+
+int topo_nodes(void) {
+    return n_nodes;
+}
+
+int topo_span(void) {
+    return span;
+}
+
+int topo_cpus(int node) {
+    return node >= 0 && node < n_nodes ? node_cpus[node] : 0;
+}
+
+int topo_socket(int node) {
+    return node >= 0 && node < n_nodes ? node_socket[node] : -1;
+}
+
+int topo_distance(int a, int b) {
+    int d = numa_distance(a, b);
+
+    return d > 0 ? d : 0;
+}
+
+int topo_cpu_nodes(void) {
+    return topo_mask_nodes(~0UL);
+}
+
+int topo_sockets(void) {
+    return topo_mask_sockets(~0UL);
+}
+
+int topo_snc(void) {
+    int most = 1;
+
+    for (int a = 0; a < n_nodes; a++) {
+        int same = 0;
+
+        for (int b = 0; b < n_nodes && node_cpus[a]; b++) {
+            if (node_cpus[b] && node_socket[b] == node_socket[a])
+                same++;
+        }
+        if (same > most)
+            most = same;
+    }
+    return most;
+}
+
+dist_class_t topo_class(int a, int b) {
+    if (a == b)
+        return DIST_LOCAL;
+    if (node_socket[a] >= 0 && node_socket[a] == node_socket[b])
+        return DIST_SOCKET;
+    if (one_hop == 0 || topo_distance(a, b) <= one_hop)
+        return DIST_ONE_HOP;
+    return DIST_TWO_HOP;
+}
+
+const char *dist_class_name(dist_class_t c) {
+    return c >= 0 && c < DIST_CLASSES ? class_names[c] : "unknown";
+}
+
+int topo_mask_nodes(unsigned long mask) {
+    int n = 0;
+
+    for (int node = 0; node < n_nodes; node++) {
+        if ((mask & (1UL << node)) && node_cpus[node])
+            n++;
+    }
+    return n;
+}
+
+int topo_mask_sockets(unsigned long mask) {
+    int n = 0;
+
+    for (int node = 0; node < n_nodes; node++) {
+        int first = 1;
+
+        if (!(mask & (1UL << node)) || !node_cpus[node])
+            continue;
+        /* Count a socket at its lowest node in the mask */
+        for (int prev = 0; prev < node && first; prev++) {
+            if ((mask & (1UL << prev)) && node_cpus[prev] &&
+                node_socket[prev] == node_socket[node])
+                first = 0;
+        }
+        n += first;
+    }
+    return n;
+}
+
+void print_topology(void) {
+    int mem_only = 0;
+
+    printf("Topology: %d socket%s, %d node%s with CPUs", topo_sockets(),
+           topo_sockets() > 1 ? "s" : "", topo_cpu_nodes(), topo_cpu_nodes() > 1 ? "s" : "");
+    if (topo_snc() > 1)
+        printf(" (SNC-%d)", topo_snc());
+    for (int node = 0; node < n_nodes; node++) {
+        if (node_cpus[node])
+            continue;
+        printf(mem_only++ ? ",%d" : ", memory-only (skipped): %d", node);
+    }
+    printf("\n");
+    if (n_nodes < 2)
+        return;
+
+    printf("  %-6s %6s %6s  distances\n", "node", "cpus", "socket");
+    for (int a = 0; a < n_nodes; a++) {
+        if (node_cpus[a])
+            printf("  %-6d %6d %6d ", a, node_cpus[a], node_socket[a]);
+        else
+            printf("  %-6d %6d %6s ", a, 0, "-");
+        for (int b = 0; b < n_nodes; b++) {
+            printf(" %3d", topo_distance(a, b));
+        }
+        printf("\n");
+    }
+}
+
+void rec_topology(void) {
+    rec_object("topology");
+    rec_int("sockets", topo_sockets());
+    rec_int("cpu_nodes", topo_cpu_nodes());
+    rec_int("snc", topo_snc());
+    rec_array("nodes");
+    for (int a = 0; a < n_nodes; a++) {
+        rec_object(NULL);
+        rec_int("node", a);
+        rec_int("cpus", node_cpus[a]);
+        rec_int("socket", node_socket[a]);
+        rec_array("distance");
+        for (int b = 0; b < n_nodes; b++) {
+            rec_int(NULL, topo_distance(a, b));
+        }
+        rec_close();
+        rec_close();
+    }
+    rec_close();
+    rec_close();
+}
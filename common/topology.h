@@ -0,0 +1,53 @@
+/*
+ * topology.h - NUMA topology as the benchmarks see it
+ *
+ * numa_num_configured_nodes() also counts memory-only nodes (CXL
+ * expanders, HBM), which no worker can run on. The topology is read once
+ * by harness_init(): CPUs and socket per node and the numa_distance()
+ * matrix, from which node pairs are put into distance classes. Nodes
+ * sharing a socket are sub-NUMA clusters (SNC); between sockets the
+ * smallest distance counts as one hop and anything further as two hops.
+ */
+
+#ifndef HYDRA_TOPOLOGY_H
+#define HYDRA_TOPOLOGY_H
+
+#define TOPO_MAX_NODES 64
+
+typedef enum {
+    DIST_LOCAL,     /* same node */
+    DIST_SOCKET,    /* another node of the same socket (SNC) */
+    DIST_ONE_HOP,   /* nearest remote socket */
+    DIST_TWO_HOP,   /* further away, or a memory-only node beyond that */
+    DIST_CLASSES
+} dist_class_t;
+
+/*
+ * Read the topology; returns the number of node ids the benchmarks use,
+ * one past the highest node with CPUs, or -1 if there is none.
+ */
+int topology_init(void);
+
+/* Node ids known to libnuma, including memory-only nodes past topo_span() */
+int topo_nodes(void);
+int topo_span(void);
+
+int topo_cpus(int node);         /* 0 for memory-only nodes */
+int topo_socket(int node);       /* -1 for memory-only nodes */
+int topo_distance(int a, int b); /* SLIT value, 0 if unknown */
+int topo_cpu_nodes(void);
+int topo_sockets(void);
+int topo_snc(void);              /* most CPU nodes on one socket, 1 without SNC */
+
+dist_class_t topo_class(int a, int b);
+const char *dist_class_name(dist_class_t c);
+
+/* Sockets and nodes with CPUs among the nodes set in mask */
+int topo_mask_sockets(unsigned long mask);
+int topo_mask_nodes(unsigned long mask);
+
+/* Config lines: sockets, SNC, memory-only nodes and the distance matrix */
+void print_topology(void);
+void rec_topology(void);
+
+#endif /* HYDRA_TOPOLOGY_H */
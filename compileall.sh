@@ -1,2 +1,3 @@
 #!/bin/bash
-find . -name "*.c" -exec sh -c 'gcc "$1" -o "${1%.c}" -lnuma' _ {} \;
+# Release build of every benchmark; see the Makefile for debug and sanitize
+exec make -C "$(dirname "$0")" "$@"